@@ -12,6 +12,7 @@
 #include "utils.h"
 #include <memory>
 class RooRealVar;
+class CascadeMinimizer;
 #include <RooAbsReal.h>
 #include <RooArgSet.h>
 #include <RooFitResult.h>
@@ -30,6 +31,7 @@ public:
   std::vector<std::pair<float,float> > runLimitExpected(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) ;
 
   float findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double quantile) ; 
+  float findCrossingFromProfile(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double threshold) ;
 
   const std::string& name() const override { static std::string name_ = "AsymptoticLimits"; return name_; }
 private:
@@ -49,6 +51,9 @@ private:
 
   static double rValue_;
 
+  static std::string massPoints_;
+  static std::vector<double> massValues_;
+
   static bool   strictBounds_;
 
   static RooAbsData * asimovDataset_;
@@ -57,15 +62,27 @@ private:
   bool    hasDiscreteParams_;
   mutable std::unique_ptr<RooArgSet>  params_;
   mutable std::unique_ptr<RooAbsReal> nllD_, nllA_; 
+  /// keep nllD_, nllA_ from the previous call of runLimit (only when scanning several masses on the same data)
+  bool reuseNLLs_ = false;
   //mutable std::unique_ptr<RooFitResult> fitFreeD_, fitFreeA_;
   //mutable std::unique_ptr<RooFitResult> fitFixD_,  fitFixA_;
   utils::CheapValueSnapshot fitFreeD_, fitFreeA_, fitFixD_,  fitFixA_;
 
+  /// one conditional fit (value of r, profiled nll, parameter values), kept for --minosAlgo profile
+  struct ProfilePoint { double r, nll; utils::CheapValueSnapshot snap; };
+  /// profiled points of nllD_, nllA_ (observed limit) and of the Asimov nll used for the expected limits
+  std::vector<ProfilePoint> profileD_, profileA_, profileExp_;
+  static const ProfilePoint * nearestProfilePoint(const std::vector<ProfilePoint> &cache, double rVal) ;
+  bool profileAt(RooAbsReal &nll, RooRealVar *r, CascadeMinimizer &minim, std::vector<ProfilePoint> &cache, double rVal) ;
+
   mutable double                      minNllD_,  minNllA_, rBestD_;
   mutable RooArgSet snapGlobalObsData, snapGlobalObsAsimov;
 
   float calculateLimitFromGrid(RooRealVar *, double, double);
 
+  bool runHypothesis(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
+  bool runMassScan(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
+
   RooAbsData *asimovDataset(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data);
   double getCLs(RooRealVar &r, double rVal, bool getAlsoExpected=false, double *limit=0, double *limitErr=0);
   
@@ -0,0 +1,76 @@
+#ifndef HiggsAnalysis_CombinedLimit_AsyncOutputWriter_h
+#define HiggsAnalysis_CombinedLimit_AsyncOutputWriter_h
+/** \class AsyncOutputWriter
+ *
+ * Fills a TTree and writes objects into the output file from a background thread, so that the
+ * compression and the I/O don't stall the computation.
+ * fill() copies the current values of the branches of the tree into a row that is put in a queue
+ * of bounded size; the thread copies it into the buffers that the branches point to while the writer
+ * is active, and fills the tree. write() queues an object to be written into a directory.
+ * All the writes into the output file must go through the writer while it is active (or be done
+ * after a sync()), since ROOT files can't be written from two threads at once.
+ * Only branches with a single leaf of fixed size are supported: with other branches the writer
+ * falls back to filling the tree directly.
+ * The writer thread is not copied by fork(): the queue is drained before forking, and in the child the
+ * writer falls back to filling the tree and writing the objects directly (e.g. in the HybridNew --fork children).
+ *
+ */
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TTree;
+class TBranch;
+class TDirectory;
+class TObject;
+
+class AsyncOutputWriter {
+    public:
+        AsyncOutputWriter(TTree *tree, unsigned int maxQueue) ;
+        /// writes everything still in the queue, and gives back the branches their addresses
+        ~AsyncOutputWriter() ;
+        /// queue the current values of the branches of the tree
+        void fill() ;
+        /// queue obj to be written in dir; takes ownership of obj
+        void write(TDirectory *dir, TObject *obj, const char *name) ;
+        /// wait until everything in the queue has been written
+        void sync() ;
+        /// address of the variable of a branch, as given when the branch was made
+        void *userAddress(TBranch *branch) const ;
+        /// time spent by the calling thread waiting for the writer (s)
+        double blockedTime() const { return blocked_; }
+        unsigned long rows() const { return rows_; }
+        unsigned long objects() const { return objects_; }
+    private:
+        struct Column { TBranch *branch; char *address; unsigned int size, offset; };
+        struct Item { std::vector<char> row; TDirectory *dir = nullptr; TObject *obj = nullptr; std::string name; };
+        bool bind_() ;
+        void unbind_() ;
+        void push_(Item &&item) ;
+        void run_() ;
+        static void beforeFork_() ;
+        static void afterForkParent_() ;
+        static void afterForkChild_() ;
+        static std::vector<AsyncOutputWriter *> & writers_() ;
+
+        TTree *tree_;
+        unsigned int maxQueue_;
+        std::vector<Column> columns_;
+        std::vector<char> shadow_; // where the branches point to while the writer is active
+        int nbranches_ = -1;
+        bool direct_ = false;
+        // the queue, shared with the thread
+        std::deque<Item> queue_;
+        std::mutex mutex_;
+        std::condition_variable wake_, done_;
+        bool busy_ = false, stop_ = false;
+        std::thread thread_;
+        bool forked_ = false; // in a child process, where thread_ does not exist
+        double blocked_ = 0;
+        unsigned long rows_ = 0, objects_ = 0;
+};
+
+#endif
@@ -43,9 +43,18 @@ class CMSHistFunc : public RooAbsReal {
     std::vector<double> x1;
     std::vector<double> x2;
     std::vector<double> y;
+    // Edges of the output bins and width of the bin below each edge
+    std::vector<double> edges;
+    std::vector<double> widths;
+    // buffers used by cdfMorph, to avoid allocating them in each evaluation
+    std::vector<double> xdisn;
+    std::vector<double> sigdisf;
 
     FastTemplate sum;
     FastTemplate diff;
+    // single precision copies of sum and diff, used instead of them with EnableFloatStorage
+    std::vector<float> fsum;
+    std::vector<float> fdiff;
 
     FastTemplate step1;
     FastTemplate step2;
@@ -141,11 +150,17 @@ class CMSHistFunc : public RooAbsReal {
   inline FastTemplate const& errors() const { return binerrors_; }
   inline FastHisto const& cache() const { return rebin_ ? rebin_cache_ : cache_; }
 
+  /// templates used for the morphing, possibly shared with other functions through the TemplatePool
+  inline FastTemplate const& storage(unsigned idx) const { return pooled_.empty() ? storage_[idx] : *pooled_[idx]; }
+  inline unsigned storageSize() const { return pooled_.empty() ? storage_.size() : pooled_.size(); }
+
   CMSHistFuncWrapper const* wrapper() const;
 
   RooAbsReal const& getXVar() const;
 
   static void EnableFastVertical();
+  /// keep the vertical morphing templates in single precision (the morphing is still done in double precision)
+  static void EnableFloatStorage(bool flag = true);
   friend class CMSHistV<CMSHistFunc>;
   friend class CMSHistSum;
 
@@ -170,6 +185,8 @@ class CMSHistFunc : public RooAbsReal {
   mutable FastHisto rebin_cache_;
   FastTemplate binerrors_;
   std::vector<FastTemplate> storage_;
+  // when reading from file the templates are moved to the TemplatePool, and storage_ is left empty
+  std::vector<std::shared_ptr<const FastTemplate>> pooled_; //! not to be serialized
 
   mutable GlobalCache global_;  //! not to be serialized
   mutable std::vector<Cache> mcache_;  //! not to be serialized
@@ -191,6 +208,7 @@ class CMSHistFunc : public RooAbsReal {
   mutable std::vector<RooAbsReal*> vmorphs_vec_; //! not to be serialized
 
   static bool enable_fast_vertical_; //! not to be serialized
+  static bool enable_float_storage_; //! not to be serialized
 
   // This is an "optional proxy", i.e. a list with either zero or one entry
   RooListProxy external_morph_;
@@ -212,13 +230,20 @@ class CMSHistFunc : public RooAbsReal {
 
   void prepareInterpCache(Cache& c1, Cache const& c2) const;
 
-  FastTemplate cdfMorph(unsigned idx, double par1, double par2,
-                        double parinterp) const;
+  void setSumDiff(Cache& c, FastTemplate const& hi, FastTemplate const& lo, FastTemplate const& nominal) const;
+
+  void cdfMorph(unsigned idx, double par1, double par2,
+                double parinterp, FastTemplate& out) const;
 
   double integrateTemplate(FastTemplate const& t) const;
 
   void applyRebin() const;
 
+  /// move the templates to the TemplatePool
+  void poolStorage();
+  /// take back a private copy of the templates, before modifying them
+  void unpoolStorage();
+
   ClassDefOverride(CMSHistFunc, 2)
 };
 
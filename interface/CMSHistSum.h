@@ -76,6 +76,9 @@ public:
   RooAbsReal const& getXVar() const { return x_.arg(); }
 
   static void EnableFastVertical();
+  /// use single precision copies of the vertical morphing templates (the morphing is still done in double precision);
+  /// copies made with this enabled keep only the single precision ones
+  static void EnableFloatStorage(bool flag = true);
   friend class CMSHistV<CMSHistSum>;
 
   void injectExternalMorph(int idx, CMSExternalMorph& morph);
@@ -93,6 +96,9 @@ public:
   std::vector<FastTemplate> storage_;  // All nominal and vmorph templates
   std::vector<int> process_fields_; // Indicies for process templates in storage_
   std::vector<int> vmorph_fields_; // Indicies for vmorph templates in storage_
+  // Single precision vmorph templates, with EnableFloatStorage. The copy constructor then releases the double
+  // precision vmorph templates in storage_ (e.g. in the clones made for the NLL), so copies must not be written out
+  mutable std::vector<std::vector<float>> fstorage_; //!
 
   std::vector<FastTemplate> binerrors_; // Bin errors for each process
 
@@ -129,8 +135,10 @@ public:
   mutable bool analytic_bb_; //! not to be serialized
 
   mutable std::vector<double> vertical_prev_vals_; //! not to be serialized
+  mutable std::vector<double> vertical_vals_; //! not to be serialized
   mutable int fast_mode_; //! not to be serialized
   static bool enable_fast_vertical_; //! not to be serialized
+  static bool enable_float_storage_; //! not to be serialized
 
   RooListProxy external_morphs_;
   std::vector<int> external_morph_indices_;
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <map>
+#include <chrono>
 #include <RooAbsPdf.h>
 #include <RooAddPdf.h>
 #include <RooRealSumPdf.h>
@@ -18,6 +19,7 @@
 #include "SimpleGaussianConstraint.h"
 #include "SimplePoissonConstraint.h"
 #include "SimpleConstraintGroup.h"
+#include "SimpleConstraintBlock.h"
 
 class RooMultiPdf;
 
@@ -110,9 +112,21 @@ class OptimizedCachingPdfT : public CachingPdf {
 
 CachingPdfBase * makeCachingPdf(RooAbsReal *pdf, const RooArgSet *obs) ;
 
+/// Run-time flags and error state used in the evaluation of one NLL, instead of process-wide statics.
+/// A CachingSimNLL and its channels share one; a clone gets its own copy.
+struct NLLEvalContext {
+    NLLEvalContext() ;
+    bool gentleNegativePenalty;   // GENTLE_LEE
+    bool expEventsNoNorm;         // ADDNLL_ROOREALSUM_NONORM
+    bool removeConstantZeroPoint; // REMOVE_CONSTANT_ZERO_POINT
+    bool noDeepLEE;               // SIMNLL_NO_LEE: set hasError instead of calling logEvalError
+    bool hasError = false;
+};
+
 class CachingAddNLL : public RooAbsReal {
     public:
-        CachingAddNLL(const char *name, const char *title, RooAbsPdf *pdf, RooAbsData *data, bool includeZeroWeights = false) ;
+        CachingAddNLL(const char *name, const char *title, RooAbsPdf *pdf, RooAbsData *data, bool includeZeroWeights = false,
+                      std::shared_ptr<NLLEvalContext> context = std::shared_ptr<NLLEvalContext>()) ;
         CachingAddNLL(const CachingAddNLL &other, const char *name = 0) ;
         ~CachingAddNLL() override ;
         CachingAddNLL *clone(const char *name = 0) const override ;
@@ -138,9 +152,11 @@ class CachingAddNLL : public RooAbsReal {
         virtual void  setIncludeZeroWeights(bool includeZeroWeights) ;
         RooSetProxy & params() { return params_; }
         RooSetProxy & catParams() { return catParams_; }
+        const NLLEvalContext & evalContext() const { return *context_; }
     private:
         void setup_();
         void addPdfs_(RooAddPdf *addpdf, bool recursive, const RooArgList & basecoeffs) ;
+        std::shared_ptr<NLLEvalContext> context_;
         RooAbsPdf *pdf_;
         RooSetProxy params_, catParams_;
         const RooAbsData *data_;
@@ -177,7 +193,11 @@ class CachingSimNLL  : public RooAbsReal {
         bool getParameters(const RooArgSet* depList, RooArgSet& outputSet, bool stripDisconnected=true) const override;
 #endif
         void splitWithWeights(const RooAbsData &data, const RooAbsCategory& splitCat, Bool_t createEmptyDataSets) ;
-        static void setNoDeepLogEvalError(bool noDeep) { noDeepLEE_ = noDeep; }
+        void setNoDeepLogEvalError(bool noDeep) { context_->noDeepLEE = noDeep; }
+        /// true if an error was found during the evaluation while logEvalError is off (SIMNLL_NO_LEE)
+        bool hasError() const { return context_->hasError; }
+        void clearError() { context_->hasError = false; }
+        const NLLEvalContext & evalContext() const { return *context_; }
         void setZeroPoint() ; 
         void clearZeroPoint() ;
         void clearConstantZeroPoint() ;
@@ -188,7 +208,17 @@ class CachingSimNLL  : public RooAbsReal {
         void setHideRooCategories(bool flag) { hideRooCategories_ = flag; }
         void setHideConstants(bool flag) { hideConstants_ = flag; }
         void setMaskConstraints(bool flag) ;
+        /// evaluate only the constraint terms, not the channels
+        void setMaskChannels(bool flag) ;
         void setMaskNonDiscreteChannels(bool mask) ;
+        /// evaluate only the channels flagged in active (an empty vector unmasks all channels)
+        void setActiveChannels(const std::vector<bool> &active) ;
+        const std::vector<CachingAddNLL*> & channelNLLs() const { return pdfs_; }
+        const std::vector<RooAbsPdf *> & genericConstraints() const { return constrainPdfs_; }
+        /// number of times evaluate() was called on this object
+        unsigned long evalCount() const { return evalCount_; }
+        /// contribution of the constraint terms to the NLL at the current parameter values (not affected by the masks)
+        double constraintsNLL() const ;
         friend class CachingAddNLL;
         // trap this call, since we don't care about propagating it to the sub-components
         void constOptimizeTestStatistic(ConstOpCode opcode, Bool_t doAlsoTrackingOpt=kTRUE) override { }
@@ -208,21 +238,23 @@ class CachingSimNLL  : public RooAbsReal {
         std::vector<SimplePoissonConstraint *>   constrainPdfsFastPoisson_;
         std::vector<bool>                        constrainPdfsFastPoissonOwned_;
         std::vector<SimpleConstraintGroup>       constrainPdfGroups_;
+        SimpleConstraintBlock                    constrainBlockFast_;
         std::vector<CachingAddNLL*>     pdfs_;
         std::unique_ptr<TList>            dataSets_;
         std::vector<RooDataSet *>       datasets_;
-        static bool noDeepLEE_;
-        static bool hasError_;
+        std::shared_ptr<NLLEvalContext> context_;
         static bool optimizeContraints_;
         std::vector<double> constrainZeroPoints_;
-        std::vector<double> constrainZeroPointsFast_;
-        std::vector<double> constrainZeroPointsFastPoisson_;
         std::vector<RooAbsReal*> channelMasks_;
         std::vector<bool>        internalMasks_;
         bool                     maskConstraints_ = false;
+        bool                     maskChannels_ = false;
         RooArgSet                activeParameters_, activeCatParameters_;
         double                   maskingOffset_ = 0;     // offset to ensure that interal or constraint masking doesn't change NLL value
         double                   maskingOffsetZero_ = 0; // and associated zero point
+        mutable unsigned long    evalCount_ = 0;
+        bool                     setupTiming_ = false;   // SIMNLL_SETUP_TIMING
+        std::chrono::steady_clock::time_point setupStart_; // start of setup_, to report the time to the first evaluation
 };
 
 }
@@ -59,7 +59,29 @@ class CascadeMinimizer {
        
         bool iterativeMinimize(double &,int,bool); 
 
+        /// group of channels sharing no floating parameter other than the POIs with the rest of the model,
+        /// together with the discrete indices (position in pdfCategories) and the parameters they depend on.
+        /// Also used for a single channel and the parameters that only it depends on (no categories)
+        struct DiscreteBlock {
+            std::vector<bool> channels;
+            std::vector<int>  categories;
+            RooArgSet         params;
+        };
+        /// returns false if the model does not split in at least two independent blocks
+        bool findIndependentBlocks(std::vector<DiscreteBlock> &blocks) const ;
+        /// choose the best indices of each block with the POIs fixed, minimizing only the channels of that block
+        bool profileIndependentBlocks(std::vector<DiscreteBlock> &blocks, int verbose, bool cascade);
+        /// discrete profiling using independent blocks. Returns false (having done nothing) if the model does not factorise
+        bool factorizedMinimize(bool &ret, int verbose, bool cascade);
+        /// split the floating parameters in blocks that enter only one channel, and the rest (global). Returns false if there are no such blocks
+        bool findLocalBlocks(std::vector<DiscreteBlock> &blocks, RooArgSet &global) const ;
+        /// alternate fits of the global parameters and of each channel-local block (evaluating only that channel), then a full fit.
+        /// Returns false (having done nothing) if the model has no channel-local parameters
+        bool blockCoordinateMinimize(bool &ret, int verbose, bool cascade);
+
         void remakeMinimizer() ;
+        /// add a minimizer run to the telemetry record of the current call (if --cminTelemetry is set)
+        void recordStage(const std::string &name, int strategy, double tolerance, int status) ;
 
         /// options configured from command line
         static boost::program_options::options_description options_;
@@ -97,6 +119,10 @@ class CascadeMinimizer {
         static int minuit2StorageLevel_;
 
 	static double discreteMinTol_;
+        /// max number of rounds of block-coordinate minimization before the full fit (0 = disabled)
+        static int blockCoordinate_;
+        /// file for the telemetry records (--cminTelemetry)
+        static std::string telemetryFile_;
 
 	static std::string defaultMinimizerType_;
 	static std::string defaultMinimizerAlgo_;
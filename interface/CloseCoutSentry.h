@@ -1,7 +1,12 @@
 #ifndef HiggsAnalysis_CombinedLimit_CloseCoutSentry_
 #define HiggsAnalysis_CombinedLimit_CloseCoutSentry_
-/** This class redirects cout and cerr to /dev/null when created,
-    and restores them back when destroyed.                        */
+/** This class silences cout and cerr when created, and restores them back when destroyed.
+    By default the file descriptors of stdout and stderr are redirected to /dev/null: this silences everything,
+    but for the whole process.
+    With --X-rtd CLOSECOUT_THREAD=1 only the calling thread is silenced instead: std::cout and std::cerr are given
+    a stream buffer that drops what is written by a silenced thread, and the messages of ROOT's error handler
+    below kFatal are dropped as well (RooFit and Minuit2 print through these). Output written directly with
+    printf is not silenced in this mode. */
 #include <cstdio>
 
 class CloseCoutSentry {
@@ -14,8 +19,11 @@ class CloseCoutSentry {
         static void breakFree() ;
         FILE *trueStdOut();
         static FILE *trueStdOutGlobal();
+        /// true if the file descriptors are redirected (the default), false if only the streams of the thread are silenced (CLOSECOUT_THREAD)
+        static bool useFileDescriptors() ;
     private:
         bool silent_;
+        bool fd_;
         static int fdOut_, fdErr_, fdTmp_, fdOutDup_;
         static bool open_;
         // always clear, even if I was not the one closing it
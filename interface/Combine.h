@@ -3,12 +3,15 @@
 #include <TString.h>
 #include <TFile.h>
 #include <boost/program_options.hpp>
+#include <memory>
 #include "RooArgSet.h"
 #include "RooAbsReal.h"
 #include "RooRealVar.h"
 
 class TDirectory;
 class TTree;
+class TObject;
+class AsyncOutputWriter;
 class LimitAlgo;
 class RooWorkspace;
 class RooAbsData;
@@ -57,6 +60,15 @@ public:
   /// Add a branch to the output tree (for advanced use or debugging only)
   static void addBranch(const char *name, void *address, const char *leaflist) ;
 
+  /// Change the mass stored in the output tree (for algorithms that scan several mass hypotheses in one job)
+  static void setTreeMass(double mass) ;
+
+  /// Write obj into dir (a directory of the output file), taking ownership of it. With --asyncOutput it's written by the background writer
+  static void writeOutput(TDirectory *dir, TObject *obj, const char *name) ;
+
+  /// Wait for the background writer to finish: must be called before writing directly into the output file
+  static void syncOutput() ;
+
   static std::string& nllBackend();
 
   static void setNllBackend(std::string const&);
@@ -82,6 +94,7 @@ private:
   bool hintUsesStatOnly_;
   bool toysNoSystematics_;
   bool toysFrequentist_;
+  unsigned int toysFork_;
   float expectSignal_;
   bool expectSignalSet_;  // keep track of whether or not expectSignal was defaulted
   float expectSignalMass_;
@@ -100,6 +113,8 @@ private:
   bool validateModel_;
   bool saveToys_;
   double mass_;
+  unsigned int asyncOutputQueue_;
+  int outputCompression_;
 
   // implementation-related variables
   bool compiledExpr_;
@@ -115,6 +130,7 @@ private:
   std::vector<std::string> modelPoints_;
   
   static TTree *tree_;
+  static std::unique_ptr<AsyncOutputWriter> asyncOutput_;
 
   static std::vector<std::pair<RooAbsReal*,float> > trackedParametersMap_;
   static std::vector<std::pair<RooRealVar*,float> > trackedErrorsMap_;
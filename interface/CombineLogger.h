@@ -4,28 +4,104 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
+/** \class CombineLogger
+ *
+ * Messages are printed on stdout by the calling thread, and put in a bounded lock-free ring buffer from
+ * which a background thread writes them into the log file, either as text or as JSON lines.
+ * log() can be called from any thread. In hot code use COMBINE_LOG(format, ...): the message is only
+ * formatted if it's going to be written, and each call site writes at most maxPerSite() messages.
+ *
+ */
 class CombineLogger
 {
-	public: 
-		static int nLogs;
+	public:
+		/// a place in the code that logs messages through COMBINE_LOG
+		class Site {
+			public:
+				Site(const char *file, int line, const char *function) ;
+				/// number of this message if it is to be written (1, 2, ...), 0 if it's over the limit
+				unsigned int accept() {
+					unsigned int n = ++calls_;
+					return (maxPerSite_ == 0 || n <= maxPerSite_) ? n : 0;
+				}
+				const char *file() const { return file_; }
+				int line() const { return line_; }
+				const char *function() const { return function_; }
+			private:
+				const char *file_;
+				int line_;
+				const char *function_;
+				std::atomic<unsigned int> calls_;
+		};
+
+		static std::atomic<int> nLogs;
 
 		static CombineLogger& instance();
-		
+
 		static void setName(const char* _fName){
 			fName=_fName;
 		};
+		/// write the log file as JSON lines instead of text
+		void setJSON(bool json) { json_ = json; }
+		/// max number of messages written by each COMBINE_LOG call site (0 = no limit)
+		static void setMaxPerSite(unsigned int max) { maxPerSite_ = max; }
+		static unsigned int maxPerSite() { return maxPerSite_; }
 
 		void log(const std::string & _file, const int _lineN, const std::string& _logmsg, const std::string& _function);
+		/// used by COMBINE_LOG: n is the number returned by site.accept()
+		void logf(const Site &site, unsigned int n, const char *format, ...) __attribute__((format(printf, 4, 5)));
+		/// wait until all the messages so far are in the log file
+		void flush();
 		void printLog();
 
 	protected:
-		// Static variable for the instance  
+		struct Record {
+			std::string file, function, message;
+			int line;
+			double time;
+			long pid;
+		};
+		struct Slot {
+			std::atomic<unsigned long> sequence;
+			Record record;
+		};
+
+		// Static variable for the instance
 		static CombineLogger* pL;
 
 		static const char*  fName;
+		static std::atomic<unsigned int> maxPerSite_;
 		std::ofstream outStream;
+		bool json_ = false;
+		std::mutex printMutex_;
+		// ring buffer, with many producers and the writer thread as the only consumer
+		std::vector<Slot> ring_;
+		alignas(64) std::atomic<unsigned long> head_;
+		alignas(64) std::atomic<unsigned long> tail_;
+		std::atomic<unsigned long> dropped_;
+		std::atomic<unsigned long> flushed_; // position up to which the file was flushed
+		std::atomic<int> writer_; // 0 = not running, 1 = running, 2 = asked to stop
+		std::mutex startMutex_;
+
 		CombineLogger();
 		virtual ~CombineLogger();
+		void push_(Record &&record);
+		void startWriter_();
+		void runWriter_();
+		void write_(const Record &record);
+		static void atExit_();
+		static void beforeFork_();
+		static void afterForkChild_();
 };
-#endif
\ No newline at end of file
+
+/// log a printf-style message, formatted only if it passes the limit of messages of this call site
+#define COMBINE_LOG(...) do { \
+		static CombineLogger::Site combineLoggerSite_(__FILE__, __LINE__, __func__); \
+		if (unsigned int combineLoggerN_ = combineLoggerSite_.accept()) CombineLogger::instance().logf(combineLoggerSite_, combineLoggerN_, __VA_ARGS__); \
+	} while (0)
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef HiggsAnalysis_CombinedLimit_FastTemplateKernel_h
+#define HiggsAnalysis_CombinedLimit_FastTemplateKernel_h
+/** \class FastTemplateKernel
+ *
+ * Chain of FastTemplate operations (Meld, Log, Exp, Scale, CropUnderflows, ...) on the active bins
+ * of a template, run in a single pass over the bins: the template is processed in blocks that stay
+ * in the cache, and all the operations are applied to one block before moving to the next one.
+ * The result is the same as calling the corresponding FastTemplate methods one after the other.
+ *
+ *   FastTemplateKernel k(cache);
+ *   double integral = k.copy(nominal).meld(diff, sum, a, b).exp().run();
+ *
+ */
+#include "FastTemplate_Old.h"
+#include <vector>
+
+class FastTemplateKernel {
+    public:
+        typedef FastTemplate::T T;
+        explicit FastTemplateKernel(FastTemplate &out) : out_(&out) {}
+
+        /// out = other
+        FastTemplateKernel & copy(const FastTemplate &other) ;
+        /// out += x * (diff + y * sum)
+        FastTemplateKernel & meld(const FastTemplate &diff, const FastTemplate &sum, T x, T y) ;
+        FastTemplateKernel & meld(const std::vector<float> &diff, const std::vector<float> &sum, T x, T y) ;
+        /// out += (xNew - xOld) * diff + (xNew * yNew - xOld * yOld) * sum
+        FastTemplateKernel & diffMeld(const FastTemplate &diff, const FastTemplate &sum, T xNew, T yNew, T xOld, T yOld) ;
+        FastTemplateKernel & diffMeld(const std::vector<float> &diff, const std::vector<float> &sum, T xNew, T yNew, T xOld, T yOld) ;
+        /// out *= values, bin by bin
+        FastTemplateKernel & multiply(const std::vector<T> &values) ;
+        /// out -= reference
+        FastTemplateKernel & subtract(const FastTemplate &reference) ;
+        /// out = log(out/reference)
+        FastTemplateKernel & logRatio(const FastTemplate &reference) ;
+        /// out = log(out), or -999 for empty bins
+        FastTemplateKernel & log() ;
+        /// out = exp(out)
+        FastTemplateKernel & exp() ;
+        /// out *= factor
+        FastTemplateKernel & scale(T factor) ;
+        /// out = max(out, minimum)
+        FastTemplateKernel & cropUnderflows(T minimum = 1e-9) ;
+        /// target += coeff * out (target must have at least as many bins as the active bins of out)
+        FastTemplateKernel & addTo(T coeff, T *target) ;
+
+        /// run the operations, and return the integral (sum of the bin contents) of the result.
+        /// The list of operations is then cleared, so that the kernel can be reused.
+        T run() ;
+        /// true if no operation is queued (run() would then only compute the integral)
+        bool empty() const { return ops_.empty(); }
+
+        /// number of bins processed together
+        static constexpr unsigned int blockSize = 256;
+    private:
+        enum Type { Copy, Multiply, Meld, MeldF, DiffMeld, DiffMeldF, Subtract, LogRatio, Log, Exp, Scale, Crop, AddTo };
+        struct Op {
+            Type type;
+            const T *a = nullptr, *b = nullptr;
+            const float *fa = nullptr, *fb = nullptr;
+            T *target = nullptr;
+            T x = 0, y = 0, z = 0;
+        };
+        FastTemplate *out_;
+        std::vector<Op> ops_;
+        FastTemplateKernel & add(Type type, T x = 0, T y = 0, T z = 0) ;
+};
+
+#endif
@@ -67,6 +67,11 @@ class FastTemplate {
         void Meld(const FastTemplate & diff, const FastTemplate & sum, T x, T y) ;
         /// Applies the difference between the new and the old melds
         void DiffMeld(const FastTemplate & diff, const FastTemplate & sum, T xNew, T yNew, T xOld, T yOld) ;
+        /// Same as Meld and DiffMeld, with diff and sum stored in single precision (the sums are still done in double precision)
+        void Meld(const std::vector<float> & diff, const std::vector<float> & sum, T x, T y) ;
+        void DiffMeld(const std::vector<float> & diff, const std::vector<float> & sum, T xNew, T yNew, T xOld, T yOld) ;
+        /// Copy of the active bins in single precision
+        void ToFloat(std::vector<float> &out) const ;
         /// protect from underflows (*this = max(*this, minimum));
         void CropUnderflows(T minimum=1e-9, bool activebinsonly=true);
 
@@ -156,6 +161,8 @@ class FastHisto2D : public FastTemplate {
             std::swap(binEdgesX_, other.binEdgesX_);
             std::swap(binEdgesY_, other.binEdgesY_);
         }
+        /// index of the bin containing (x,y) in the flattened template, or -1 if outside
+        int FindBin(const T &x, const T &y) const ;
         T GetAt(const T &x, const T &y) const ;
         T IntegralWidth() const ;
         unsigned int binX() const { return binX_; }
@@ -214,6 +221,8 @@ class FastHisto3D : public FastTemplate {
             std::swap(binEdgesY_, other.binEdgesY_);
             std::swap(binEdgesZ_, other.binEdgesZ_);
         }
+        /// index of the bin containing (x,y,z) in the flattened template, or -1 if outside
+        int FindBin(const T &x, const T &y, const T &z) const ;
         T GetAt(const T &x, const T &y, const T &z) const ;
         T IntegralWidth() const ;
         unsigned int binX() const { return binX_; }
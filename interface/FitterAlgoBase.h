@@ -17,6 +17,7 @@ class RooAbsReal;
 class RooArgList;
 class CascadeMinimizer;
 #include <RooArgSet.h>
+#include <vector>
 
 class FitterAlgoBase : public LimitAlgo {
 public:
@@ -39,6 +40,7 @@ protected:
   static float preFitValue_;
 
   static bool robustFit_, do95_, forceRecreateNLL_;
+  static unsigned int robustFitFork_;
   static float stepSize_;
   static int   maxFailedSteps_;
 
@@ -66,6 +68,12 @@ protected:
   double findCrossing(CascadeMinimizer &minim, RooAbsReal &nll, RooRealVar &r, double level, double rStart, double rBound) ;
   double findCrossingNew(CascadeMinimizer &minim, RooAbsReal &nll, RooRealVar &r, double level, double rStart, double rBound) ;
 
+  /// a robust crossing search for one POI: r is the parameter, rf its copy in the fit result
+  struct CrossingSearch { RooRealVar *r, *rf; double r0, rMin, rMax; };
+  void setCrossings(RooRealVar &rf, double r0, double lo68, double hi68, double lo95, double hi95) ;
+  /// run the up and down crossing searches in robustFitFork_ child processes, each starting from the best fit, and set the results in POI order
+  void findCrossingsWithFork(const std::vector<CrossingSearch> &searches, const RooArgSet &bestFit, double delta68, double delta95) ;
+
   void optimizeBounds(const RooWorkspace *w, const RooStats::ModelConfig *mc) ;
   void restoreBounds(const RooWorkspace *w, const RooStats::ModelConfig *mc) ;
 };
@@ -0,0 +1,44 @@
+#ifndef HiggsAnalysis_CombinedLimit_ForkedJobs_h
+#define HiggsAnalysis_CombinedLimit_ForkedJobs_h
+/** \class ForkedJobs
+ *
+ * Runs independent jobs (fits, crossing searches, toys, chains) in forked child processes, since RooFit
+ * objects can't be shared between threads: each child starts from a copy of the state of the parent.
+ * Job j goes to child j % nchildren. Each job writes a one-line result, which the parent reads back after
+ * all the children are done; larger results (e.g. ROOT objects) go into a scratch file of the job.
+ * Everything goes into a temporary directory, which is removed at the end, except for the output of the
+ * children that failed.
+ * The jobs whose results are missing are not done(): the caller decides how to report them.
+ *
+ */
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+class ForkedJobs {
+    public:
+        /// what names the jobs in the log messages (e.g. "crossing search")
+        ForkedJobs(const char *what, unsigned int njobs, unsigned int nchildren) ;
+        /// removes the temporary directory, unless it holds the output of a child that failed
+        ~ForkedJobs() ;
+        /// run job(j, out) for each job in the children; the job writes its result into out, on a single line
+        void run(const std::function<void(unsigned int job, FILE *out)> &job) ;
+        bool done(unsigned int j) const { return done_[j]; }
+        /// result written by job j (empty if it did not complete)
+        const std::string &result(unsigned int j) const { return results_[j]; }
+        /// scratch file of job j, with the given extension (e.g. ".root")
+        std::string file(unsigned int j, const char *ext) const ;
+        unsigned int jobs() const { return njobs_; }
+        unsigned int children() const { return nchildren_; }
+        unsigned int child(unsigned int j) const { return j % nchildren_; }
+    private:
+        std::string what_;
+        unsigned int njobs_, nchildren_;
+        std::string dir_;
+        std::vector<std::string> results_;
+        std::vector<bool> done_;
+        std::vector<bool> failed_;
+};
+
+#endif
@@ -10,8 +10,11 @@
  */
 #include "LimitAlgo.h"
 #include "Significance.h"
+#include <RooArgList.h>
+#include <memory>
 
 class TDirectory;
+namespace cacheutils { class CachingSimNLL; }
 
 class GoodnessOfFit : public LimitAlgo {
 public:
@@ -22,6 +25,8 @@ public:
     return name;
   }
   void applyOptions(const boost::program_options::variables_map &vm) override ;
+  void setToyNumber(const int iToy) override { iToy_ = iToy; }
+  bool canForkToys() const override { return !makePlots_; }
 
   virtual bool runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint);
   virtual bool runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint, bool kolmo);
@@ -50,6 +55,22 @@ protected:
   RooAbsPdf *makeSaturatedPdf(RooAbsData &data);
   mutable std::vector<RooAbsData*> tempData_;
 
+  // Fit the nominal model and return its nll, as needed for the saturated model test statistic
+  double fitNominalNLL(RooWorkspace *w, RooAbsReal &nominal_nll);
+  // Saturated model nll of each channel computed directly from the data. Return false if it can't be done (e.g. not a RooSimultaneous).
+  bool saturatedChannelNLLs(RooAbsData &data, std::vector<double> &nlls);
+  static bool saturatedChannelNLL(const RooAbsData &data, const RooArgSet &observables, double &nll);
+  // Best fit value of the constraint terms alone, which is the part of the saturated model nll that has parameters
+  double saturatedConstraintsNLL(RooWorkspace *w, RooStats::ModelConfig *mc_s, cacheutils::CachingSimNLL &nll);
+
+  // Factorise the pdf and create the nll of the nominal model. From the second toy of a job on, only move the nll to the new data.
+  RooAbsReal & nominalNLL(RooStats::ModelConfig *mc_s, RooAbsData &data);
+  int iToy_ = -1;
+  RooAbsPdf *cachedPdf_ = nullptr;
+  RooAbsPdf *obsOnlyPdf_ = nullptr;
+  RooArgList constraints_;
+  std::unique_ptr<RooAbsReal> nominalNLL_;
+
 };
 
 
@@ -7,6 +7,7 @@
 #include "RooConstVar.h"
 #include "RooRealProxy.h"
 #include "RooListProxy.h"
+#include <vector>
 
 
 class HZZ4L_RooSpinZeroPdf_phase_fast : public RooAbsPdf{
@@ -31,6 +32,10 @@ public:
   TObject* clone(const char* newname) const override { return new HZZ4L_RooSpinZeroPdf_phase_fast(*this, newname); }
   inline ~HZZ4L_RooSpinZeroPdf_phase_fast() override{}
 
+  // Coefficients of the templates in coefList for the current couplings, false if the couplings are unphysical
+  Bool_t getCouplingCoefficients(std::vector<Float_t>& coefs) const;
+  const RooArgList& componentList() const { return coefList; }
+
   Float_t interpolateFcn(Int_t code, const char* rangeName=0) const;
   Double_t evaluate() const override;
   Int_t getAnalyticalIntegral(RooArgSet& allVars, RooArgSet& analVars, const char* rangeName=0) const override;
@@ -23,6 +23,8 @@ public:
   virtual void applyDefaultOptions() { }
   virtual void setToyNumber(const int) { }
   virtual void setNToys(const int) { }
+  /// whether the toys of -t can be run in forked processes (--toysFork): true if the method writes nothing but rows of the output tree for each toy
+  virtual bool canForkToys() const { return false; }
   virtual bool run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) = 0;
   virtual const std::string & name() const = 0;
   const boost::program_options::options_description & options() const {
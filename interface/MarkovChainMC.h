@@ -22,6 +22,10 @@ public:
     static const std::string name("MarkovChainMC");
     return name;
   }
+  /// Gelman-Rubin potential scale reduction of the traces, skipping the first points of each
+  static double gelmanRubin(const std::vector<std::vector<double> > &traces, int first) ;
+  /// Effective sample size of the traces from batch means, skipping the first points of each
+  static double effectiveSampleSize(const std::vector<std::vector<double> > &traces, int first) ;
 private:
   enum ProposalType { FitP, UniformP, MultiGaussianP, TestP };
   static std::string proposalTypeName_;
@@ -51,6 +55,19 @@ private:
   static bool mergeChains_; 
   /// Read chains from file instead of running them 
   static bool readChains_;
+  /// Run this number of chains of the native sampler over the combine NLL instead of RooStats::MCMCCalculator (0 = off)
+  static unsigned int nChains_;
+  /// Stop the native chains once R-hat is below this value and the effective sample size is above essTarget_
+  static float rHatTarget_, essTarget_;
+  /// Check the convergence of the native chains after this number of steps of each chain
+  static unsigned int checkEvery_;
+  /// Run each block of steps of the native chains in this number of forked processes (0 = in this process)
+  static unsigned int chainsFork_;
+  /// Sampler of the native chains ('metropolis' or 'hmc'), and settings of the Hamiltonian Monte Carlo one
+  static std::string chainSamplerName_;
+  static bool hmc_;
+  static unsigned int hmcSteps_;
+  static float hmcStepSize_;
   /// Mass of the Higgs boson (goes into the name of the saved chains)
   float mass_;
   /// Number of degrees of freedom of the problem, approximately
@@ -71,6 +88,9 @@ private:
   // return number of items in chain, 0 for error
   int runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) const ;
 
+  // run nChains_ chains of the native sampler, return false for error
+  bool runChains(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooAbsData &data, double &limit, double &limitErr, const double *hint) ;
+
   RooStats::MarkovChain *mergeChains(const RooArgSet &poi, const std::vector<double> &limits) const;
   void readChains(const RooArgSet &poi, std::vector<double> &limits);
   void limitFromChain(double &limit, double &limitErr, const RooArgSet &poi, RooStats::MarkovChain &chain, int burnInSteps=-1 /* -1 = use default */) ;
@@ -0,0 +1,62 @@
+#ifndef HiggsAnalysis_CombinedLimit_MinimizerTelemetry_h
+#define HiggsAnalysis_CombinedLimit_MinimizerTelemetry_h
+/** \class MinimizerTelemetry
+ *
+ * Record of what CascadeMinimizer does in each minimize/improve/minos/hesse call
+ * (minimizer runs and fallbacks, status, edm, wall time and number of NLL evaluations),
+ * written as one JSON object per line to the file given with --cminTelemetry
+ *
+ */
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class RooAbsReal;
+
+class MinimizerTelemetry {
+    public:
+        static MinimizerTelemetry & instance() ;
+        /// start writing the records to this file
+        void open(const std::string &fileName) ;
+        bool enabled() const { return out_.is_open(); }
+
+        /// One call to the minimizer. Does nothing if the telemetry is not enabled,
+        /// otherwise the record is written when the object goes out of scope.
+        class Call {
+            public:
+                Call(const char *what, const RooAbsReal &nll) ;
+                ~Call() ;
+                Call(const Call &) = delete;
+                Call & operator=(const Call &) = delete;
+                bool active() const { return active_; }
+                /// one run of the minimizer within this call (e.g. type,algo or "Hesse"); time and NLL evaluations are counted since the previous stage
+                void stage(const std::string &name, int strategy, double tolerance, int status, double edm) ;
+                /// the fallback algorithm that succeeded, if any
+                void setFallback(const std::string &algo) { fallback_ = algo; }
+                void setResult(bool ok) { ok_ = ok; }
+                /// innermost call currently open (nullptr if none, or if the telemetry is disabled)
+                static Call * current() ;
+            private:
+                bool active_;
+                std::string what_, nllName_;
+                const RooAbsReal *nll_;
+                unsigned long id_, parent_;
+                int depth_;
+                std::chrono::steady_clock::time_point start_, last_;
+                long nllCallsStart_, nllCallsLast_;
+                bool ok_;
+                std::string fallback_;
+                std::string stages_;
+        };
+    private:
+        MinimizerTelemetry() {}
+        std::ofstream out_;
+        unsigned long nCalls_ = 0;
+        std::vector<Call *> open_;
+        /// number of evaluations of the NLL so far, -1 if the NLL does not count them
+        static long nllCalls(const RooAbsReal &nll) ;
+        static std::string escape(const std::string &str) ;
+};
+
+#endif
@@ -89,6 +89,8 @@ protected:
   static RooArgList                specifiedList_;
   static bool saveInactivePOI_;
   static bool skipDefaultStart_;
+  static bool impactWarmStart_, approxImpacts_;
+  static unsigned int impactFork_;
   // initialize variables
   void initOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s) ;
 
@@ -100,6 +102,8 @@ protected:
   void doContour2D(RooWorkspace *w, RooAbsReal &nll) ;
   void doStitch2D(RooWorkspace *w, RooAbsReal &nll) ;
   void doImpact(RooFitResult &res, RooAbsReal &nll) ;
+  /// run the up and down fits of doImpact in impactFork_ child processes, each starting from the initial fit, and commit and print the results in parameter order
+  void doImpactWithFork(RooFitResult &res, RooAbsReal &nll, RooArgSet &params, const RooArgSet &init_snap) ;
 
   std::map<std::string, std::vector<float>> getRangesDictFromInString(std::string) ;
 
@@ -107,8 +111,14 @@ protected:
   // utilities
   /// for each RooRealVar, set a range 'box' from the PL profiling all other parameters
   void doBox(RooAbsReal &nll, double cl, const char *name="box", bool commitPoints=true) ;
+  /// doBox with the searches of the minimum and maximum of each POI in robustFitFork_ child processes, each starting from the best fit
+  void doBoxWithFork(RooAbsReal &nll, double cl, const char *name, bool commitPoints, double nll0, double threshold, const std::vector<double> &p0) ;
   /// save a file with the RooFitResult inside
   void saveResult(RooFitResult &res);
+  /// best-fit value and -/+ 1 sigma uncertainties of the i-th parameter of --algo impact
+  void impactRange(const RooFitResult &res, int i, double &bestFitVal, double &loErr, double &hiErr) ;
+  /// move the floating parameters from the best fit in res by their linear response to a shift of the named parameter, from the covariance matrix
+  bool setLinearPrediction(const RooFitResult &res, RooArgSet &params, const std::string &name, double shift) ;
   /// split values passed to --gridPoints option, e.g. "10,20" -> unsigned int vector {10, 20}
   void splitGridPoints(const std::string& s, std::vector<unsigned int>& points) const;
 };
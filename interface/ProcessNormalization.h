@@ -17,10 +17,11 @@ END_HTML
 //
 class ProcessNormalization : public RooAbsReal {
    public:
-      ProcessNormalization() : nominalValue_(1) {}
+      ProcessNormalization() : nominalValue_(1), engineRow_(-1) {}
       ProcessNormalization(const char *name, const char *title, double nominal=1) ;
       ProcessNormalization(const char *name, const char *title, RooAbsReal &nominal) ;
       ProcessNormalization(const ProcessNormalization &other, const char *newname = 0) ;
+      ~ProcessNormalization() override ;
 
       TObject * clone(const char *newname) const override { return new ProcessNormalization(*this, newname); }
 
@@ -41,9 +42,12 @@ class ProcessNormalization : public RooAbsReal {
 
     protected:
         Double_t evaluate() const override;
+        bool redirectServersHook(const RooAbsCollection &newServerList, bool mustReplaceAll, bool nameChange, bool isRecursiveStep) override;
 
     private:
         void fillAsymmKappaVecs() const;
+        bool registerWithEngine() const;
+        void releaseEngineRow() const;
 
         // ---- PERSISTENT ----
         double nominalValue_;                         
@@ -57,6 +61,7 @@ class ProcessNormalization : public RooAbsReal {
         mutable std::vector<double> otherFactorListVec_; //! Don't serialize me
         mutable std::vector<double> logAsymmKappaLow_; //! Don't serialize me
         mutable std::vector<double> logAsymmKappaHigh_; //! Don't serialize me
+        mutable int engineRow_; //! Row in the ProcessNormalizationEngine, -1 if not registered
 
   ClassDefOverride(ProcessNormalization,1) // Process normalization interpolator 
 };
@@ -0,0 +1,66 @@
+#ifndef HiggsAnalysis_CombinedLimit_ProcessNormalizationEngine_h
+#define HiggsAnalysis_CombinedLimit_ProcessNormalizationEngine_h
+/** \class ProcessNormalizationEngine
+ *
+ * Process-wide evaluation of the log-normal part of the ProcessNormalization objects,
+ * exp(sum_i theta_i * log(kappa_i)), for all the processes at once.
+ * The log-kappas are stored as a sparse process x nuisance matrix (one row per process,
+ * one column per nuisance). When a process asks for its value, the nuisances of that process
+ * are read, and all the rows that use a nuisance that changed are marked as stale; the stale
+ * rows are then recomputed together with one sparse matrix-vector product and one pass of exp,
+ * and the processes read their value from a flat array.
+ * The engine is shared by all the NLLs of the process, and its state is guarded by a mutex.
+ * It is off by default, and can be turned on with --X-rtd PROCNORM_ENGINE.
+ *
+ */
+#include <RooAbsReal.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ProcessNormalizationEngine {
+    public:
+        static ProcessNormalizationEngine & instance() ;
+        /// turned on with --X-rtd PROCNORM_ENGINE
+        static bool enabled() ;
+        /// add a process, with its nuisances for symmetric and asymmetric kappas; return its row
+        unsigned int addProcess(const std::vector<const RooAbsReal *> &thetas, const std::vector<double> &logKappas,
+                                const std::vector<const RooAbsReal *> &asymmThetas,
+                                const std::vector<double> &logKappasLow, const std::vector<double> &logKappasHigh) ;
+        void removeProcess(unsigned int row) ;
+        /// exp(sum theta * logKappa) for this process at the current values of its nuisances
+        double value(unsigned int row) ;
+        unsigned int processes() const { return rows_.size() - freeRows_.size(); }
+        unsigned int nuisances() const { return thetas_.size() - freeCols_.size(); }
+    private:
+        ProcessNormalizationEngine() {}
+        struct Row {
+            unsigned int begin, end;          // symmetric kappas, in cols_ and logKappa_
+            unsigned int asymmBegin, asymmEnd; // asymmetric kappas, in asymmCols_, logKappaLow_ and logKappaHigh_
+        };
+        unsigned int column_(const RooAbsReal *theta) ;
+        void markStale_(unsigned int row) ;
+        void sync_(const Row &row) ;
+        void recompute_() ;
+        void compact_() ;
+
+        // the sparse matrix, rows in compressed form (entries of removed rows stay until the next compaction)
+        std::vector<Row> rows_;
+        std::vector<unsigned int> cols_, asymmCols_;
+        std::vector<double> logKappa_, logKappaLow_, logKappaHigh_;
+        std::vector<unsigned int> freeRows_;
+        unsigned int deadEntries_ = 0;
+        // the nuisances: the last value seen, and the rows that use them
+        std::unordered_map<const RooAbsReal *, unsigned int> columns_;
+        std::vector<const RooAbsReal *> thetas_;
+        std::vector<double> thetaVals_;
+        std::vector<std::vector<unsigned int> > colRows_;
+        std::vector<unsigned int> freeCols_; // of nuisances no longer used by any process
+        // the results
+        std::vector<double> values_, logValues_;
+        std::vector<char> stale_;
+        std::vector<unsigned int> staleRows_;
+        std::mutex mutex_;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HiggsAnalysis_CombinedLimit_RooDirtyInhibitSentry_
+#define HiggsAnalysis_CombinedLimit_RooDirtyInhibitSentry_
+
+#include <RooAbsArg.h>
+
+/** This class sets the global inhibit of the propagation of dirty flags in RooFit when created,
+    and resets it to the old value when destroyed, so that nested uses don't turn it off too early. */
+class RooDirtyInhibitSentry {
+    public:
+        RooDirtyInhibitSentry(bool inhibit = true) :
+            inhibit_(Access::inhibitDirty())
+    {
+        RooAbsArg::setDirtyInhibit(inhibit);
+    }
+
+        ~RooDirtyInhibitSentry() {
+            RooAbsArg::setDirtyInhibit(inhibit_);
+        }
+    private:
+        struct Access : public RooAbsArg {
+            static bool inhibitDirty() { return _inhibitDirty; }
+        };
+        bool inhibit_;
+};
+#endif
@@ -61,11 +61,17 @@ END_HTML
 class RooSplineND : public RooAbsReal {
 
    public:
+      /// Gaussian: exp(-d^2/eps^2), with all the points contributing everywhere (default)
+      /// TruncatedGaussian: the same, but zero beyond cutoff*eps
+      /// Wendland: compactly supported Wendland function, zero beyond eps
+      /// With the last two, only the points within the support are used, found with a k-d tree, and the weights are solved as a sparse system
+      enum Kernel { Gaussian = 0, TruncatedGaussian = 1, Wendland = 2 };
+
       //RooSplineND() : ndim_(0),M_(0),eps_(3.) {}
       RooSplineND() {};
-      RooSplineND(const char *name, const char *title, RooArgList &vars, TTree *tree, const char* fName="f", double eps=3., bool rescale=false, std::string cutstring="" ) ;
+      RooSplineND(const char *name, const char *title, RooArgList &vars, TTree *tree, const char* fName="f", double eps=3., bool rescale=false, std::string cutstring="", int kernel=Gaussian, double cutoff=3. ) ;
       RooSplineND(const RooSplineND& other, const char *name) ; 
-      RooSplineND(const char *name, const char *title, const RooListProxy &vars, int ndim, int M, double eps, bool rescale, std::vector<double> &w, std::map<int,std::vector<double> > &map, std::map<int,std::pair<double,double> > & ,double,double) ;
+      RooSplineND(const char *name, const char *title, const RooListProxy &vars, int ndim, int M, double eps, bool rescale, std::vector<double> &w, std::map<int,std::vector<double> > &map, std::map<int,std::pair<double,double> > & ,double,double, int kernel=Gaussian, double cutoff=3.) ;
       ~RooSplineND() override ;
 
       TObject * clone(const char *newname) const override ;
@@ -89,16 +95,35 @@ class RooSplineND : public RooAbsReal {
 	
 	mutable double w_mean, w_rms;
 
+	int kernel_ = Gaussian;
+	double cutoff_ = 3.;
+
 	void calculateWeights(std::vector<double> &);
 	double getDistSquare(int i, int j);
 	double getDistFromSquare(int i) const;
 	void   printPoint(int i) const;
 	double radialFunc(double d2, double eps, double cutoff = -1) const;
+	/// throw std::invalid_argument for an unknown kernel, or a TruncatedGaussian without a positive cutoff
+	void checkKernel() const;
+	/// square of the distance beyond which the kernel is zero (-1 if it never is)
+	double supportSquare() const;
+	/// fill the points in a flat array and build the k-d tree over them
+	void buildIndex() const;
+	/// call f(i, d2) for each point i within a squared distance d2max of x (unscaled coordinates)
+	template<typename F> void forEachNeighbour(const double *x, double d2max, F f) const;
 
 	mutable bool rescaleAxis;
-	
 
-  ClassDefOverride(RooSplineND,1) 
+	// the points, with the coordinates of each point contiguous, and the ranges of the axes (for rescaleAxis)
+	mutable std::vector<double> pts_; //!
+	mutable std::vector<double> range_; //!
+	// k-d tree: for a range [lo, hi) of kdOrder_, the median point is at mid = (lo+hi)/2, and
+	// kdDim_[mid] is the axis along which the range is split
+	mutable std::vector<int> kdOrder_, kdDim_; //!
+	mutable std::vector<double> x_; //! current values of the variables
+	mutable bool indexReady_ = false; //!
+
+  ClassDefOverride(RooSplineND,2) 
 };
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef SimpleConstraintBlock_h
+#define SimpleConstraintBlock_h
+
+#include "SimpleGaussianConstraint.h"
+#include "SimplePoissonConstraint.h"
+#include "Accumulators.h"
+#include <vector>
+
+/** \class SimpleConstraintBlock
+ *
+ * The log of a set of SimpleGaussianConstraint and SimplePoissonConstraint terms, with their parameters
+ * kept in contiguous arrays. When x and the mean are RooRealVars or RooConstVars their values are read
+ * directly, and only the terms whose parameters changed since the last call are recomputed (all of them
+ * in one vectorizable pass when many changed); other constraints go through getLogValFast().
+ * The values are identical to the sum of getLogValFast() over the constraints.
+ *
+ */
+class SimpleConstraintBlock {
+    public:
+        void add(const SimpleGaussianConstraint * gaus) ;
+        void add(const SimplePoissonConstraint * pois) ;
+        unsigned int size() const { return gaus_.size() + pois_.size(); }
+        bool empty() const { return gaus_.empty() && pois_.empty(); }
+        void setZeroPoint() ;
+        void clearZeroPoint() ;
+        /// add log(pdf) + zero point of each constraint to the accumulator: gaussians first, each in the order they were added
+        void addTo(DefaultAccumulator<double> &acc) const ;
+    private:
+        void update_() const ;
+
+        // gaussians: scale * (x - mean)^2
+        std::vector<const SimpleGaussianConstraint *> gaus_;
+        std::vector<const double *> gausX_, gausMean_;
+        std::vector<double> gausScale_, gausZero_;
+        std::vector<unsigned int> gausOther_; // with x or mean not a RooRealVar
+        mutable std::vector<double> gausXVal_, gausMeanVal_, gausLogVal_;
+        // poissons: the mean is the parameter
+        std::vector<const SimplePoissonConstraint *> pois_;
+        std::vector<const double *> poisObs_, poisMean_;
+        std::vector<double> poisLogGamma_, poisZero_;
+        std::vector<unsigned int> poisOther_;
+        mutable std::vector<double> poisObsVal_, poisMeanVal_, poisLogVal_;
+        mutable std::vector<unsigned int> changed_;
+        mutable bool init_ = false;
+};
+
+#endif
@@ -1,8 +1,7 @@
 #ifndef SimpleGaussianConstraintGroup_h
 #define SimpleGaussianConstraintGroup_h
 
-#include "SimpleGaussianConstraint.h"
-#include "SimplePoissonConstraint.h"
+#include "SimpleConstraintBlock.h"
 #include "RooSetProxy.h"
 
 class SimpleConstraintGroup : public RooAbsReal {
@@ -18,15 +17,13 @@ class SimpleConstraintGroup : public RooAbsReal {
  
         TObject * clone(const char *newname) const override { return new SimpleConstraintGroup(*this, newname); }
 
-        unsigned int size() const { return _gaus.size() + _pois.size(); }
+        unsigned int size() const { return _block.size(); }
     protected:
         Double_t evaluate() const override;
 
     private:
         RooSetProxy _deps;
-        std::vector<const SimpleGaussianConstraint *> _gaus;
-        std::vector<const SimplePoissonConstraint *> _pois;
-        std::vector<double> _gaus0, _pois0;
+        SimpleConstraintBlock _block; //! not persisted
 
         ClassDefOverride(SimpleConstraintGroup,1) // group of constraints
 };
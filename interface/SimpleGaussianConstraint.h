@@ -18,19 +18,26 @@ class SimpleGaussianConstraint : public RooGaussian {
 #if ROOT_VERSION_CODE < ROOT_VERSION(6,26,0)
         // function was upstreamed to RooGaussian in ROOT 6.26
         const RooAbsReal & getX() const { return x.arg(); }
+        const RooAbsReal & getMean() const { return mean.arg(); }
 #endif
 
         double getLogValFast() const { 
             if (_valueDirty) {
-                Double_t arg = x - mean;  
                 //Double_t sig = sigma ;
                 //return -0.5*arg*arg/(sig*sig);
-                _value = scale_*arg*arg;
+                _value = logValue(x, mean, scale_);
                 _valueDirty = false;
             }
             return _value;
         }
 
+        /// -0.5/sigma^2, the coefficient of (x-mean)^2 in the log of the constraint
+        double scale() const { return scale_; }
+        static double logValue(double x, double mean, double scale) {
+            double arg = x - mean;
+            return scale*arg*arg;
+        }
+
         // RooFit should make no attempt to normalize this constraint, as the
         // "getLogValFast()" function that combined CachingNLL is calling also
         // doesn't do any normalization.
@@ -18,28 +18,33 @@ class SimplePoissonConstraint : public RooPoisson {
         inline ~SimplePoissonConstraint() override { }
 
         const RooAbsReal & getMean() const { return mean.arg(); }
+        const RooAbsReal & getObserved() const { return x.arg(); }
 
         double getLogValFast() const { 
             if (_valueDirty) {
-                Double_t expected = mean;
-                Double_t observed = x;
-                if (std::abs(observed)<1e-10) {
-                    _value = (std::abs(expected)<1e-10) ? 0 : -1*expected;
-                } else {
-                    if(observed<1000000) {
-                        _value = - ( - observed * log(expected) + expected + logGamma_ );
-                    } else {
-                        //if many observed events, use Gauss approximation
-                        Double_t sigma_square = expected;
-                        Double_t diff = observed - expected;
-                        _value = log(sigma_square)/2 - (diff*diff)/(2*sigma_square);
-                    }
-                }
+                _value = logValue(x, mean, logGamma_);
                 _valueDirty = false;
             }
             return _value;
         }
 
+        /// log(n!) for the observed value at construction
+        double logGamma() const { return logGamma_; }
+        static double logValue(double observed, double expected, double logGamma) {
+            if (std::abs(observed)<1e-10) {
+                return (std::abs(expected)<1e-10) ? 0 : -1*expected;
+            } else {
+                if(observed<1000000) {
+                    return - ( - observed * log(expected) + expected + logGamma );
+                } else {
+                    //if many observed events, use Gauss approximation
+                    Double_t sigma_square = expected;
+                    Double_t diff = observed - expected;
+                    return log(sigma_square)/2 - (diff*diff)/(2*sigma_square);
+                }
+            }
+        }
+
         static RooPoisson * make(RooPoisson &c) ;
     private:
         double logGamma_;
@@ -0,0 +1,39 @@
+#ifndef HiggsAnalysis_CombinedLimit_TemplatePool_h
+#define HiggsAnalysis_CombinedLimit_TemplatePool_h
+/** \class TemplatePool
+ *
+ * Process-wide store of the templates of the CMSHistFunc objects read from a workspace.
+ * Templates with identical content (e.g. the same shape used for several years or processes)
+ * are kept in memory only once, and shared by all the functions that use them.
+ * Shared templates are never modified: a function that needs to change its templates
+ * takes back a private copy first.
+ *
+ */
+#include "FastTemplate_Old.h"
+#include <memory>
+#include <ostream>
+#include <unordered_map>
+
+class TemplatePool {
+    public:
+        typedef std::shared_ptr<const FastTemplate> Ref;
+        static TemplatePool & instance() ;
+        /// return the shared copy of a template with this content, adding it to the pool if there isn't one yet
+        Ref intern(const FastTemplate &t) ;
+        /// can be turned off with --X-rtd NO_TEMPLATE_POOL
+        static bool enabled() ;
+        /// number of templates requested, and of those that were already in the pool
+        unsigned long requested() const { return requested_; }
+        unsigned long shared() const { return shared_; }
+        /// memory not allocated thanks to the sharing
+        unsigned long bytesSaved() const { return bytesSaved_; }
+        void report(std::ostream &out) const ;
+    private:
+        TemplatePool() {}
+        static std::size_t hash(const FastTemplate &t) ;
+        static bool equal(const FastTemplate &t1, const FastTemplate &t2) ;
+        std::unordered_multimap<std::size_t, std::weak_ptr<const FastTemplate> > pool_;
+        unsigned long requested_ = 0, shared_ = 0, bytesSaved_ = 0, bytesStored_ = 0;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef VectorizedSpinZeroPdfs_h
+#define VectorizedSpinZeroPdfs_h
+
+#include <RooAbsData.h>
+#include <RooAbsReal.h>
+#include <RooArgSet.h>
+#include <vector>
+
+// Vectorized version of the HZZ4L_RooSpinZeroPdf_*_fast family of pdfs:
+// the templates are evaluated once for all the entries of the dataset, and the pdf is then the
+// sum of the templates weighted by the coupling coefficients, divided by the same sum of the
+// template integrals (which is only recomputed when the coupling coefficients change).
+// The arithmetic is the same as in PdfT::interpolateFcn, so the values are identical.
+template<typename PdfT>
+class VectorizedSpinZeroPdf {
+    public:
+        VectorizedSpinZeroPdf(const PdfT &pdf, const RooAbsData &data, bool includeZeroWeights=false) ;
+        /// whether the pdf can be vectorized for these observables: its integral over all of them must be analytical,
+        /// and its components must be pure templates of them (no parameters)
+        static bool canVectorize(const PdfT &pdf, const RooArgSet &obs) ;
+        void fill(std::vector<Double_t> &out) const ;
+    private:
+        const PdfT * pdf_;
+        unsigned int nentries_;
+        std::vector<std::vector<Double_t>> vals_; // template values, [component][entry]
+        std::vector<Double_t> integrals_;         // template integrals over the observables
+        mutable std::vector<Float_t> coefs_, normCoefs_;
+        mutable Double_t norm_;
+        mutable std::vector<Float_t> sum_, compensation_;
+};
+
+#endif
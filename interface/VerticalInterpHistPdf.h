@@ -412,10 +412,38 @@ protected:
   void initNominal(TObject *nominal) ;
   void initComponent(int which, TObject *hi, TObject *lo) ;
 
+  friend class FastVerticalInterpHistPdf2D2V;
 private:
   ClassDefOverride(FastVerticalInterpHistPdf2D2,1) // 
 };
 
+/// Flattened bin index of each entry of a dataset in a 2D or 3D template, so that the
+/// values for all the entries can be taken from the template without any bin lookup
+class FastHistoNDBins {
+    public:
+        /// add the next entry, with the bin index returned by FastHisto2D/3D::FindBin (-1 if outside)
+        void push_back(int bin) ;
+        /// call after all the entries have been added
+        void finalize() ;
+        void fill(const FastTemplate &cache, std::vector<Double_t> &out) const ;
+    private:
+        /// if the entries are in consecutive bins (e.g. a binned dataset in the same order as the template), first and last+1 bin
+        int begin_ = 0, end_ = 0;
+        /// otherwise, the bin of each entry (0 if outside the template)...
+        std::vector<int> bins_;
+        /// ...and the entries outside the template, whose value is zero
+        std::vector<int> outside_;
+};
+
+class FastVerticalInterpHistPdf2D2V {
+    public: 
+        FastVerticalInterpHistPdf2D2V(const FastVerticalInterpHistPdf2D2 &, const RooAbsData &data, bool includeZeroWeights=false) ;
+        void fill(std::vector<Double_t> &out) const ;
+    private:
+        const FastVerticalInterpHistPdf2D2 & hpdf_;
+        FastHistoNDBins bins_;
+};
+
 
 class FastVerticalInterpHistPdf3D : public FastVerticalInterpHistPdfBase {
 public:
@@ -462,10 +490,20 @@ protected:
   void syncNominal() const ;
   void syncComponents(int dimension) const ;
 
+  friend class FastVerticalInterpHistPdf3DV;
 private:
   ClassDefOverride(FastVerticalInterpHistPdf3D,1) // 
 };
 
+class FastVerticalInterpHistPdf3DV {
+    public: 
+        FastVerticalInterpHistPdf3DV(const FastVerticalInterpHistPdf3D &, const RooAbsData &data, bool includeZeroWeights=false) ;
+        void fill(std::vector<Double_t> &out) const ;
+    private:
+        const FastVerticalInterpHistPdf3D & hpdf_;
+        FastHistoNDBins bins_;
+};
+
 
 COMBINE_DECLARE_CODEGEN_IMPL(FastVerticalInterpHistPdf2);
 COMBINE_DECLARE_CODEGEN_IMPL(FastVerticalInterpHistPdf2D2);
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+# Compare the NLL and the fit results obtained with the templates of CMSHistFunc/CMSHistSum
+# stored in double precision (default) and in single precision (--X-rtd FLOAT_TEMPLATE_STORAGE).
+# The NLL is built as in combine: a cacheutils::CachingSimNLL (the pdf must be a RooSimultaneousOpt, i.e. the
+# workspace made by text2workspace.py without --no-optimize-pdfs), with the same optimizations switched on,
+# so that the templates used are the single precision ones of the clones made by its CachingAddNLLs
+import argparse
+import random
+
+import ROOT
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--input", "-i", help="input ws file")
+parser.add_argument("--workspace", "-w", default="w", help="name of the workspace")
+parser.add_argument("--pdf", default="model_s", help="name of the pdf")
+parser.add_argument("--dataset", "-D", default="data_obs", help="name of the dataset")
+parser.add_argument("--points", type=int, default=20, help="number of random parameter points at which the NLL is compared")
+parser.add_argument("--seed", type=int, default=1, help="seed for the random parameter points")
+parser.add_argument("--fit", action="store_true", help="also compare the results of a fit")
+parser.add_argument("--tolerance", type=float, default=1e-3, help="largest acceptable difference of the NLL values")
+args = parser.parse_args()
+
+ROOT.gSystem.Load("libHiggsAnalysisCombinedLimit")
+ROOT.gInterpreter.Declare("#include <HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h>")
+ROOT.gInterpreter.Declare(
+    """
+#include <HiggsAnalysis/CombinedLimit/interface/CachingNLL.h>
+bool isCachingSimNLL(RooAbsReal *nll) { return dynamic_cast<cacheutils::CachingSimNLL *>(nll) != nullptr; }
+"""
+)
+# the defaults of bin/combine.cpp, which select the optimized evaluation of CMSHistFunc and CMSHistSum
+for rtd in [
+    "OPTIMIZE_BOUNDS",
+    "ADDNLL_RECURSIVE",
+    "ADDNLL_GAUSSNLL",
+    "ADDNLL_HISTNLL",
+    "ADDNLL_CBNLL",
+    "ADDNLL_ROOREALSUM_FACTOR",
+    "ADDNLL_ROOREALSUM_NONORM",
+    "ADDNLL_ROOREALSUM_BASICINT",
+    "ADDNLL_ROOREALSUM_KEEPZEROS",
+    "ADDNLL_PRODNLL",
+    "ADDNLL_HFNLL",
+    "ADDNLL_HISTFUNCNLL",
+    "ADDNLL_SPINZERONLL",
+    "ADDNLL_ROOREALSUM_CHEAPPROD",
+]:
+    ROOT.runtimedef.set(rtd, 1)
+ROOT.RooMsgService.instance().setGlobalKillBelow(ROOT.RooFit.WARNING)
+
+f = ROOT.TFile.Open(args.input)
+ws = f.Get(args.workspace)
+pdf = ws.pdf(args.pdf)
+data = ws.data(args.dataset)
+constrain = ws.set("nuisances")
+global_observables = ws.set("globalObservables")
+
+params = [p for p in pdf.getParameters(data) if not p.isConstant() and p.InheritsFrom("RooRealVar")]
+snapshot = ROOT.RooArgSet()
+for p in params:
+    snapshot.add(p)
+start = snapshot.snapshot()
+
+# random points around the starting values, the same for both storage modes
+random.seed(args.seed)
+points = [{}]
+for i in range(args.points):
+    point = {}
+    for p in params:
+        width = p.getError() if p.getError() > 0 else 1.0
+        point[p.GetName()] = min(max(p.getVal() + random.gauss(0.0, width), p.getMin()), p.getMax())
+    points.append(point)
+
+
+def run(float_storage):
+    ROOT.CMSHistFunc.EnableFloatStorage(float_storage)
+    ROOT.CMSHistSum.EnableFloatStorage(float_storage)
+    # the templates are converted when the pdf is cloned into the NLL
+    nll = pdf.createNLL(data, ROOT.RooFit.Constrain(constrain), ROOT.RooFit.GlobalObservables(global_observables))
+    if not ROOT.isCachingSimNLL(nll):
+        raise RuntimeError("The NLL is not a cacheutils::CachingSimNLL: is %s a RooSimultaneousOpt?" % args.pdf)
+    values = []
+    for point in points:
+        snapshot.assignValueOnly(start)
+        for p in params:
+            if p.GetName() in point:
+                p.setVal(point[p.GetName()])
+        values.append(nll.getVal())
+    result = None
+    if args.fit:
+        snapshot.assignValueOnly(start)
+        minim = ROOT.RooMinimizer(nll)
+        minim.setStrategy(1)
+        minim.setPrintLevel(-1)
+        minim.minimize("Minuit2", "")
+        minim.hesse()
+        result = minim.save()
+    snapshot.assignValueOnly(start)
+    return values, result
+
+
+values_d, result_d = run(False)
+values_f, result_f = run(True)
+
+print("%-8s %20s %20s %12s" % ("point", "NLL (double)", "NLL (float)", "difference"))
+max_diff = 0.0
+for i, (vd, vf) in enumerate(zip(values_d, values_f)):
+    print("%-8s %20.6f %20.6f %12.3e" % ("nominal" if i == 0 else str(i), vd, vf, vf - vd))
+    max_diff = max(max_diff, abs(vf - vd))
+print("Largest difference of the NLL: %.3e" % max_diff)
+
+ok = max_diff < args.tolerance
+if args.fit:
+    print("\nFit status: %d (double), %d (float)" % (result_d.status(), result_f.status()))
+    print("Minimum NLL: %.6f (double), %.6f (float), difference %.3e" % (result_d.minNll(), result_f.minNll(), result_f.minNll() - result_d.minNll()))
+    print("\n%-40s %14s %14s %14s %12s" % ("parameter", "value (double)", "value (float)", "error (double)", "shift/error"))
+    max_shift = 0.0
+    for pd in result_d.floatParsFinal():
+        pf = result_f.floatParsFinal().find(pd.GetName())
+        shift = (pf.getVal() - pd.getVal()) / pd.getError() if pd.getError() > 0 else 0.0
+        max_shift = max(max_shift, abs(shift))
+        print("%-40s %14.6f %14.6f %14.6f %12.3e" % (pd.GetName(), pd.getVal(), pf.getVal(), pd.getError(), shift))
+    print("Largest shift of the fitted parameters: %.3e of their uncertainty" % max_shift)
+    ok = ok and result_d.status() == result_f.status()
+
+print("\nValidation %s" % ("passed" if ok else "FAILED"))
+exit(0 if ok else 1)
@@ -19,6 +19,7 @@
 #include "../interface/utils.h"
 #include "../interface/AsimovUtils.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/CachingNLL.h"
 
 using namespace RooStats;
 
@@ -37,6 +38,8 @@ std::string AsymptoticLimits::minosAlgo_ = "stepping";
 //float       AsymptoticLimits::minimizerTolerance_ = 0.01;
 //int         AsymptoticLimits::minimizerStrategy_  = 0;
 double AsymptoticLimits::rValue_ = 1.0;
+std::string AsymptoticLimits::massPoints_ = "";
+std::vector<double> AsymptoticLimits::massValues_;
 bool AsymptoticLimits::strictBounds_ = false;
 
 RooAbsData * AsymptoticLimits::asimovDataset_ = nullptr;
@@ -57,8 +60,9 @@ LimitAlgo("AsymptoticLimits specific options") {
         ("noFitAsimov", "Use the pre-fit asimov dataset")
 	("getLimitFromGrid", boost::program_options::value<std::string>(&gridFileName_), "Calculates the limit from a grid of r,cls values")
         ("newExpected", boost::program_options::value<bool>(&newExpected_)->default_value(newExpected_), "Use the new formula for expected limits (default is true)")
-        ("minosAlgo", boost::program_options::value<std::string>(&minosAlgo_)->default_value(minosAlgo_), "Algorithm to use to get the median expected limit: 'minos' (fastest), 'bisection', 'stepping' (default, most robust)")
+        ("minosAlgo", boost::program_options::value<std::string>(&minosAlgo_)->default_value(minosAlgo_), "Algorithm to use to get the median expected limit: 'minos' (fastest), 'bisection', 'stepping' (default, most robust), 'profile' (interpolate the cached profile of q(r), shared by all quantiles and warm-starting each fit from the nearest point)")
         ("strictBounds", "Take --rMax as a strict upper bound")
+        ("massPoints", boost::program_options::value<std::string>(&massPoints_)->default_value(massPoints_), "Compute the limits for several values of MH in one job: comma separated list of masses and/or ranges min:max:step. The background-only asimov dataset is shared if the background-only model does not depend on MH")
     ;
 }
 
@@ -82,6 +86,23 @@ void AsymptoticLimits::applyOptions(const boost::program_options::variables_map
     strictBounds_ = vm.count("strictBounds");
     useGrid_ = vm.count("getLimitFromGrid");
 
+    massValues_.clear();
+    if (!massPoints_.empty()) {
+        if (what_ == "singlePoint" || vm.count("getLimitFromGrid")) throw std::invalid_argument("AsymptoticLimits: --massPoints can't be used together with --singlePoint or --getLimitFromGrid");
+        for (const std::string & token : Utils::split(massPoints_, ",")) {
+            std::vector<std::string> range = Utils::split(token, ":");
+            if (range.size() == 1) {
+                massValues_.push_back(atof(range[0].c_str()));
+            } else if (range.size() == 3) {
+                double mMin = atof(range[0].c_str()), mMax = atof(range[1].c_str()), mStep = atof(range[2].c_str());
+                if (mStep <= 0 || mMax < mMin) throw std::invalid_argument("AsymptoticLimits: malformed range '"+token+"' in --massPoints, must be min:max:step with min <= max and step > 0");
+                for (int i = 0, n = int(std::floor((mMax - mMin)/mStep + 1e-6)); i <= n; ++i) massValues_.push_back(mMin + i*mStep);
+            } else {
+                throw std::invalid_argument("AsymptoticLimits: malformed item '"+token+"' in --massPoints, must be a mass or a range min:max:step");
+            }
+        }
+    }
+
     if (useGrid_){
 	std::cout << "Will calculate limit from grid" << std::endl;
 	gridFile_ = TFile::Open(gridFileName_.c_str());
@@ -98,6 +119,61 @@ void AsymptoticLimits::applyDefaultOptions() {
 
 bool AsymptoticLimits::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
     RooFitGlobalKillSentry silence(verbose <= 1 ? RooFit::WARNING : RooFit::DEBUG);
+
+    bool ret = massValues_.empty() ? runHypothesis(w, mc_s, mc_b, data, limit, limitErr, hint) 
+                                   : runMassScan(w, mc_s, mc_b, data, limit, limitErr, hint);
+
+    // Should now delete the asimov dataset, if we run with toys we recreate it again for the next toy
+    if (asimovDataset_) {
+      delete asimovDataset_;
+      asimovDataset_ = nullptr;
+    }
+
+    return ret;
+}
+
+bool AsymptoticLimits::runMassScan(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
+    RooRealVar *MH = w->var("MH");
+    if (MH == 0) throw std::invalid_argument("AsymptoticLimits: --massPoints requires a variable MH in the workspace");
+
+    // The asimov dataset is built from the background-only hypothesis (including the fit to data, unless --noFitAsimov),
+    // so it can be shared by all the mass points if the background-only model does not depend on MH.
+    bool reuseAsimov = (mc_b != 0 && mc_b->GetPdf() != 0 && !mc_b->GetPdf()->dependsOn(*MH));
+    if (verbose > 0) {
+        CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("Will compute limits for %d mass points, %s the background-only asimov dataset",
+                int(massValues_.size()), reuseAsimov ? "sharing" : "re-generating for each point")),__func__);
+    }
+
+    w->saveSnapshot("massScanClean", utils::returnAllVars(w));
+    bool ret = false;
+    for (double mass : massValues_) {
+        w->loadSnapshot("massScanClean");
+        MH->setVal(mass);
+        w->saveSnapshot("clean", utils::returnAllVars(w));
+        Combine::setTreeMass(mass);
+        if (!reuseAsimov && asimovDataset_) {
+            delete asimovDataset_;
+            asimovDataset_ = nullptr;
+        }
+        if (verbose >= 0) std::cout << "\n -- AsymptoticLimits for MH = " << mass << " --" << std::endl;
+        // the observed limit is committed here, as Combine only does it once per call
+        if (runHypothesis(w, mc_s, mc_b, data, limit, limitErr, hint)) {
+            Combine::commitPoint(false, -1);
+            ret = true;
+        }
+        reuseNLLs_ = reuseAsimov;
+    }
+    reuseNLLs_ = false;
+    w->loadSnapshot("massScanClean");
+    w->saveSnapshot("clean", utils::returnAllVars(w));
+    Combine::setTreeMass(MH->getVal());
+
+    // results of the scan are already in the tree
+    if (ret) Combine::toggleGlobalFillTree(false);
+    return ret;
+}
+
+bool AsymptoticLimits::runHypothesis(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
     /*
     ProfileLikelihood::MinimizerSentry minimizerConfig(minimizerAlgo_, minimizerTolerance_);
     if (verbose > 0) std::cout << "Will compute " << what_ << " limit(s) using minimizer " << minimizerAlgo_ 
@@ -128,12 +204,6 @@ bool AsymptoticLimits::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
         std::cout << std::endl;
     }
 
-    // Should now delete the asimov dataset, if we run with toys we recreate it again for the next toy
-    if (asimovDataset_) {
-      delete asimovDataset_;
-      asimovDataset_ = nullptr;
-    }
-
     // note that for expected we have to return FALSE even if we succeed because otherwise it goes into the observed limit as well
     return ret;
 }
@@ -167,8 +237,11 @@ bool AsymptoticLimits::runLimit(RooWorkspace *w, RooStats::ModelConfig *mc_s, Ro
   }
 
   RooArgSet constraints; if (withSystematics) constraints.add(*mc_s->GetNuisanceParameters());
-  nllD_ = combineCreateNLL(*mc_s->GetPdf(), data,   &constraints, /*offset=*/false);
-  nllA_ = combineCreateNLL(*mc_s->GetPdf(), asimov, &constraints, /*offset=*/false);
+  // when scanning MH the nlls can be kept, the caching inside CachingSimNLL tracks the change of MH
+  if (!reuseNLLs_ || !nllD_ || !nllA_ || !dynamic_cast<cacheutils::CachingSimNLL *>(nllD_.get())) {
+    nllD_ = combineCreateNLL(*mc_s->GetPdf(), data,   &constraints, /*offset=*/false);
+    nllA_ = combineCreateNLL(*mc_s->GetPdf(), asimov, &constraints, /*offset=*/false);
+  }
 
   if (verbose > 0) std::cout << (qtilde_ ? "Restricting" : "Not restricting") << " " << r->GetName() << " to positive values." << std::endl;
   if (verbose > 1) params_->Print("V");
@@ -184,6 +257,8 @@ bool AsymptoticLimits::runLimit(RooWorkspace *w, RooStats::ModelConfig *mc_s, Ro
     minNllD_ = nllD_->getVal();
   }
   rBestD_ = r->getVal();
+  profileD_.clear();
+  if (minosAlgo_ == "profile") profileD_.push_back(ProfilePoint{rBestD_, minNllD_, fitFreeD_});
   if (verbose > 0) {
   	    //std::cout << "NLL at global minimum of data: " << minNllD_ << " (" << r->GetName() << " = " << r->getVal() << ")" << std::endl;
     	CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("NLL at global minimum of data = %g (%s=%g)",minNllD_,r->GetName(),r->getVal())),__func__);
@@ -204,6 +279,8 @@ bool AsymptoticLimits::runLimit(RooWorkspace *w, RooStats::ModelConfig *mc_s, Ro
     minNllA_ = nllA_->getVal();
     sentry.clear();
   }
+  profileA_.clear();
+  if (minosAlgo_ == "profile") profileA_.push_back(ProfilePoint{r->getVal(), minNllA_, fitFreeA_});
   if (verbose > 0) {
   	    //std::cout << "NLL at global minimum of asimov: " << minNllA_ << " (" << r->GetName() << " = " << r->getVal() << ")" << std::endl;
     	CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("NLL at global minimum of asimov = %g (%s=%g)",minNllA_,r->GetName(),r->getVal())),__func__);
@@ -281,7 +358,9 @@ double AsymptoticLimits::getCLs(RooRealVar &r, double rVal, bool getAlsoExpected
   CascadeMinimizer minimD(*nllD_, CascadeMinimizer::Constrained, &r);
   //minimD.setStrategy(minimizerStrategy_);  
 
-  (!fitFixD_.empty() ? fitFixD_ : fitFreeD_).writeTo(*params_);
+  const ProfilePoint *nearD = nearestProfilePoint(profileD_, rVal);
+  if (nearD) nearD->snap.writeTo(*params_);
+  else (!fitFixD_.empty() ? fitFixD_ : fitFreeD_).writeTo(*params_);
   *params_ = snapGlobalObsData;
   r.setVal(rVal);
   r.setConstant(true);
@@ -293,6 +372,7 @@ double AsymptoticLimits::getCLs(RooRealVar &r, double rVal, bool getAlsoExpected
       }
       fitFixD_.readFrom(*params_);
       if (verbose >= 2) fitFixD_.Print("V");
+      if (minosAlgo_ == "profile") profileD_.push_back(ProfilePoint{rVal, nllD_->getVal(), fitFixD_});
   }
   double qmu = 2*(nllD_->getVal() - minNllD_); if (qmu < 0) qmu = 0;
   // qmu is zero when mu < mu^ (CMS NOTE-2011/005)
@@ -306,7 +386,9 @@ double AsymptoticLimits::getCLs(RooRealVar &r, double rVal, bool getAlsoExpected
   CascadeMinimizer minimA(*nllA_, CascadeMinimizer::Constrained, &r);
   //minimA.setStrategy(minimizerStrategy_); 
 
-  (!fitFixA_.empty() ? fitFixA_ : fitFreeA_).writeTo(*params_);
+  const ProfilePoint *nearA = nearestProfilePoint(profileA_, rVal);
+  if (nearA) nearA->snap.writeTo(*params_);
+  else (!fitFixA_.empty() ? fitFixA_ : fitFreeA_).writeTo(*params_);
   *params_ = snapGlobalObsAsimov;
   r.setVal(rVal);
   r.setConstant(true);
@@ -318,6 +400,7 @@ double AsymptoticLimits::getCLs(RooRealVar &r, double rVal, bool getAlsoExpected
       }
       fitFixA_.readFrom(*params_);
       if (verbose >= 2) fitFixA_.Print("V");
+      if (minosAlgo_ == "profile") profileA_.push_back(ProfilePoint{rVal, nllA_->getVal(), fitFixA_});
   }
   double qA  = 2*(nllA_->getVal() - minNllA_); if (qA < 0) qA = 0;
 
@@ -417,6 +500,8 @@ std::vector<std::pair<float,float> > AsymptoticLimits::runLimitExpected(RooWorks
 
     // 3) get ingredients for equation 37
     double nll0 = nll->getVal();
+    profileExp_.clear();
+    if (minosAlgo_ == "profile") profileExp_.push_back(ProfilePoint{r->getVal(), nll0, utils::CheapValueSnapshot(*params_)});
     double median = findExpectedLimitFromCrossing(*nll, r, r->getMin(), r->getMax(), nll0, 0.5);
     double sigma  = median / ROOT::Math::normal_quantile(1-(doCLs_ ? 0.5:1.0)*(1-cl),1.0);
     double alpha = 1-cl;
@@ -448,6 +533,9 @@ std::vector<std::pair<float,float> > AsymptoticLimits::runLimitExpected(RooWorks
         Combine::commitPoint(true, quantiles[iq]);
         expected.push_back(std::pair<float,float>(quantiles[iq], limit));
     }
+    if (verbose > 0 && minosAlgo_ == "profile") {
+    	CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("Expected limits used %d conditional fits of the asimov dataset",int(profileExp_.size())-1)),__func__);
+    }
     return expected;
 
 }
@@ -463,6 +551,7 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
 
     double N = ROOT::Math::normal_quantile(pb, 1.0);
     double errorlevel = 0.5 * pow(N+ROOT::Math::normal_quantile_c((doCLs_ ? pb:1.)*(1-cl),1.0), 2);
+    if (minosAlgo_ == "profile") return findCrossingFromProfile(nll, r, rMin, rMax, nll0, nll0 + errorlevel);
     int minosStat = -1;
     if (minosAlgo_ == "minos") {
         double rMax0 = r->getMax();
@@ -669,6 +758,85 @@ float AsymptoticLimits::findExpectedLimitFromCrossing(RooAbsReal &nll, RooRealVa
     return std::numeric_limits<float>::quiet_NaN();
 }
 
+const AsymptoticLimits::ProfilePoint * AsymptoticLimits::nearestProfilePoint(const std::vector<ProfilePoint> &cache, double rVal) {
+    const ProfilePoint *ret = 0;
+    for (const ProfilePoint &p : cache) {
+        if (ret == 0 || fabs(p.r - rVal) < fabs(ret->r - rVal)) ret = &p;
+    }
+    return ret;
+}
+
+bool AsymptoticLimits::profileAt(RooAbsReal &nll, RooRealVar *r, CascadeMinimizer &minim, std::vector<ProfilePoint> &cache, double rVal) {
+    // start from the parameters of the closest point already profiled
+    const ProfilePoint *nearest = nearestProfilePoint(cache, rVal);
+    if (nearest) nearest->snap.writeTo(*params_);
+    if (!strictBounds_ && rVal >= r->getMax()) r->setMax(rVal*1.1);
+    r->setVal(rVal); r->setConstant(true);
+    bool ok = true;
+    { 
+        CloseCoutSentry sentry2(verbose < 3);
+        if (hasDiscreteParams_) ok = minim.minimize(verbose-2);
+        else ok = minim.improve(verbose-2);
+    }
+    if (!ok && picky_) return false;
+    cache.push_back(ProfilePoint{rVal, nll.getVal(), utils::CheapValueSnapshot(*params_)});
+    if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("At %s = %f:\tdelta(nll) = %.5f (started from %s = %f)\n", r->GetName(), rVal, cache.back().nll-cache.front().nll, r->GetName(), nearest ? nearest->r : rVal)),__func__);
+    return true;
+}
+
+float AsymptoticLimits::findCrossingFromProfile(RooAbsReal &nll, RooRealVar *r, double rMin, double rMax, double nll0, double threshold) {
+    // Above the best fit the profiled q(r) = 2*(nll-nll0) is close to a parabola, so sqrt(q) is almost linear in r.
+    // The crossing is interpolated in sqrt(q) between the closest cached points below and above the threshold and
+    // only the interpolated point is profiled. The cache (profileExp_) is filled by the previous quantiles too, so
+    // after the median most quantiles are bracketed tightly before any new fit is made.
+    if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,"Will search for NLL crossing from the cached profile",__func__);
+    if (strictBounds_ && rMax > r->getMax()) rMax = r->getMax();
+    const double rBest = profileExp_.front().r, yTarget = std::sqrt(2*(threshold - nll0));
+    const double rGiveUp = 100*std::max(rMax, r->getMax());
+    auto sqrtq = [nll0](double nllVal) { return std::sqrt(std::max(0., 2*(nllVal - nll0))); };
+    CascadeMinimizer minim(nll, CascadeMinimizer::Constrained);
+    int lastSide = 0, sameSide = 0;
+    for (int iter = 0; iter < 100; ++iter) {
+        // tightest bracket among the cached points (the best fit point is always below threshold)
+        int lo = 0, hi = -1;
+        for (int i = 1, n = profileExp_.size(); i < n; ++i) {
+            const ProfilePoint &p = profileExp_[i];
+            if (p.r < rBest) continue;
+            if (p.nll < threshold) { if (p.r > profileExp_[lo].r) lo = i; }
+            else if (hi == -1 || p.r < profileExp_[hi].r) hi = i;
+        }
+        double rLo = profileExp_[lo].r, yLo = sqrtq(profileExp_[lo].nll), rNext;
+        if (hi == -1) {
+            if (strictBounds_ && rLo >= r->getMax()) {
+                if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("reached hard bound at %s = %f\n", r->GetName(), rLo)),__func__);
+                return rLo;
+            }
+            // extrapolate along the line through the best fit (slightly beyond, to get a bracket), or start with 5% of the range
+            if (rLo > rBest && yLo > 0) rNext = rBest + std::min(1.05*yTarget/yLo, 10.)*(rLo - rBest);
+            else rNext = rBest + 0.05*(std::max(rMax, rMin) - rBest);
+            if (strictBounds_ && rNext > r->getMax()) rNext = r->getMax();
+            if (rNext > rGiveUp) break;
+            lastSide = 0; sameSide = 0;
+        } else {
+            double rHi = profileExp_[hi].r, yHi = sqrtq(profileExp_[hi].nll), width = rHi - rLo;
+            double rCross = (yHi > yLo ? rLo + width*(yTarget - yLo)/(yHi - yLo) : 0.5*(rLo + rHi));
+            if (width < std::max(rRelAccuracy_*rCross, rAbsAccuracy_)) return rCross;
+            // if the interpolation keeps moving the same end of the bracket, bisect instead
+            rNext = (sameSide >= 2 ? 0.5*(rLo + rHi) : std::max(rLo + 0.01*width, std::min(rHi - 0.01*width, rCross)));
+        }
+        if (!profileAt(nll, r, minim, profileExp_, rNext)) return std::numeric_limits<float>::quiet_NaN();
+        double here = profileExp_.back().nll;
+        if (fabs(here - threshold) < 0.05*minim.tolerance()) return rNext;
+        if (hi != -1) {
+            int side = (here < threshold ? -1 : +1);
+            sameSide = (side == lastSide ? sameSide+1 : 0);
+            lastSide = side;
+        }
+    }
+    if (verbose > 1) CombineLogger::instance().log("AsymptoticLimits.cc",__LINE__,std::string(Form("[WARNING] search for crossing of %s from the cached profile failed", r->GetName())),__func__);
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
 float AsymptoticLimits::calculateLimitFromGrid(RooRealVar *r , double quantile, double alpha){	
 	
 	int iq = 0;
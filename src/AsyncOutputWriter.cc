@@ -0,0 +1,191 @@
+#include "../interface/AsyncOutputWriter.h"
+
+#include <TTree.h>
+#include <TBranch.h>
+#include <TLeaf.h>
+#include <TLeafC.h>
+#include <TDirectory.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
+
+AsyncOutputWriter::AsyncOutputWriter(TTree *tree, unsigned int maxQueue) :
+    tree_(tree),
+    maxQueue_(maxQueue ? maxQueue : 1)
+{
+    static bool registered = (pthread_atfork(&AsyncOutputWriter::beforeFork_, &AsyncOutputWriter::afterForkParent_, &AsyncOutputWriter::afterForkChild_) == 0);
+    (void) registered;
+    writers_().push_back(this);
+    thread_ = std::thread(&AsyncOutputWriter::run_, this);
+}
+
+AsyncOutputWriter::~AsyncOutputWriter()
+{
+    std::vector<AsyncOutputWriter *> &writers = writers_();
+    writers.erase(std::remove(writers.begin(), writers.end(), this), writers.end());
+    if (!forked_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+    unbind_();
+}
+
+std::vector<AsyncOutputWriter *> & AsyncOutputWriter::writers_()
+{
+    static std::vector<AsyncOutputWriter *> writers;
+    return writers;
+}
+
+void AsyncOutputWriter::beforeFork_()
+{
+    // empty the queues, and keep them locked so that the threads are idle when the process is copied
+    for (AsyncOutputWriter *w : writers_()) {
+        if (w->forked_) continue;
+        w->sync();
+        w->mutex_.lock();
+    }
+}
+
+void AsyncOutputWriter::afterForkParent_()
+{
+    for (AsyncOutputWriter *w : writers_()) {
+        if (!w->forked_) w->mutex_.unlock();
+    }
+}
+
+void AsyncOutputWriter::afterForkChild_()
+{
+    // the writer threads were not copied: write directly from now on, and never join them
+    for (AsyncOutputWriter *w : writers_()) {
+        if (w->forked_) continue;
+        w->mutex_.unlock();
+        w->forked_ = true;
+        w->unbind_();
+        w->direct_ = true;
+        // the handle refers to a thread of the parent: leave it alone, as joining or destroying it would block or abort
+        new std::thread(std::move(w->thread_));
+    }
+}
+
+bool AsyncOutputWriter::bind_()
+{
+    columns_.clear();
+    TObjArray *branches = tree_->GetListOfBranches();
+    nbranches_ = branches->GetEntriesFast();
+    unsigned int offset = 0;
+    for (int i = 0; i < nbranches_; ++i) {
+        TBranch *branch = static_cast<TBranch *>(branches->At(i));
+        if (branch->IsA() != TBranch::Class() || branch->GetListOfLeaves()->GetEntriesFast() != 1 || branch->GetAddress() == nullptr) return false;
+        TLeaf *leaf = static_cast<TLeaf *>(branch->GetListOfLeaves()->At(0));
+        if (leaf->GetLeafCount() != nullptr || leaf->InheritsFrom(TLeafC::Class())) return false;
+        unsigned int size = leaf->GetLenType() * leaf->GetLen();
+        columns_.push_back(Column{branch, branch->GetAddress(), size, offset});
+        offset += (size + 7) & ~7u; // keep every value aligned
+    }
+    shadow_.assign(offset, 0);
+    for (const Column &c : columns_) c.branch->SetAddress(&shadow_[c.offset]);
+    return true;
+}
+
+void AsyncOutputWriter::unbind_()
+{
+    for (const Column &c : columns_) c.branch->SetAddress(c.address);
+    columns_.clear();
+}
+
+void * AsyncOutputWriter::userAddress(TBranch *branch) const
+{
+    for (const Column &c : columns_) {
+        if (c.branch == branch) return c.address;
+    }
+    return branch->GetAddress();
+}
+
+void AsyncOutputWriter::fill()
+{
+    if (!direct_ && tree_->GetListOfBranches()->GetEntriesFast() != nbranches_) {
+        // branches were added: rebind them all, with the thread idle
+        sync();
+        unbind_();
+        if (!bind_()) {
+            unbind_();
+            direct_ = true;
+        }
+    }
+    if (direct_) {
+        tree_->Fill();
+        ++rows_;
+        return;
+    }
+    Item item;
+    item.row.resize(shadow_.size());
+    for (const Column &c : columns_) std::memcpy(&item.row[c.offset], c.address, c.size);
+    push_(std::move(item));
+    ++rows_;
+}
+
+void AsyncOutputWriter::write(TDirectory *dir, TObject *obj, const char *name)
+{
+    ++objects_;
+    if (direct_) {
+        dir->WriteTObject(obj, name);
+        delete obj;
+        return;
+    }
+    Item item;
+    item.dir = dir;
+    item.obj = obj;
+    item.name = name;
+    push_(std::move(item));
+}
+
+void AsyncOutputWriter::push_(Item &&item)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.size() >= maxQueue_) {
+        auto start = std::chrono::steady_clock::now();
+        done_.wait(lock, [this] { return queue_.size() < maxQueue_; });
+        blocked_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    queue_.push_back(std::move(item));
+    wake_.notify_one();
+}
+
+void AsyncOutputWriter::sync()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (queue_.empty() && !busy_) return;
+    auto start = std::chrono::steady_clock::now();
+    done_.wait(lock, [this] { return queue_.empty() && !busy_; });
+    blocked_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void AsyncOutputWriter::run_()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) break; // stopped, and nothing left to write
+        Item item = std::move(queue_.front());
+        queue_.pop_front();
+        busy_ = true;
+        done_.notify_all(); // there is room in the queue
+        lock.unlock();
+        if (item.obj) {
+            item.dir->WriteTObject(item.obj, item.name.c_str());
+            delete item.obj;
+        } else {
+            // the rows are queued only while the branches point to shadow_, and it's only resized when idle
+            std::memcpy(shadow_.data(), item.row.data(), item.row.size());
+            tree_->Fill();
+        }
+        lock.lock();
+        busy_ = false;
+        done_.notify_all();
+    }
+}
@@ -1,5 +1,6 @@
 #include "../interface/CMSHistErrorPropagator.h"
 #include "../interface/CMSHistFuncWrapper.h"
+#include "../interface/RooDirtyInhibitSentry.h"
 #include <stdexcept>
 #include <vector>
 #include <ostream>
@@ -193,7 +194,6 @@ void CMSHistErrorPropagator::updateCache(int eval) const {
 
 void CMSHistErrorPropagator::runBarlowBeeston() const {
   if (!bb_.init) return;
-  RooAbsArg::setDirtyInhibit(true);
 
   const unsigned n = bb_.use.size();
   for (unsigned j = 0; j < n; ++j) {
@@ -212,10 +212,12 @@ void CMSHistErrorPropagator::runBarlowBeeston() const {
     bb_.x2[j] = bb_.c[j] / bb_.tmp[j];
     bb_.res[j] = std::max(bb_.x1[j], bb_.x2[j]);
   }
-  for (unsigned j = 0; j < n; ++j) {
-    if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
+  {
+    RooDirtyInhibitSentry inhibit;
+    for (unsigned j = 0; j < n; ++j) {
+      if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
+    }
   }
-  RooAbsArg::setDirtyInhibit(false);
   for (RooAbsArg *arg : bb_.dirty_prop) {
     arg->setValueDirty();
   }
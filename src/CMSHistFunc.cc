@@ -1,6 +1,8 @@
 #include "../interface/CMSHistFunc.h"
 #include "../interface/CMSHistFuncWrapper.h"
 #include "../interface/Accumulators.h"
+#include "../interface/TemplatePool.h"
+#include "../interface/FastTemplateKernel.h"
 #include <vector>
 #include <ostream>
 #include <memory>
@@ -13,10 +15,12 @@
 #include "TMatrix.h"
 #include "vectorized.h"
 #include "TMath.h"
+#include "TBuffer.h"
 
 #define HFVERBOSE 0
 
 bool CMSHistFunc::enable_fast_vertical_ = false;
+bool CMSHistFunc::enable_float_storage_ = false;
 
 CMSHistFunc::CMSHistFunc() {
   morph_strategy_ = 0;
@@ -112,6 +116,7 @@ CMSHistFunc::CMSHistFunc(CMSHistFunc const& other, const char* name)
       rebin_cache_(other.rebin_cache_),
       binerrors_(other.binerrors_),
       storage_(other.storage_),
+      pooled_(other.pooled_),
       morph_strategy_(other.morph_strategy_),
       initialized_(false),
       rebin_(other.rebin_),
@@ -186,6 +191,7 @@ void CMSHistFunc::setGlobalCache() const {
 }
 
 void CMSHistFunc::setActiveBins(unsigned bins) {
+  unpoolStorage();
   cache_.SetActiveSize(bins);
   for (unsigned i = 0; i < storage_.size(); ++i) {
     storage_[i].SetActiveSize(bins);
@@ -229,6 +235,7 @@ void CMSHistFunc::setVerticalMorphs(RooArgList const& vvars) {
 }
 
 void CMSHistFunc::prepareStorage() {
+  pooled_.clear();
   storage_.clear();
   assert(hmorphs_.getSize() <= 1);
   unsigned n_hpoints = 1;
@@ -245,6 +252,7 @@ void CMSHistFunc::prepareStorage() {
 
 void CMSHistFunc::setShape(unsigned hindex, unsigned hpoint, unsigned vindex,
                            unsigned vpoint, TH1 const& hist) {
+  unpoolStorage();
   unsigned idx = getIdx(hindex, hpoint, vindex, vpoint);
 #if HFVERBOSE > 0
   std::cout << "hindex: " << hindex << " hpoint: " << hpoint
@@ -320,7 +328,7 @@ void CMSHistFunc::updateCache() const {
   }
 
   if (step1 || step2) {
-    if (mcache_.size() == 0) mcache_.resize(storage_.size());
+    if (mcache_.size() == 0) mcache_.resize(storageSize());
   }
 
   bool external_morph_updated = (external_morph_.getSize() && static_cast<CMSExternalMorph*>(external_morph_.at(0))->hasChanged());
@@ -350,7 +358,7 @@ void CMSHistFunc::updateCache() const {
               // define vec of mean vals
               unsigned idx = getIdx(0, hi, v, vi);
               if (!mcache_[idx].meansig_set) {
-                setMeanSig(mcache_[idx], storage_[idx]);
+                setMeanSig(mcache_[idx], storage(idx));
               }
               global_.means[hi] = mcache_[idx].mean;
               global_.sigmas[hi] = mcache_[idx].sigma;
@@ -360,7 +368,7 @@ void CMSHistFunc::updateCache() const {
 
             unsigned cidx = getIdx(0, global_.p1, v, vi);
             // The step1 cache might not have been allocated yet...
-            mcache_[cidx].step1.Resize(storage_[cidx].size());
+            mcache_[cidx].step1.Resize(storage(cidx).size());
             mcache_[cidx].step1.Clear();
 
             for (unsigned hi = 0; hi < hpoints_[0].size(); ++hi) {
@@ -386,13 +394,13 @@ void CMSHistFunc::updateCache() const {
               int il =  cache_.FindBin(xl);
               double xh = 0.;
               int ih = 0;
-              int n = storage_[idx].size();
+              int n = storage(idx).size();
 
 #if HFVERBOSE > 0
-              storage_[idx].Dump();
+              storage(idx).Dump();
 #endif
 
-              for (unsigned ib = 0; ib < storage_[idx].size(); ++ib) {
+              for (unsigned ib = 0; ib < storage(idx).size(); ++ib) {
 
                 double sum = 0.;
 
@@ -406,37 +414,37 @@ void CMSHistFunc::updateCache() const {
 #endif
 
                 if (il != -1 && il != n && il != ih) {
-                  sum += (cache_.GetEdge(il + 1) - xl) * storage_[idx][il];
+                  sum += (cache_.GetEdge(il + 1) - xl) * storage(idx)[il];
 #if HFVERBOSE > 1
                   std::cout << "Adding from lower edge: to boundary = "
                             << cache_.GetEdge(il + 1)
-                            << "\tcontent = " << storage_[idx][il] << "\n";
+                            << "\tcontent = " << storage(idx)[il] << "\n";
 #endif
                 }
 
                 for (int step = il + 1; step < ih; ++step) {
-                  sum += cache_.GetWidth(step) * storage_[idx][step];
+                  sum += cache_.GetWidth(step) * storage(idx)[step];
 #if HFVERBOSE > 1
                   std::cout << "Adding whole bin: bin = " << step
-                            << "\tcontent = " << storage_[idx][step] << "\n";
+                            << "\tcontent = " << storage(idx)[step] << "\n";
 #endif
                 }
                 // Add the fraction of the last bin
                 if (ih != -1 && ih != n && il != ih) {
-                  sum += (xh - cache_.GetEdge(ih)) * storage_[idx][ih];
+                  sum += (xh - cache_.GetEdge(ih)) * storage(idx)[ih];
 #if HFVERBOSE > 1
                   std::cout
                       << "Adding to upper edge: from boundary = "
                       << cache_.GetEdge(ih)
-                      << "\tcontent = " << storage_[idx][ih] << "\n";
+                      << "\tcontent = " << storage(idx)[ih] << "\n";
 #endif
                 }
 
                 if (il == ih && il != -1 && il != n) {
-                  sum += (xh - xl) * storage_[idx][il];
+                  sum += (xh - xl) * storage(idx)[il];
 #if HFVERBOSE > 1
                   std::cout << "Adding partial bin: bin = " << il
-                            << "\tcontent = " << storage_[idx][il] << "\n";
+                            << "\tcontent = " << storage(idx)[il] << "\n";
 #endif
                 }
 
@@ -456,13 +464,13 @@ void CMSHistFunc::updateCache() const {
 #if HFVERBOSE > 0
               std::cout << "Setting cdf for " << 0 << " " << global_.p1 << " " << v << " " << vi << "\n";
 #endif
-              setCdf(mcache_[idx1], storage_[idx1]);
+              setCdf(mcache_[idx1], storage(idx1));
             }
             if (!mcache_[idx2].cdf_set) {
 #if HFVERBOSE > 0
               std::cout << "Setting cdf for " << 0 << " " << global_.p2 << " " << v << " " << vi << "\n";
 #endif
-              setCdf(mcache_[idx2], storage_[idx2]);
+              setCdf(mcache_[idx2], storage(idx2));
             }
             if (!mcache_[idx1].interp_set) {
 #if HFVERBOSE > 0
@@ -484,7 +492,7 @@ void CMSHistFunc::updateCache() const {
             }
             else
             {
-              mcache_[idx1].step1 = cdfMorph(idx1, x1, x2, val);
+              cdfMorph(idx1, x1, x2, val, mcache_[idx1].step1);
               mcache_[idx1].step1.CropUnderflows();
               double ym = y1 + ((y2 - y1) / (x2 - x1)) * (val - x1);
               mcache_[idx1].step1.Scale(ym / integrateTemplate(mcache_[idx1].step1));
@@ -509,10 +517,7 @@ void CMSHistFunc::updateCache() const {
             hi.LogRatio(mcache_[idx].step1);
             lo.LogRatio(mcache_[idx].step1);
           }
-          // TODO: could skip the next two lines if .sum and .diff have been set before
-          mcache_[idxLo].sum = mcache_[idx].step1;
-          mcache_[idxLo].diff = mcache_[idx].step1;
-          FastTemplate::SumDiff(hi, lo, mcache_[idxLo].sum, mcache_[idxLo].diff);
+          setSumDiff(mcache_[idxLo], hi, lo, mcache_[idx].step1);
         }
       }
       hmorph_sentry_.reset();
@@ -525,7 +530,7 @@ void CMSHistFunc::updateCache() const {
       for (int v = 0; v < vmorphs_.getSize() + 1; ++v) {
         unsigned idx = getIdx(0, global_.p1, 0, 0);
         if (v == 0) {
-          mcache_[idx].step1 = storage_[idx];
+          mcache_[idx].step1 = storage(idx);
         }
         if (v >= 1) {
 #if HFVERBOSE > 0
@@ -533,19 +538,16 @@ void CMSHistFunc::updateCache() const {
 #endif
           unsigned idxLo = getIdx(0, global_.p1, v, 0);
           unsigned idxHi = getIdx(0, global_.p1, v, 1);
-          FastTemplate lo = storage_[idxLo];
-          FastTemplate hi = storage_[idxHi];
+          FastTemplate lo = storage(idxLo);
+          FastTemplate hi = storage(idxHi);
           if (vtype_ == VerticalSetting::QuadLinear) {
-            hi.Subtract(storage_[idx]);
-            lo.Subtract(storage_[idx]);
+            hi.Subtract(storage(idx));
+            lo.Subtract(storage(idx));
           } else if (vtype_ == VerticalSetting::LogQuadLinear) {
-            hi.LogRatio(storage_[idx]);
-            lo.LogRatio(storage_[idx]);
+            hi.LogRatio(storage(idx));
+            lo.LogRatio(storage(idx));
           }
-          // TODO: could skip the next two lines if .sum and .diff have been set before
-          mcache_[idxLo].sum = storage_[idx];
-          mcache_[idxLo].diff = storage_[idx];
-          FastTemplate::SumDiff(hi, lo, mcache_[idxLo].sum, mcache_[idxLo].diff);
+          setSumDiff(mcache_[idxLo], hi, lo, storage(idx));
         }
       }
       hmorph_sentry_.reset();
@@ -582,6 +584,8 @@ void CMSHistFunc::updateCache() const {
       mcache_[idx].step2.Dump();
 #endif
 
+      // all the morphs are applied in a single pass over the bins
+      FastTemplateKernel kernel(mcache_[idx].step2);
       for (int v = 0; v < vmorphs_.getSize(); ++v) {
         double x = vmorphs_vec_[v]->getVal();
         // if we're in fast_vertical then need to check if this vmorph value has changed.
@@ -590,26 +594,39 @@ void CMSHistFunc::updateCache() const {
 
         unsigned vidx = getIdx(0, global_.p1, v+1, 0);
 
+        Cache const& vc = mcache_[vidx];
+        bool compact = !vc.fsum.empty();
         if (fast_vertical_) {
           double xold = vertical_prev_vals_[v];
-          mcache_[idx].step2.DiffMeld(mcache_[vidx].diff, mcache_[vidx].sum, 0.5*x, smoothStepFunc(x), 0.5*xold, smoothStepFunc(xold));
+          if (compact) {
+            kernel.diffMeld(vc.fdiff, vc.fsum, 0.5*x, smoothStepFunc(x), 0.5*xold, smoothStepFunc(xold));
+          } else {
+            kernel.diffMeld(vc.diff, vc.sum, 0.5*x, smoothStepFunc(x), 0.5*xold, smoothStepFunc(xold));
+          }
         } else {
-          mcache_[idx].step2.Meld(mcache_[vidx].diff, mcache_[vidx].sum, 0.5*x, smoothStepFunc(x));
+          if (compact) {
+            kernel.meld(vc.fdiff, vc.fsum, 0.5*x, smoothStepFunc(x));
+          } else {
+            kernel.meld(vc.diff, vc.sum, 0.5*x, smoothStepFunc(x));
+          }
         }
         vertical_prev_vals_[v] = x;
 
 #if HFVERBOSE > 1
         std::cout << "Morphing for " << vmorphs_[v].GetName() << " with value: " << x << "\n";
-        std::cout << "Template after vmorph " << v+1 << ": " << mcache_[idx].step2.Integral() << "\n";
-        mcache_[idx].step2.Dump();
 #endif
       }
-      cache_.CopyValues(mcache_[idx].step2);
+      double step2Integral = kernel.run();
+#if HFVERBOSE > 1
+      std::cout << "Template after vmorph: " << step2Integral << "\n";
+      mcache_[idx].step2.Dump();
+#endif
+      FastTemplateKernel output(cache_);
+      output.copy(mcache_[idx].step2);
       if (vtype_ == VerticalSetting::LogQuadLinear) {
-        cache_.Exp();
-        cache_.Scale(mcache_[idx].step1.Integral() / mcache_[idx].step2.Integral());
+        output.exp().scale(mcache_[idx].step1.Integral() / step2Integral);
       }
-      cache_.CropUnderflows();
+      output.cropUnderflows().run();
       if (enable_fast_vertical_) fast_vertical_ = true;
 
 #if HFVERBOSE > 0
@@ -625,6 +642,21 @@ void CMSHistFunc::updateCache() const {
 }
 
 
+void CMSHistFunc::setSumDiff(Cache& c, FastTemplate const& hi, FastTemplate const& lo, FastTemplate const& nominal) const {
+  c.sum = nominal;
+  c.diff = nominal;
+  FastTemplate::SumDiff(hi, lo, c.sum, c.diff);
+  if (enable_float_storage_) {
+    c.sum.ToFloat(c.fsum);
+    c.diff.ToFloat(c.fdiff);
+    c.sum = FastTemplate();
+    c.diff = FastTemplate();
+  } else {
+    c.fsum.clear();
+    c.fdiff.clear();
+  }
+}
+
 void CMSHistFunc::applyRebin() const {
   rebin_cache_.Clear();
   for (unsigned i = 0; i < cache_.size(); ++i) {
@@ -957,11 +989,24 @@ void CMSHistFunc::prepareInterpCache(Cache& c1,
                 << std::endl;
     }
 #endif
+  // Table for cdfMorph: the cdf points (x1, x2, y) only need to be blended for each value
+  // of the morphing parameter, and the edges and widths of the output bins are fixed
+  unsigned nx = c1.y.size();
+  unsigned nbn = cache_.size();
+  c1.edges.resize(nbn + 1);
+  c1.widths.resize(nbn + 1);
+  for (unsigned i = 0; i <= nbn; ++i) {
+    c1.edges[i] = cache_.GetEdge(i);
+    // width of the bin below each edge, i.e. cache_.GetWidth(cache_.FindBin(edge)) with underflows in the first bin
+    c1.widths[i] = cache_.GetWidth(i > 0 ? i - 1 : 0);
+  }
+  c1.xdisn.resize(nx);
+  c1.sigdisf.resize(nbn + 1);
   c1.interp_set = true;
 }
 
-FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
-                                 double parinterp) const {
+void CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
+                           double parinterp, FastTemplate& out) const {
   double wt1;
   double wt2;
   if (par2 != par1) {
@@ -1021,24 +1066,27 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
   // *......We set all the bins following the final edge to the value
   // *      of the final edge.
 
-  Cache const& c1 = mcache_[idx];
+  Cache& c1 = mcache_[idx];
 
   int nbn = cache_.size();
-  int nbe = cache_.size() + 1;
+  std::vector<double> const& edges = c1.edges;
 
-  double x  = cache_.GetEdge(nbn);
+  double x  = edges[nbn];
   int ix = nbn;
 
   int nx3 = c1.y.size();
-  std::vector<double> xdisn(nx3);
+  std::vector<double>& xdisn = c1.xdisn;
+  double const* x1 = &c1.x1[0];
+  double const* x2 = &c1.x2[0];
   for (int i = 0; i < nx3; ++i) {
-    xdisn[i] = wt1 * c1.x1[i] + wt2 * c1.x2[i];
+    xdisn[i] = wt1 * x1[i] + wt2 * x2[i];
   }
 #if HFVERBOSE > 2
     std::cout << "relevant x,y for the morphed cdf: "  << std::endl;
     for (unsigned int i=0; i < c1.y.size(); ++i){ std::cout << "\t (x,y) = (" << xdisn[i] << "," << c1.y[i] << ")" << std::endl; }
 #endif
-  std::vector<double> sigdisf(nbe, 0.);
+  std::vector<double>& sigdisf = c1.sigdisf;
+  std::fill(sigdisf.begin(), sigdisf.end(), 0.);
 
 
   nx3 = nx3 - 1;
@@ -1057,7 +1105,7 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
 #endif
 
     ix = ix - 1;
-    x = cache_.GetEdge(ix);
+    x = edges[ix];
   }
   Int_t ixl = ix + 1;
 
@@ -1074,7 +1122,7 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
   // *
 
   ix = 0;
-  x = cache_.GetEdge(ix + 1);
+  x = edges[ix + 1];
 
 #if HFVERBOSE > 2
   std::cout << "Start setting initial bins at x=" << x << std::endl;
@@ -1087,7 +1135,7 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
               << xdisn[1] << " " << sigdisf[ix] << std::endl;
 #endif
     ix = ix + 1;
-    x = cache_.GetEdge(ix + 1);
+    x = edges[ix + 1];
   }
   Int_t ixf = ix;
 
@@ -1100,7 +1148,7 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
   Int_t ix3 = 0;  // Problems with initial edge!!!
   double y = 0;
   for (ix = ixf; ix < ixl; ix++) {
-    x = cache_.GetEdge(ix);
+    x = edges[ix];
     if (x < xdisn[0]) {
       y = 0;
     } else if (x > xdisn[nx3]) {
@@ -1109,10 +1157,7 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
       while (xdisn[ix3 + 1] <= x && ix3 < 2 * nbn) {
         ix3 = ix3 + 1;
       }
-      int bin = cache_.FindBin(x);
-      if (bin == -1) bin = 0;
-      // std::cout << "x=" << x << ", bin=" << bin << "\n";
-      Double_t dx2 = cache_.GetWidth(bin);
+      Double_t dx2 = c1.widths[ix];
       if (xdisn[ix3 + 1] - x >= 1.0 * dx2) {  // Empty bin treatment
 #if HFVERBOSE > 2
         std::cout << "Warning - th1fmorph: encountered empty bin." << std::endl;
@@ -1151,16 +1196,12 @@ FastTemplate CMSHistFunc::cdfMorph(unsigned idx, double par1, double par2,
   // .....Differentiate interpolated cdf and return renormalized result in
   //      new histogram.
 
-  FastTemplate morphedhist(nbn);
+  out.Resize(nbn);
 
   for (ix = nbn - 1; ix > -1; ix--) {
     y = sigdisf[ix + 1] - sigdisf[ix];
-    morphedhist[ix] = y / cache_.GetWidth(ix);
+    out[ix] = y / c1.widths[ix + 1];
   }
-
-  // ......All done, return the result.
-
-  return morphedhist;
 }
 
 double CMSHistFunc::integrateTemplate(FastTemplate const& t) const {
@@ -1170,6 +1211,36 @@ double CMSHistFunc::integrateTemplate(FastTemplate const& t) const {
 }
 
 
+void CMSHistFunc::poolStorage() {
+  if (!TemplatePool::enabled() || !pooled_.empty() || storage_.empty()) return;
+  TemplatePool &pool = TemplatePool::instance();
+  pooled_.reserve(storage_.size());
+  for (FastTemplate const& t : storage_) pooled_.push_back(pool.intern(t));
+  std::vector<FastTemplate>().swap(storage_);
+}
+
+void CMSHistFunc::unpoolStorage() {
+  if (pooled_.empty()) return;
+  storage_.clear();
+  storage_.reserve(pooled_.size());
+  for (auto const& t : pooled_) storage_.push_back(*t);
+  pooled_.clear();
+}
+
+void CMSHistFunc::Streamer(TBuffer &R__b) {
+  if (R__b.IsReading()) {
+    R__b.ReadClassBuffer(CMSHistFunc::Class(), this);
+    pooled_.clear();
+    poolStorage();
+  } else {
+    // the templates are written from storage_, so take them back from the pool for the time being
+    bool pooled = !pooled_.empty();
+    unpoolStorage();
+    R__b.WriteClassBuffer(CMSHistFunc::Class(), this);
+    if (pooled) poolStorage();
+  }
+}
+
 void CMSHistFunc::printMultiline(std::ostream& os, Int_t contents,
                                  Bool_t verbose, TString indent) const {
   RooAbsReal::printMultiline(os, contents, verbose, indent);
@@ -1219,6 +1290,10 @@ void CMSHistFunc::EnableFastVertical() {
   enable_fast_vertical_ = true;
 }
 
+void CMSHistFunc::EnableFloatStorage(bool flag) {
+  enable_float_storage_ = flag;
+}
+
 
 void CMSHistFunc::injectExternalMorph(CMSExternalMorph& morph) {
   if ( morph.batchGetBinValues().size() != cache_.size() ) {
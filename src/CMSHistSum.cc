@@ -1,5 +1,7 @@
 #include "../interface/CMSHistSum.h"
 #include "../interface/CMSHistFuncWrapper.h"
+#include "../interface/FastTemplateKernel.h"
+#include "../interface/RooDirtyInhibitSentry.h"
 #include <stdexcept>
 #include <vector>
 #include <ostream>
@@ -18,6 +20,7 @@
 #define HFVERBOSE 0
 
 bool CMSHistSum::enable_fast_vertical_ = false;
+bool CMSHistSum::enable_float_storage_ = false;
 
 CMSHistSum::CMSHistSum() : initialized_(false), fast_mode_(0) {}
 
@@ -74,7 +77,7 @@ CMSHistSum::CMSHistSum(const char* name,
     }
 
     // Determine the size we'll need for storage_
-    n_storage += func->storage_.size();
+    n_storage += func->storageSize();
 
     // Construct a list of the unique vertical morphing parameters and
     // make a per-process index of the local list positions of each vmorph
@@ -111,7 +114,7 @@ CMSHistSum::CMSHistSum(const char* name,
 #if HFVERBOSE > 0
     std::cout << "Before copy: size = " << storage_.size() << ", distance = " << std::distance(storage_.begin(), copy_it) << "\n";
 #endif
-    copy_it = std::copy(func->storage_.begin(), func->storage_.end(), copy_it);
+    for (unsigned i = 0; i < func->storageSize(); ++i, ++copy_it) *copy_it = func->storage(i);
 #if HFVERBOSE > 0
     std::cout << "After copy: size = " << storage_.size() << ", distance = " << std::distance(storage_.begin(), copy_it) << "\n";
 #endif
@@ -181,6 +184,7 @@ CMSHistSum::CMSHistSum(
       storage_(other.storage_),
       process_fields_(other.process_fields_),
       vmorph_fields_(other.vmorph_fields_),
+      fstorage_(other.fstorage_),
       binerrors_(other.binerrors_),
       vtype_(other.vtype_),
       vsmooth_par_(other.vsmooth_par_),
@@ -194,6 +198,15 @@ CMSHistSum::CMSHistSum(
       external_morph_indices_(other.external_morph_indices_)
 {
       initialize();
+      // the copies (e.g. the clones made for the NLL) keep only the single precision vmorph templates, while
+      // the original keeps the double precision ones too, as it may be written to a file
+      if (!fstorage_.empty()) {
+        for (int code : vmorph_fields_) {
+          if (code == -1) continue;
+          storage_[code + 0] = FastTemplate();
+          storage_[code + 1] = FastTemplate();
+        }
+      }
 }
 
 void CMSHistSum::initialize() const {
@@ -232,6 +245,20 @@ void CMSHistSum::initialize() const {
     }
   }
 
+  if (enable_float_storage_ || !fstorage_.empty()) {
+    // the templates are read once per morphing parameter in each evaluation,
+    // so this halves the memory traffic of updateMorphs
+    fstorage_.resize(storage_.size());
+    for (int code : vmorph_fields_) {
+      if (code == -1) continue;
+      for (int k = 0; k < 2; ++k) {
+        // empty if released in the object this one was copied from, which gave us the float template
+        if (storage_[code + k].size() == 0) continue;
+        storage_[code + k].ToFloat(fstorage_[code + k]);
+      }
+    }
+  }
+
   valsum_ = cache_;
   staging_ = cache_;
   valsum_.Clear();
@@ -270,61 +297,60 @@ void CMSHistSum::updateMorphs() const {
       fast_mode_ = 0;
     }
   }
-  // If we're not in fast mode, need to reset all the compcache_
+  int n_morphs = vmorphpars_.size();
+
+  if (vertical_prev_vals_.size() == 0) {
+    vertical_prev_vals_.resize(n_morphs);
+  }
+  vertical_vals_.resize(n_morphs);
+  for (int iv = 0; iv < n_morphs; ++iv) {
+    vertical_vals_[iv] = vmorphpars_[iv]->getVal();
+  }
+
+  // Each process template is reset if we're not in fast mode, and then all the vmorphs
+  // are applied to it in a single pass over the bins
   #if HFVERBOSE > 0
   std::cout << "fast_mode_ = " << fast_mode_ << std::endl;
   #endif
   for (unsigned ip = 0; ip < compcache_.size(); ++ip) {
+    FastTemplateKernel kernel(compcache_[ip]);
     if (fast_mode_ == 0) {
-      compcache_[ip].CopyValues(storage_[process_fields_[ip]]);
+      kernel.copy(storage_[process_fields_[ip]]);
       if ( process_morphs[ip] != nullptr ) {
-        auto& extdata = process_morphs[ip]->batchGetBinValues();
-        for(size_t ibin=0; ibin<extdata.size(); ++ibin) {
-          compcache_[ip][ibin] *= extdata[ibin];
-        }
+        kernel.multiply(process_morphs[ip]->batchGetBinValues());
       }
       if (vtype_[ip] == CMSHistFunc::VerticalSetting::LogQuadLinear) {
-        compcache_[ip].Log();
+        kernel.log();
       }
     }
-  }
-  int n_morphs = vmorphpars_.size();
-
-  if (vertical_prev_vals_.size() == 0) {
-    vertical_prev_vals_.resize(n_morphs);
-  }
-  // Loop through vmorphs
-  for (unsigned iv = 0; iv < vmorphpars_.size(); ++iv) {
-    double x = vmorphpars_[iv]->getVal();
-    if (fast_mode_ == 1 && (x == vertical_prev_vals_[iv])) {
-      #if HFVERBOSE > 0
-      std::cout << "Skipping " << vmorphpars_[iv]->GetName() << ", prev = now = " << x << std::endl;
-      #endif
-      continue;
-    }
-    #if HFVERBOSE > 0
-    if (fast_mode_ == 1) {
-      std::cout << "Updating " << vmorphpars_[iv]->GetName() << ", prev =  " << vertical_prev_vals_[iv] << ", now = " << x << std::endl;
-    }
-    #endif
-
-
-    // If in fast made, check if the value has changed since the last eval,
-    // and if it hasn't, skip it
-
-    // For each vmorph need to know the list of processes we apply to
-    for (unsigned ip = 0; ip < compcache_.size(); ++ip) {
+    for (int iv = 0; iv < n_morphs; ++iv) {
+      double x = vertical_vals_[iv];
+      // If in fast mode, skip the vmorphs whose value hasn't changed since the last eval
+      if (fast_mode_ == 1 && (x == vertical_prev_vals_[iv])) continue;
       int code = vmorph_fields_[ip * n_morphs + iv];
       if (code == -1) continue;
+      #if HFVERBOSE > 0
+      std::cout << "Updating " << vmorphpars_[iv]->GetName() << " for process " << ip << ", prev =  " << vertical_prev_vals_[iv] << ", now = " << x << std::endl;
+      #endif
       if (fast_mode_ == 1) {
         double xold = vertical_prev_vals_[iv];
-        compcache_[ip].DiffMeld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip), 0.5*xold, smoothStepFunc(xold, ip));
+        if (!fstorage_.empty()) {
+          kernel.diffMeld(fstorage_[code + 1], fstorage_[code + 0], 0.5*x, smoothStepFunc(x, ip), 0.5*xold, smoothStepFunc(xold, ip));
+        } else {
+          kernel.diffMeld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip), 0.5*xold, smoothStepFunc(xold, ip));
+        }
       } else {
-        compcache_[ip].Meld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip));
+        if (!fstorage_.empty()) {
+          kernel.meld(fstorage_[code + 1], fstorage_[code + 0], 0.5*x, smoothStepFunc(x, ip));
+        } else {
+          kernel.meld(storage_[code + 1], storage_[code + 0], 0.5*x, smoothStepFunc(x, ip));
+        }
       }
     }
-    vertical_prev_vals_[iv] = x;
+    // in fast mode, nothing is queued for the processes none of whose vmorphs changed
+    if (!kernel.empty()) kernel.run();
   }
+  vertical_prev_vals_ = vertical_vals_;
 
   if (enable_fast_vertical_) fast_mode_ = 1;
 }
@@ -359,13 +385,13 @@ void CMSHistSum::updateCache() const {
     valsum_.Clear();
     std::fill(err2sum_.begin(), err2sum_.end(), 0.);
     for (unsigned i = 0; i < vcoeffpars_.size(); ++i) {
-      staging_ = compcache_[i];
+      FastTemplateKernel kernel(staging_);
+      kernel.copy(compcache_[i]);
       if (vtype_[i] == CMSHistFunc::VerticalSetting::LogQuadLinear) {
-        staging_.Exp();
-        staging_.Scale(storage_[process_fields_[i]].Integral() / staging_.Integral());
+        double integral = kernel.exp().run();
+        kernel.scale(storage_[process_fields_[i]].Integral() / integral);
       }
-      staging_.CropUnderflows();
-      vectorized::mul_add(valsum_.size(), coeffvals_[i], &(staging_[0]), &valsum_[0]);
+      kernel.cropUnderflows().addTo(coeffvals_[i], &valsum_[0]).run();
       vectorized::mul_add_sqr(valsum_.size(), coeffvals_[i], &(binerrors_[i][0]), &err2sum_[0]);
     }
     vectorized::sqrt(valsum_.size(), &err2sum_[0], &toterr_[0]);
@@ -419,7 +445,6 @@ void CMSHistSum::updateCache() const {
 
 void CMSHistSum::runBarlowBeeston() const {
   if (!bb_.init) return;
-  RooAbsArg::setDirtyInhibit(true);
 
   const unsigned n = bb_.use.size();
   for (unsigned j = 0; j < n; ++j) {
@@ -438,10 +463,12 @@ void CMSHistSum::runBarlowBeeston() const {
     bb_.x2[j] = bb_.c[j] / bb_.tmp[j];
     bb_.res[j] = std::max(bb_.x1[j], bb_.x2[j]);
   }
-  for (unsigned j = 0; j < n; ++j) {
-    if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
+  {
+    RooDirtyInhibitSentry inhibit;
+    for (unsigned j = 0; j < n; ++j) {
+      if (toterr_[bb_.use[j]] > 0.) bb_.push_res[j]->setVal(bb_.res[j]);
+    }
   }
-  RooAbsArg::setDirtyInhibit(false);
   for (RooAbsArg *arg : bb_.dirty_prop) {
     arg->setValueDirty();
   }
@@ -782,6 +809,10 @@ void CMSHistSum::EnableFastVertical() {
   enable_fast_vertical_ = true;
 }
 
+void CMSHistSum::EnableFloatStorage(bool flag) {
+  enable_float_storage_ = flag;
+}
+
 void CMSHistSum::injectExternalMorph(int idx, CMSExternalMorph& morph) {
   if ( idx >= coeffpars_.getSize() ) {
     throw std::runtime_error("Process index larger than number of processes in CMSHistSum");
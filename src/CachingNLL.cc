@@ -2,6 +2,10 @@
 #include "../interface/utils.h"
 #include "../interface/FnTimer.h"
 #include <stdexcept>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <functional>
 #include <RooCategory.h>
 #include <RooDataSet.h>
 #include <RooProduct.h>
@@ -19,6 +23,12 @@
 #include "../interface/VectorizedCB.h"
 #include "../interface/VectorizedSimplePdfs.h"
 #include "../interface/VectorizedHistFactoryPdfs.h"
+#include "../interface/VectorizedSpinZeroPdfs.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_1D_fast.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_2D_fast.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_phase_fast.h"
+#include "../interface/VBFHZZ4L_RooSpinZeroPdf_fast.h"
+#include "../interface/VVHZZ4L_RooSpinZeroPdf_1D_fast.h"
 #include "../interface/CachingMultiPdf.h"
 #include "../interface/RooCheapProduct.h"
 #include "../interface/Accumulators.h"
@@ -28,6 +38,8 @@
 namespace cacheutils {
     typedef OptimizedCachingPdfT<FastVerticalInterpHistPdf,FastVerticalInterpHistPdfV> CachingHistPdf;
     typedef OptimizedCachingPdfT<FastVerticalInterpHistPdf2,FastVerticalInterpHistPdf2V> CachingHistPdf2;
+    typedef OptimizedCachingPdfT<FastVerticalInterpHistPdf2D2,FastVerticalInterpHistPdf2D2V> CachingHistPdf2D2;
+    typedef OptimizedCachingPdfT<FastVerticalInterpHistPdf3D,FastVerticalInterpHistPdf3DV> CachingHistPdf3D;
     typedef OptimizedCachingPdfT<CMSHistFunc, CMSHistV<CMSHistFunc>> CachingCMSHistFunc;
     typedef OptimizedCachingPdfT<CMSHistFuncWrapper, CMSHistV<CMSHistFuncWrapper>> CachingCMSHistFuncWrapper;
     typedef OptimizedCachingPdfT<CMSHistErrorPropagator, CMSHistV<CMSHistErrorPropagator>> CachingCMSHistErrorPropagator;
@@ -36,6 +48,21 @@ namespace cacheutils {
     typedef OptimizedCachingPdfT<RooCBShape,VectorizedCBShape> CachingCBPdf;
     typedef OptimizedCachingPdfT<RooExponential,VectorizedExponential> CachingExpoPdf;
     typedef OptimizedCachingPdfT<RooPower,VectorizedPower> CachingPowerPdf;
+    typedef OptimizedCachingPdfT<HZZ4L_RooSpinZeroPdf_1D_fast, VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_1D_fast>> CachingSpinZeroPdf1D;
+    typedef OptimizedCachingPdfT<HZZ4L_RooSpinZeroPdf_2D_fast, VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_2D_fast>> CachingSpinZeroPdf2D;
+    typedef OptimizedCachingPdfT<HZZ4L_RooSpinZeroPdf_phase_fast, VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_phase_fast>> CachingSpinZeroPdfPhase;
+    typedef OptimizedCachingPdfT<VBFHZZ4L_RooSpinZeroPdf_fast, VectorizedSpinZeroPdf<VBFHZZ4L_RooSpinZeroPdf_fast>> CachingVBFSpinZeroPdf;
+    typedef OptimizedCachingPdfT<VVHZZ4L_RooSpinZeroPdf_1D_fast, VectorizedSpinZeroPdf<VVHZZ4L_RooSpinZeroPdf_1D_fast>> CachingVVSpinZeroPdf1D;
+
+    /// the vectorized spin-zero pdfs need analytical integrals and pure templates: the others go through the generic CachingPdf
+    template<typename PdfT, typename CachingT>
+    cacheutils::CachingPdfBase *makeCachingSpinZeroPdf(RooAbsReal *pdf, const RooArgSet *obs, bool verb) {
+        if (VectorizedSpinZeroPdf<PdfT>::canVectorize(static_cast<const PdfT &>(*pdf), *obs)) return new CachingT(pdf, obs);
+        if (verb) {
+            CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("Can't vectorize %s (%s), whose integral is not analytical or whose components depend on parameters",pdf->ClassName(),pdf->GetName())),__func__);
+        }
+        return new cacheutils::CachingPdf(pdf, obs);
+    }
 
     class ReminderSum : public RooAbsReal {
         public:
@@ -69,10 +96,16 @@ namespace cacheutils {
 #include "../interface/ProfilingTools.h"
 
 //std::map<std::string,double> cacheutils::CachingAddNLL::offsets_;
-bool cacheutils::CachingSimNLL::noDeepLEE_ = false;
-bool cacheutils::CachingSimNLL::hasError_  = false;
 bool cacheutils::CachingSimNLL::optimizeContraints_  = true;
 
+cacheutils::NLLEvalContext::NLLEvalContext() :
+    gentleNegativePenalty(runtimedef::get("GENTLE_LEE")),
+    expEventsNoNorm(runtimedef::get("ADDNLL_ROOREALSUM_NONORM")),
+    removeConstantZeroPoint(runtimedef::get("REMOVE_CONSTANT_ZERO_POINT")),
+    noDeepLEE(runtimedef::get("SIMNLL_NO_LEE"))
+{
+}
+
 //#define DEBUG_TRACE_POINTS
 #ifdef DEBUG_TRACE_POINTS
 namespace { 
@@ -115,6 +148,11 @@ namespace {
 namespace { unsigned long CachingSimNLLEvalCount = 0; }
 #endif
 
+namespace {
+    // shared by all the NLLs, so that the number of warnings is bounded in the whole job
+    std::atomic<unsigned int> zeroEntryWarnings_(0);
+}
+
 cacheutils::ArgSetChecker::ArgSetChecker(const RooAbsCollection &set) 
 {
     for (RooAbsArg *a : set) {
@@ -380,8 +418,9 @@ Double_t cacheutils::ReminderSum::evaluate() const {
     return ret;
 }
 
-cacheutils::CachingAddNLL::CachingAddNLL(const char *name, const char *title, RooAbsPdf *pdf, RooAbsData *data, bool includeZeroWeights) :
+cacheutils::CachingAddNLL::CachingAddNLL(const char *name, const char *title, RooAbsPdf *pdf, RooAbsData *data, bool includeZeroWeights, std::shared_ptr<NLLEvalContext> context) :
     RooAbsReal(name, title),
+    context_(context ? context : std::make_shared<NLLEvalContext>()),
     pdf_(pdf),
     params_("params","parameters",this),
     catParams_("catParams","RooCategory parameters",this),
@@ -396,6 +435,7 @@ cacheutils::CachingAddNLL::CachingAddNLL(const char *name, const char *title, Ro
 
 cacheutils::CachingAddNLL::CachingAddNLL(const CachingAddNLL &other, const char *name) :
     RooAbsReal(name ? name : (TString("nll_")+other.pdf_->GetName()).Data(), ""),
+    context_(std::make_shared<NLLEvalContext>(*other.context_)),
     pdf_(other.pdf_),
     params_("params","parameters",this),
     catParams_("catParams","RooCategory parameters",this),
@@ -467,12 +507,17 @@ cacheutils::makeCachingPdf(RooAbsReal *pdf, const RooArgSet *obs) {
     static bool histfuncNll  = runtimedef::get("ADDNLL_HISTFUNCNLL");
     static bool cbNll  = runtimedef::get("ADDNLL_CBNLL");
     static bool hfNll  = runtimedef::get("ADDNLL_HFNLL");
+    static bool spinZeroNll  = runtimedef::get("ADDNLL_SPINZERONLL");
     static bool verb  = runtimedef::get("ADDNLL_VERBOSE_CACHING");
 
     if (histNll && typeid(*pdf) == typeid(FastVerticalInterpHistPdf)) {
         return new CachingHistPdf(pdf, obs);
     } else if (histNll && typeid(*pdf) == typeid(FastVerticalInterpHistPdf2)) {
         return new CachingHistPdf2(pdf, obs);
+    } else if (histNll && typeid(*pdf) == typeid(FastVerticalInterpHistPdf2D2)) {
+        return new CachingHistPdf2D2(pdf, obs);
+    } else if (histNll && typeid(*pdf) == typeid(FastVerticalInterpHistPdf3D)) {
+        return new CachingHistPdf3D(pdf, obs);
     } else if (gaussNll && typeid(*pdf) == typeid(RooGaussian)) {
         if (runtimedef::get("DBG_GAUSS")) {
             CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("Creating CachingGaussPdf for  %s",pdf->GetName())),__func__);
@@ -508,6 +553,16 @@ cacheutils::makeCachingPdf(RooAbsReal *pdf, const RooArgSet *obs) {
         return new CachingCMSHistErrorPropagator(pdf, obs);
     } else if (histfuncNll && typeid(*pdf) == typeid(CMSHistSum)) {
         return new CachingCMSHistSum(pdf, obs);
+    } else if (spinZeroNll && typeid(*pdf) == typeid(HZZ4L_RooSpinZeroPdf_1D_fast)) {
+        return makeCachingSpinZeroPdf<HZZ4L_RooSpinZeroPdf_1D_fast, CachingSpinZeroPdf1D>(pdf, obs, verb);
+    } else if (spinZeroNll && typeid(*pdf) == typeid(HZZ4L_RooSpinZeroPdf_2D_fast)) {
+        return makeCachingSpinZeroPdf<HZZ4L_RooSpinZeroPdf_2D_fast, CachingSpinZeroPdf2D>(pdf, obs, verb);
+    } else if (spinZeroNll && typeid(*pdf) == typeid(HZZ4L_RooSpinZeroPdf_phase_fast)) {
+        return makeCachingSpinZeroPdf<HZZ4L_RooSpinZeroPdf_phase_fast, CachingSpinZeroPdfPhase>(pdf, obs, verb);
+    } else if (spinZeroNll && typeid(*pdf) == typeid(VBFHZZ4L_RooSpinZeroPdf_fast)) {
+        return makeCachingSpinZeroPdf<VBFHZZ4L_RooSpinZeroPdf_fast, CachingVBFSpinZeroPdf>(pdf, obs, verb);
+    } else if (spinZeroNll && typeid(*pdf) == typeid(VVHZZ4L_RooSpinZeroPdf_1D_fast)) {
+        return makeCachingSpinZeroPdf<VVHZZ4L_RooSpinZeroPdf_1D_fast, CachingVVSpinZeroPdf1D>(pdf, obs, verb);
     } else {
         if (verb) {
             CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("I don't have an optimized implementation for %s (%s)",pdf->ClassName(),pdf->GetName())),__func__);
@@ -661,9 +716,9 @@ cacheutils::CachingAddNLL::evaluate() const
     // if all basic integrals evaluated ok, use them
     if (allBasicIntegralsOk) basicIntegrals_ = 2;
     // then get the final nll
-    static bool gentleNegativePenalty_ = runtimedef::get("GENTLE_LEE");
+    NLLEvalContext &context = *context_;
     double ret = constantZeroPoint_;
-    if (runtimedef::get("REMOVE_CONSTANT_ZERO_POINT") ) ret = 0; 
+    if (context.removeConstantZeroPoint) ret = 0;
     for (its = bgs; its != eds ; ++its) {
         if (!std::isnormal(*its) || *its <= 0) {
             if ((weights_[its-bgs] == 0) && (*its == 0)) {
@@ -675,21 +730,20 @@ cacheutils::CachingAddNLL::evaluate() const
                 // this is a special case we should in principle care, even if it does not alter the likelihood
                 // since it's multiplied by zero. However, normally RooFit ignores errors in zero-weight bins,
                 // so we comply to his policy (but we issue a warning, and we protect the logarithm)
-                static int nwarn = 0;
-                if (++nwarn < 100) {
+                if (++zeroEntryWarnings_ < 100) {
                     std::cout << "WARNING: underflow to " << *its << " in " << pdf_->GetName() << " for zero-entry bin " << its-bgs << std::endl;
                 }
                 *its = 1.0; // arbitrary number, to avoid bad logs
                 continue;
             }
-            if (gentleNegativePenalty_ && abs(weights_[its-bgs]) < 1e-2) {
+            if (context.gentleNegativePenalty && abs(weights_[its-bgs]) < 1e-2) {
                 std::cout << "WARNING: gentle underflow to " << *its << " in " << pdf_->GetName() << " for bin " << its-bgs << ", weight " << weights_[its-bgs] << std::endl; 
                 *its = 1.0; // skip the log
                 ret -= 25;  // add a penalty (negative since we flip 'ret' afterwards)
                 continue;
             }
             std::cout << "WARNING: underflow to " << *its << " in " << pdf_->GetName() << " for bin " << its-bgs << ", weight " << weights_[its-bgs] << std::endl; 
-            if (!CachingSimNLL::noDeepLEE_) logEvalError("Number of events is negative or error"); else CachingSimNLL::hasError_ = true;
+            if (!context.noDeepLEE) logEvalError("Number of events is negative or error"); else context.hasError = true;
             if (fastExit_) { std::cout << "FASTEXIT from " << pdf_->GetName() << std::endl; return 9e9; }
             else *its = 1;
         }
@@ -701,12 +755,11 @@ cacheutils::CachingAddNLL::evaluate() const
     ret -= vectorized::nll_reduce(partialSum_.size(), partialSum_.data(), weights_.data(), sumCoeff, workingArea_.data());
     // std::cout << "AddNLL for " << pdf_->GetName() << ": " << ret << std::endl;
     // and add extended term: expected - observed*log(expected);
-    static bool expEventsNoNorm = runtimedef::get("ADDNLL_ROOREALSUM_NONORM");
-    double expectedEvents = (isRooRealSum_ && !expEventsNoNorm ? pdf_->getNorm(data_->get()) : sumCoeff);
+    double expectedEvents = (isRooRealSum_ && !context.expEventsNoNorm ? pdf_->getNorm(data_->get()) : sumCoeff);
     if (expectedEvents <= 0) {
         //std::cout << "WARNING: underflow in total event yield for " << pdf_->GetName() << ", expected yield = " << expectedEvents << " (observed: " << sumWeights_ << ")" << std::endl;
-    	CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("underflow (expected events <=0) in total event yield for %s, expected yield = %g (observed: %g)",pdf_->GetName(), expectedEvents, sumWeights_)),__func__);
-        if (!CachingSimNLL::noDeepLEE_) logEvalError("Expected number of events is negative"); else CachingSimNLL::hasError_ = true;
+    	COMBINE_LOG("underflow (expected events <=0) in total event yield for %s, expected yield = %g (observed: %g)",pdf_->GetName(), expectedEvents, sumWeights_);
+        if (!context.noDeepLEE) logEvalError("Expected number of events is negative"); else context.hasError = true;
         expectedEvents = 1e-6;
     }
     // I can add any arbitrary constant that does not depend on the expected events,
@@ -863,7 +916,8 @@ cacheutils::CachingSimNLL::CachingSimNLL(RooSimultaneous *pdf, RooAbsData *data,
     dataOriginal_(data),
     nuis_(nuis),
     params_("params","parameters",this),
-    catParams_("catParams","Category parameters",this)
+    catParams_("catParams","Category parameters",this),
+    context_(std::make_shared<NLLEvalContext>())
 {
     setup_();
 }
@@ -877,8 +931,10 @@ cacheutils::CachingSimNLL::CachingSimNLL(const CachingSimNLL &other, const char
     catParams_("catParams","Category parameters",this),
     hideRooCategories_(other.hideRooCategories_),
     hideConstants_(other.hideConstants_),
+    context_(std::make_shared<NLLEvalContext>(*other.context_)),
     internalMasks_(other.internalMasks_),
     maskConstraints_(other.maskConstraints_),
+    maskChannels_(other.maskChannels_),
     maskingOffset_(other.maskingOffset_),
     maskingOffsetZero_(other.maskingOffsetZero_)
 {
@@ -913,9 +969,6 @@ cacheutils::CachingSimNLL::~CachingSimNLL()
 void
 cacheutils::CachingSimNLL::setup_() 
 {
-    // Allow runtime-flag to switch off logEvalErrors
-    noDeepLEE_ = runtimedef::get("SIMNLL_NO_LEE");
-
     //RooAbsPdf *pdfclone = runtimedef::get("SIMNLL_CLONE") ? pdfOriginal_  : utils::fullClonePdf(pdfOriginal_, piecesForCloning_);
     RooAbsPdf *pdfclone = pdfOriginal_; // never clone
 
@@ -924,9 +977,16 @@ cacheutils::CachingSimNLL::setup_()
     //std::unique_ptr<RooArgSet> params(pdfclone->getParameters(*dataOriginal_));
     //params_.add(*params);
     static bool verb  = runtimedef::get("ADDNLL_VERBOSE_CACHING");
+    static bool timing = runtimedef::get("SIMNLL_SETUP_TIMING");
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point since) { return std::chrono::duration<double>(Clock::now() - since).count(); };
+    Clock::time_point start = Clock::now(), stage = start;
+    double tFactorize, tConstraints, tSplit;
+    setupTiming_ = timing; setupStart_ = start;
 
     RooArgList constraints;
     factorizedPdf_.reset(dynamic_cast<RooSimultaneous *>(utils::factorizePdf(*dataOriginal_->get(), *pdfclone, constraints)));
+    tFactorize = seconds(stage); stage = Clock::now();
 
     RooSimultaneous *simpdf = factorizedPdf_.get();
     constrainPdfs_.clear(); 
@@ -939,11 +999,9 @@ cacheutils::CachingSimNLL::setup_()
             if (optimizeContraints_ && typeid(*pdfi) == typeid(SimpleGaussianConstraint)) {
                 constrainPdfsFast_.push_back(static_cast<SimpleGaussianConstraint *>(pdfi));
                 constrainPdfsFastOwned_.push_back(false);
-                constrainZeroPointsFast_.push_back(0);
             } else if (optimizeContraints_ && typeid(*pdfi) == typeid(SimplePoissonConstraint)) {
                 constrainPdfsFastPoisson_.push_back(static_cast<SimplePoissonConstraint *>(pdfi));
                 constrainPdfsFastPoissonOwned_.push_back(false);
-                constrainZeroPointsFastPoisson_.push_back(0);
             } else if (FastConstraints) {
                 if (typeid(*pdfi) == typeid(RooGaussian)) {
                      RooAbsPdf *opt = SimpleGaussianConstraint::make(static_cast<RooGaussian&>(*pdfi));
@@ -951,7 +1009,6 @@ cacheutils::CachingSimNLL::setup_()
                          if (verb) std::cout << "Constraint " << pdfi->GetName() << " optimized into " << opt->ClassName() << std::endl;
                          constrainPdfsFast_.push_back(static_cast<SimpleGaussianConstraint*>(opt));
                          constrainPdfsFastOwned_.push_back(true);
-                         constrainZeroPointsFast_.push_back(0);
                      } else {
                          constrainPdfs_.push_back(pdfi);
                          constrainZeroPoints_.push_back(0);
@@ -962,7 +1019,6 @@ cacheutils::CachingSimNLL::setup_()
                          if (verb) std::cout << "Constraint " << pdfi->GetName() << " optimized into " << opt->ClassName() << std::endl;
                          constrainPdfsFastPoisson_.push_back(static_cast<SimplePoissonConstraint*>(opt));
                          constrainPdfsFastPoissonOwned_.push_back(true);
-                         constrainZeroPointsFastPoisson_.push_back(0);
                      } else {
                          constrainPdfs_.push_back(pdfi);
                          constrainZeroPoints_.push_back(0);
@@ -1000,6 +1056,10 @@ cacheutils::CachingSimNLL::setup_()
                 std::cout << "ConstrainPdfGroup with " << cg.size() << " constraints." << std::endl;
             }
         }
+        if (constrainPdfGroups_.empty()) {
+            for (auto *gaus : constrainPdfsFast_) constrainBlockFast_.add(gaus);
+            for (auto *pois : constrainPdfsFastPoisson_) constrainBlockFast_.add(pois);
+        }
     } else {
         std::cerr << "PDF didn't factorize!" << std::endl;
         std::cout << "Parameters: " << std::endl;
@@ -1012,13 +1072,20 @@ cacheutils::CachingSimNLL::setup_()
     }
 
 
+    tConstraints = seconds(stage); stage = Clock::now();
+
     std::unique_ptr<RooAbsCategoryLValue> catClone((RooAbsCategoryLValue*) simpdf->indexCat().Clone());
     pdfs_.resize(catClone->numBins(NULL), 0);
     //dataSets_.reset(dataOriginal_->split(pdfOriginal_->indexCat(), true));
     datasets_.resize(pdfs_.size(), 0);
     splitWithWeights(*dataOriginal_, simpdf->indexCat(), true);
+    tSplit = seconds(stage); stage = Clock::now();
+    std::vector<std::pair<double, int> > channelTimes;
     //std::cout << "Pdf " << simpdf->GetName() <<" is a SimPdf over category " << catClone->GetName() << ", with " << pdfs_.size() << " bins" << std::endl;
     unsigned int nchannels = 0;
+    // The channels are built one after the other: the clone of each channel pdf is attached as a new client to
+    // the nuisances and shared functions of all the others, so building two at once would modify the same
+    // client lists (and the ProcessNormalizationEngine rows), and a forked child can't hand back the NLL it built.
     for (int ib = 0, nb = pdfs_.size(); ib < nb; ++ib) {
         catClone->setBin(ib);
         RooAbsPdf *pdf = simpdf->getPdf(catClone->getLabel());
@@ -1028,9 +1095,11 @@ cacheutils::CachingSimNLL::setup_()
             //std::cout << "   bin " << ib << " (label " << catClone->getLabel() << ") has pdf " << pdf->GetName() << " of type " << pdf->ClassName() << " and " << (data ? data->numEntries() : -1) << " dataset entries" << std::endl;
             if (data == 0) { throw std::logic_error("Error: no data"); }
             bool includeZeroWeights = (runtimedef::get("ADDNLL_ROOREALSUM_BASICINT") && runtimedef::get("ADDNLL_ROOREALSUM_KEEPZEROS") && (dynamic_cast<RooRealSumPdf*>(pdf)!=0));
-            pdfs_[ib] = new CachingAddNLL(catClone->getLabel(), "", pdf, data, includeZeroWeights);
+            Clock::time_point channelStart = Clock::now();
+            pdfs_[ib] = new CachingAddNLL(catClone->getLabel(), "", pdf, data, includeZeroWeights, context_);
             params_.add(pdfs_[ib]->params(), /*silent=*/true); 
             catParams_.add(pdfs_[ib]->catParams(), /*silent=*/true); 
+            if (timing) channelTimes.emplace_back(seconds(channelStart), ib);
             ++nchannels;
         } else { 
             pdfs_[ib] = 0; 
@@ -1044,6 +1113,16 @@ cacheutils::CachingSimNLL::setup_()
 	    "SimNLL created with %d channels, %d generic constraints, %d fast gaussian constraints, %d fast poisson constraints, %d fast group constraints.",
 	    (int)nchannels, (int)constrainPdfs_.size(),(int)constrainPdfsFast_.size(),(int)constrainPdfsFastPoisson_.size(),(int)constrainPdfGroups_.size())),__func__);
     }
+    if (timing) {
+        double tChannels = seconds(stage);
+        CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form(
+            "SimNLL setup took %.3f s: factorization %.3f s, %d constraints %.3f s, splitting the data %.3f s, %d channels %.3f s",
+            seconds(start), tFactorize, constraints.getSize(), tConstraints, tSplit, (int)nchannels, tChannels)),__func__);
+        std::sort(channelTimes.begin(), channelTimes.end(), std::greater<std::pair<double, int> >());
+        for (unsigned int i = 0; i < std::min<unsigned int>(5, channelTimes.size()); ++i) {
+            CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("   slowest channels: %s took %.3f s", pdfs_[channelTimes[i].second]->GetName(), channelTimes[i].first)),__func__);
+        }
+    }
     setValueDirty();
 }
 
@@ -1052,17 +1131,17 @@ cacheutils::CachingSimNLL::evaluate() const
 {
     // LAUNCH_FUNCTION_TIMER(__timer__, __token__)
     TRACE_POINT(params_)
+    ++evalCount_;
 #ifdef TRACE_NLL_EVAL_COUNT
     ::CachingSimNLLEvalCount++;
 #endif
 #ifdef DEBUG_CACHE
     PerfCounter::add("CachingSimNLL::evaluate called");
 #endif
-    static bool gentleNegativePenalty_ = runtimedef::get("GENTLE_LEE");
     DefaultAccumulator<double> ret = 0;
     unsigned idx = 0;
     for (std::vector<CachingAddNLL*>::const_iterator it = pdfs_.begin(), ed = pdfs_.end(); it != ed; ++it, ++idx) {
-        if (*it != 0) {
+        if (*it != 0 && !maskChannels_) {
             if (!channelMasks_.empty() && channelMasks_[idx]->getVal() != 0.) {
                 // std::cout << "Channel " << (*it)->GetName() << " will be masked as " 
                 //     << channelMasks_[idx]->GetName() << " evalutes to " 
@@ -1077,7 +1156,26 @@ cacheutils::CachingSimNLL::evaluate() const
             ret += nllval;
         }
     }
-    if (!maskConstraints_ && (!constrainPdfs_.empty() || !constrainPdfsFast_.empty() || !constrainPdfsFastPoisson_.empty() || !constrainPdfGroups_.empty())) {
+    if (!maskConstraints_) ret += constraintsNLL();
+    ret += (maskingOffset_ - maskingOffsetZero_);
+#ifdef TRACE_NLL_EVALS
+    static unsigned long _trace_ = 0; _trace_++;
+    if (_trace_ % 10 == 0)  { putchar('.'); fflush(stdout); }
+    //if (_trace_ % 250 == 0) { printf("               NLL % 10.4f after %10lu evals.\n", ret.sum(), _trace_); fflush(stdout); }
+#endif
+    TRACE_NLL("SimNLL for " << GetName() << ": " << ret.sum())
+    if (setupTiming_ && evalCount_ == 1) {
+        CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("SimNLL first evaluated %.3f s after the start of its setup",
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - setupStart_).count())),__func__);
+    }
+    return ret.sum();
+}
+
+double
+cacheutils::CachingSimNLL::constraintsNLL() const
+{
+    double ret = 0;
+    if (!constrainPdfs_.empty() || !constrainPdfsFast_.empty() || !constrainPdfsFastPoisson_.empty() || !constrainPdfGroups_.empty()) {
         DefaultAccumulator<double> ret2 = 0;
         /// ============= GENERIC CONSTRAINTS  =========
         std::vector<double>::const_iterator itz = constrainZeroPoints_.begin();
@@ -1085,9 +1183,10 @@ cacheutils::CachingSimNLL::evaluate() const
             double pdfval = (*it)->getVal(nuis_);
             if (!std::isnormal(pdfval) || pdfval <= 0) {
                 //std::cout << "WARNING: underflow constraint pdf " << (*it)->GetName() << ", value = " << pdfval << std::endl;
-    		    CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("underflow (pdf evaluates to <=0) of constraint pdf %s, value = %g ",(*it)->GetName(), pdfval)),__func__);
-                if (gentleNegativePenalty_) { ret += 25; continue; }
-                if (!noDeepLEE_) logEvalError((std::string("Constraint pdf ")+(*it)->GetName()+" evaluated to zero, negative or error").c_str());
+    		    COMBINE_LOG("underflow (pdf evaluates to <=0) of constraint pdf %s, value = %g ",(*it)->GetName(), pdfval);
+                if (context_->gentleNegativePenalty) { ret += 25; continue; }
+                if (!context_->noDeepLEE) logEvalError((std::string("Constraint pdf ")+(*it)->GetName()+" evaluated to zero, negative or error").c_str());
+                else context_->hasError = true;
                 pdfval = 1e-9;
             }
             ret2 += (log(pdfval) + *itz);
@@ -1097,31 +1196,12 @@ cacheutils::CachingSimNLL::evaluate() const
                 ret2 += g.getVal();
             }
         } else {
-            /// ============= FAST GAUSSIAN CONSTRAINTS  =========
-            itz = constrainZeroPointsFast_.begin();
-            for (std::vector<SimpleGaussianConstraint*>::const_iterator it = constrainPdfsFast_.begin(), ed = constrainPdfsFast_.end(); it != ed; ++it, ++itz) { 
-                double logpdfval = (*it)->getLogValFast();
-                //std::cout << "pdf " << (*it)->GetName() << " = " << logpdfval << std::endl;
-                ret2 += (logpdfval + *itz);
-            }
-            /// ============= FAST POISSON CONSTRAINTS  =========
-            itz = constrainZeroPointsFastPoisson_.begin();
-            for (std::vector<SimplePoissonConstraint*>::const_iterator it = constrainPdfsFastPoisson_.begin(), ed = constrainPdfsFastPoisson_.end(); it != ed; ++it, ++itz) { 
-                double logpdfval = (*it)->getLogValFast();
-                //std::cout << "pdf " << (*it)->GetName() << " = " << logpdfval << std::endl;
-                ret2 += (logpdfval + *itz);
-            }
+            /// ============= FAST GAUSSIAN AND POISSON CONSTRAINTS  =========
+            constrainBlockFast_.addTo(ret2);
         }
         ret -= ret2.sum();
     }
-    ret += (maskingOffset_ - maskingOffsetZero_);
-#ifdef TRACE_NLL_EVALS
-    static unsigned long _trace_ = 0; _trace_++;
-    if (_trace_ % 10 == 0)  { putchar('.'); fflush(stdout); }
-    //if (_trace_ % 250 == 0) { printf("               NLL % 10.4f after %10lu evals.\n", ret.sum(), _trace_); fflush(stdout); }
-#endif
-    TRACE_NLL("SimNLL for " << GetName() << ": " << ret.sum())
-    return ret.sum();
+    return ret;
 }
 
 void 
@@ -1135,7 +1215,14 @@ cacheutils::CachingSimNLL::setData(const RooAbsData &data)
     	throw  std::logic_error("Error: no category in dataset. You should try to recreate your datacard as a Fake shape datacard -- combineCards.py mycard.txt -S > myshapecard.txt OR rerun with option --forceRecreateNLL");
 	assert(0);
     }
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
     splitWithWeights(*dataOriginal_, pdfOriginal_->indexCat(), true);
+    double tSplit = std::chrono::duration<double>(Clock::now() - start).count();
+    // The channels read their data one after the other: reading an entry sets the observables of the channel,
+    // which its caching pdfs are attached to (attachDataSet), and the pdfs are then marked dirty, so two channels can't be filled
+    // at once. The reading is a single pass over the entries, so a forked child would spend as long writing them
+    // back as the parent spends reading them.
     for (int ib = 0, nb = pdfs_.size(); ib < nb; ++ib) {
         CachingAddNLL *canll = pdfs_[ib];
         if (canll == 0) continue;
@@ -1146,6 +1233,11 @@ cacheutils::CachingSimNLL::setData(const RooAbsData &data)
         //             " and " << (data ? data->numEntries() : -1) << " dataset entries (sumw " << data->sumEntries() << ", weighted " << data->isWeighted() << ")" << std::endl;
         canll->setData(*data);
     }
+    if (setupTiming_) {
+        double tTotal = std::chrono::duration<double>(Clock::now() - start).count();
+        CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("SimNLL setData took %.3f s: splitting the data %.3f s, %d channels %.3f s",
+            tTotal, tSplit, int(pdfs_.size()), tTotal - tSplit)),__func__);
+    }
 }
 
 void cacheutils::CachingSimNLL::splitWithWeights(const RooAbsData &data, const RooAbsCategory& splitCat, Bool_t createEmptyDataSets) {
@@ -1202,16 +1294,7 @@ void cacheutils::CachingSimNLL::setZeroPoint() {
         double pdfval = (*it)->getVal(nuis_);
         if (std::isnormal(pdfval) || pdfval > 0) *itz = -log(pdfval);
     }
-    itz = constrainZeroPointsFast_.begin();
-    for (std::vector<SimpleGaussianConstraint*>::const_iterator it = constrainPdfsFast_.begin(), ed = constrainPdfsFast_.end(); it != ed; ++it, ++itz) {
-        double logpdfval = (*it)->getLogValFast();
-        *itz = -logpdfval;
-    }
-    itz = constrainZeroPointsFastPoisson_.begin();
-    for (std::vector<SimplePoissonConstraint*>::const_iterator it = constrainPdfsFastPoisson_.begin(), ed = constrainPdfsFastPoisson_.end(); it != ed; ++it, ++itz) {
-        double logpdfval = (*it)->getLogValFast();
-        *itz = -logpdfval;
-    }
+    constrainBlockFast_.setZeroPoint();
     for (SimpleConstraintGroup & g : constrainPdfGroups_) {
         g.setZeroPoint();
     }
@@ -1224,8 +1307,7 @@ void cacheutils::CachingSimNLL::clearZeroPoint() {
         if (*it != 0) (*it)->clearZeroPoint();
     }
     std::fill(constrainZeroPoints_.begin(), constrainZeroPoints_.end(), 0.0);
-    std::fill(constrainZeroPointsFast_.begin(), constrainZeroPointsFast_.end(), 0.0);
-    std::fill(constrainZeroPointsFastPoisson_.begin(), constrainZeroPointsFastPoisson_.end(), 0.0);
+    constrainBlockFast_.clearZeroPoint();
     for (SimpleConstraintGroup & g : constrainPdfGroups_) g.clearZeroPoint();
     maskingOffsetZero_ = 0;
     setValueDirty();
@@ -1321,13 +1403,17 @@ void cacheutils::CachingSimNLL::setMaskConstraints(bool flag) {
     //            int(flag), nllBefore, nllAfter, (nllBefore-nllAfter), maskingOffset_, evaluate() - nllBefore);
 }
 
-void cacheutils::CachingSimNLL::setMaskNonDiscreteChannels(bool mask) {
+void cacheutils::CachingSimNLL::setMaskChannels(bool flag) {
     double nllBefore = evaluate();
-    internalMasks_.clear(); // reset
-    activeParameters_.removeAll(); 
-    activeCatParameters_.removeAll();
+    maskChannels_ = flag;
+    double nllAfter = evaluate();
+    maskingOffset_ += (nllBefore - nllAfter);
+}
+
+void cacheutils::CachingSimNLL::setMaskNonDiscreteChannels(bool mask) {
+    std::vector<bool> active;
     if (mask) {
-        internalMasks_.resize(pdfs_.size(), false);
+        active.resize(pdfs_.size(), false);
         unsigned int idx = 0;
         for (std::vector<CachingAddNLL*>::const_iterator it = pdfs_.begin(), ed = pdfs_.end(); it != ed; ++it, ++idx) {
             if ((*it) == 0) continue;
@@ -1335,19 +1421,30 @@ void cacheutils::CachingSimNLL::setMaskNonDiscreteChannels(bool mask) {
                 RooCategory *cat = dynamic_cast<RooCategory *>(P);
                 if (!cat) continue;
                 if (cat && !cat->isConstant()) {
-                    internalMasks_[idx] = true; 
-                    activeParameters_.add((*it)->params(), /*silent=*/true); 
-                    activeCatParameters_.add((*it)->catParams(), /*silent=*/true); 
+                    active[idx] = true; 
                     CombineLogger::instance().log("CachingNLL.cc",__LINE__,std::string(Form("Enabling channel %s that depends on non-constant category %s",(*it)->GetName(), cat->GetName())),__func__);
                     break;
                 }
             }
         }
     }
+    setActiveChannels(active);
+}
+
+void cacheutils::CachingSimNLL::setActiveChannels(const std::vector<bool> &active) {
+    if (!active.empty() && active.size() != pdfs_.size()) throw std::invalid_argument("CachingSimNLL::setActiveChannels: mask size does not match the number of channels");
+    double nllBefore = evaluate();
+    internalMasks_ = active;
+    activeParameters_.removeAll(); 
+    activeCatParameters_.removeAll();
+    for (unsigned int idx = 0, n = internalMasks_.size(); idx < n; ++idx) {
+        if (!internalMasks_[idx] || pdfs_[idx] == 0) continue;
+        activeParameters_.add(pdfs_[idx]->params(), /*silent=*/true); 
+        activeCatParameters_.add(pdfs_[idx]->catParams(), /*silent=*/true); 
+    }
     double nllAfter = evaluate();
     maskingOffset_ += (nllBefore - nllAfter);
-    //printf("CachingSimNLL: setMaskNonDiscreteChannels(%d): nll before %.12g, nll after %.12g (diff %.12g), new maskingOffset %.12g, check = %.12g\n",
-    //            int(mask), nllBefore, nllAfter, (nllBefore-nllAfter), maskingOffset_, evaluate() - nllBefore);
-    
+    //printf("CachingSimNLL: setActiveChannels: nll before %.12g, nll after %.12g (diff %.12g), new maskingOffset %.12g, check = %.12g\n",
+    //            nllBefore, nllAfter, (nllBefore-nllAfter), maskingOffset_, evaluate() - nllBefore);
 }
 
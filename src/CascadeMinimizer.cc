@@ -5,15 +5,22 @@
 #include "../interface/utils.h"
 #include "../interface/ProfilingTools.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/CachingNLL.h"
+#include "../interface/MinimizerTelemetry.h"
 
 #include <Math/MinimizerOptions.h>
 #include <Math/IOptions.h>
 #include <RooCategory.h>
 #include <RooNumIntConfig.h>
+#include <Fit/Fitter.h>
 #include <TStopwatch.h>
 #include <RooStats/RooStatsUtils.h>
 
 #include <iomanip>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
 
 boost::program_options::options_description CascadeMinimizer::options_("Cascade Minimizer options");
 std::vector<CascadeMinimizer::Algo> CascadeMinimizer::fallbacks_;
@@ -31,6 +38,8 @@ int  CascadeMinimizer::minuit2StorageLevel_ = 0;
 bool CascadeMinimizer::runShortCombinations = true;
 float CascadeMinimizer::nuisancePruningThreshold_ = 0;
 double CascadeMinimizer::discreteMinTol_ = 0.001;
+std::string CascadeMinimizer::telemetryFile_ = "";
+int CascadeMinimizer::blockCoordinate_ = 0;
 std::string CascadeMinimizer::defaultMinimizerType_="Minuit2"; // default to minuit2 (not always the default !?)
 std::string CascadeMinimizer::defaultMinimizerAlgo_="Migrad";
 double CascadeMinimizer::defaultMinimizerTolerance_=1e-1;  
@@ -91,6 +100,7 @@ void CascadeMinimizer::setAutoMax(const RooArgSet *pois)
 
 bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimizer) 
 {
+    MinimizerTelemetry::Call telemetry("improve", nll_);
     cacheutils::CachingSimNLL *simnllbb = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
     if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
       simnllbb->setAnalyticBarlowBeeston(true);
@@ -128,7 +138,7 @@ bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimiz
         int         nominalStrat(strategy_);
         if (verbose > 0) {
 		//std::cerr << "Failed minimization with " << nominalType << "," << nominalAlgo << " and tolerance " << nominalTol << std::endl;
-		CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Failed minimization with %s, %s and tolerance %g",nominalType.c_str(),nominalAlgo.c_str(),nominalTol)),__func__);
+		COMBINE_LOG("Failed minimization with %s, %s and tolerance %g",nominalType.c_str(),nominalAlgo.c_str(),nominalTol);
 	}
         for (std::vector<Algo>::const_iterator it = fallbacks_.begin(), ed = fallbacks_.end(); it != ed; ++it) {
             Significance::MinimizerSentry minimizerConfig(it->type + "," + it->algo, it->tolerance != Algo::default_tolerance() ? it->tolerance : nominalTol); // set the global defaults
@@ -139,12 +149,15 @@ bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimiz
                 myStrategy  != nominalStrat) {
                 if (verbose > 0) { 
 			//std::cerr << "Will fallback to minimization using " << it->algo << ", strategy " << myStrategy << " and tolerance " << it->tolerance << std::endl;
-			CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Will fall back to minimization using %s, strategy %d and tolerance %g",(it->algo).c_str(),myStrategy,it->tolerance)),__func__);
+			COMBINE_LOG("Will fall back to minimization using %s, strategy %d and tolerance %g",(it->algo).c_str(),myStrategy,it->tolerance);
 		}
                 minimizer_->setEps(ROOT::Math::MinimizerOptions::DefaultTolerance());
                 minimizer_->setStrategy(myStrategy); 
                 outcome = improveOnce(verbose-2);
-                if (outcome) break;
+                if (outcome) { 
+                    telemetry.setFallback(Form("%s,%s,%d:%g", it->type.c_str(), it->algo.c_str(), myStrategy, ROOT::Math::MinimizerOptions::DefaultTolerance()));
+                    break;
+                }
             }
         }
 	
@@ -154,6 +167,7 @@ bool CascadeMinimizer::improve(int verbose, bool cascade, bool forceResetMinimiz
     if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
       simnllbb->setAnalyticBarlowBeeston(false);
     }
+    telemetry.setResult(outcome);
     return outcome;
 }
 
@@ -180,6 +194,7 @@ bool CascadeMinimizer::improveOnce(int verbose, bool noHesse)
         if (optConst) minimizer_->optimizeConst(std::max(0,optConst));
         if (rooFitOffset) minimizer_->setOffsetting(std::max(0,rooFitOffset));
         outcome = nllutils::robustMinimize(nll_, *minimizer_, verbose, setZeroPoint_);
+        recordStage("robustMinimize", myStrategy, tol, outcome ? 0 : -1);
     } else {
         if (verbose+2>0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Minimization configured with Type=%s, Algo=%s, strategy=%d, tolerance=%g",myType.c_str(),myAlgo.c_str(),myStrategy,tol)),__func__);
         cacheutils::CachingSimNLL *simnll = setZeroPoint_ ? dynamic_cast<cacheutils::CachingSimNLL *>(&nll_) : 0;
@@ -188,15 +203,18 @@ bool CascadeMinimizer::improveOnce(int verbose, bool noHesse)
         if ((!simnll) && rooFitOffset) minimizer_->setOffsetting(std::max(0,rooFitOffset));
         if (firstHesse_ && !noHesse) {
             minimizer_->setPrintLevel(std::max(0,verbose-3)); 
-            minimizer_->hesse();
+            int hesseStatus = minimizer_->hesse();
+            recordStage("Hesse", myStrategy, tol, hesseStatus);
             if (simnll) simnll->updateZeroPoint(); 
             minimizer_->setPrintLevel(verbose-1); 
         }
         int status = minimizer_->minimize(myType.c_str(), myAlgo.c_str());
+        recordStage(myType+","+myAlgo, myStrategy, tol, status);
         if (lastHesse_ && !noHesse) {
             if (simnll) simnll->updateZeroPoint(); 
             minimizer_->setPrintLevel(std::max(0,verbose-3)); 
             status = minimizer_->hesse();
+            recordStage("Hesse", myStrategy, tol, status);
             minimizer_->setPrintLevel(verbose-1); 
     	    if (verbose+2>0 ) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Hesse finished with status=%d",status)),__func__);
         }
@@ -224,6 +242,7 @@ bool CascadeMinimizer::improveOnce(int verbose, bool noHesse)
 
 
 bool CascadeMinimizer::minos(const RooArgSet & params , int verbose ) {
+   MinimizerTelemetry::Call telemetry("minos", nll_);
    
    cacheutils::CachingSimNLL *simnllbb = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
    if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
@@ -254,8 +273,10 @@ bool CascadeMinimizer::minos(const RooArgSet & params , int verbose ) {
    // freeze parameters not active under current indexes if MINIMIZER_freezeDisassociatedParams enabled
    freezeDiscParams(true);
    // need to re-run Migrad before running minos
-   minimizer_->minimize(myType.c_str(), "Migrad");
+   int migradStatus = minimizer_->minimize(myType.c_str(), "Migrad");
+   recordStage(myType+",Migrad", ROOT::Math::MinimizerOptions::DefaultStrategy(), ROOT::Math::MinimizerOptions::DefaultTolerance(), migradStatus);
    int iret = minimizer_->minos(params); 
+   recordStage("Minos", ROOT::Math::MinimizerOptions::DefaultStrategy(), ROOT::Math::MinimizerOptions::DefaultTolerance(), iret);
    if (verbose>0 ) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Minos finished with status=%d",iret)),__func__);
    freezeDiscParams(false);
 
@@ -270,10 +291,12 @@ bool CascadeMinimizer::minos(const RooArgSet & params , int verbose ) {
      simnllbb->setAnalyticBarlowBeeston(false);
    }
 
+   telemetry.setResult(iret != 1);
    return (iret != 1) ? true : false; 
 }
 
 bool CascadeMinimizer::hesse(int verbose ) {
+   MinimizerTelemetry::Call telemetry("hesse", nll_);
    
    cacheutils::CachingSimNLL *simnllbb = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
    if (simnllbb && !runtimedef::get(std::string("MINIMIZER_no_analytic"))) {
@@ -298,6 +321,7 @@ bool CascadeMinimizer::hesse(int verbose ) {
 
    freezeDiscParams(true);
    int iret = minimizer_->hesse(); 
+   recordStage("Hesse", ROOT::Math::MinimizerOptions::DefaultStrategy(), ROOT::Math::MinimizerOptions::DefaultTolerance(), iret);
    freezeDiscParams(false);
 
    if (setZeroPoint_) {
@@ -305,6 +329,7 @@ bool CascadeMinimizer::hesse(int verbose ) {
       if (simnll) simnll->clearZeroPoint();
    }
 
+   telemetry.setResult(iret != 1);
    return (iret != 1) ? true : false; 
 }
 
@@ -372,6 +397,7 @@ bool CascadeMinimizer::iterativeMinimize(double &minimumNLL,int verbose, bool ca
 
 bool CascadeMinimizer::minimize(int verbose, bool cascade) 
 {
+    MinimizerTelemetry::Call telemetry("minimize", nll_);
     static int optConst = runtimedef::get("MINIMIZER_optimizeConst");
     static int rooFitOffset = runtimedef::get("MINIMIZER_rooFitOffset");
     if (runtimedef::get("CMIN_CENSURE")) {
@@ -404,7 +430,8 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
         if (simnll) simnll->setZeroPoint();
         if (optConst) minimizer_->optimizeConst(std::max(0,optConst));
         if (rooFitOffset) minimizer_->setOffsetting(std::max(0,rooFitOffset));
-        minimizer_->minimize(ROOT::Math::MinimizerOptions::DefaultMinimizerType().c_str(), ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo().c_str());
+        int preFitStatus = minimizer_->minimize(ROOT::Math::MinimizerOptions::DefaultMinimizerType().c_str(), ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo().c_str());
+        recordStage("preFit "+ROOT::Math::MinimizerOptions::DefaultMinimizerType()+","+ROOT::Math::MinimizerOptions::DefaultMinimizerAlgo(), preFit_-1, ROOT::Math::MinimizerOptions::DefaultTolerance(), preFitStatus);
         if (simnll) simnll->clearZeroPoint();
         utils::setAllConstant(frozen,false);
         freezeDiscParams(false);
@@ -417,7 +444,7 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
        	 trivialMinimize(nll_, *poi_, 200);
     	} 
 
-      ret = improve(verbose, cascade);
+      if (blockCoordinate_ <= 0 || !blockCoordinateMinimize(ret, verbose, cascade)) ret = improve(verbose, cascade);
 
     }else{
       // Do the discrete nuisance magic
@@ -429,7 +456,10 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
       (nllParams)->snapshot(reallyCleanParameters); // should remove also the nuisance parameters from here!
       // Before each step, reset the parameters back to their prefit state!
       
-      if (runShortCombinations) {
+      static bool factorized = runtimedef::get(std::string("MINIMIZER_multiMin_factorized"));
+      if (factorized && factorizedMinimize(ret, verbose, cascade)) {
+        // all done, indices were profiled within each independent block
+      } else if (runShortCombinations) {
         // Initial fit under current index values
         improve(verbose, cascade);
         double backupApproxPreFitTolerance = approxPreFitTolerance_;
@@ -479,9 +509,303 @@ bool CascadeMinimizer::minimize(int verbose, bool cascade)
       CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,"[WARNING] After fit, some parameters are found at the boundary (within ~1sigma)",__func__);
     }
     freezeDiscParams(false);
+    telemetry.setResult(ret);
     return ret;
 }
 
+bool CascadeMinimizer::findIndependentBlocks(std::vector<DiscreteBlock> &blocks) const {
+    blocks.clear();
+    cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
+    if (!simnll) return false;
+    const std::vector<cacheutils::CachingAddNLL*> & channels = simnll->channelNLLs();
+    const RooArgList & pois = CascadeMinimizerGlobalConfigs::O().parametersOfInterest;
+    const RooArgList & pdfCategories = CascadeMinimizerGlobalConfigs::O().pdfCategories;
+
+    // union-find over the channels: two channels end up in the same block if they
+    // depend on a common floating parameter or category (the POIs don't count)
+    std::vector<unsigned int> parent(channels.size());
+    std::iota(parent.begin(), parent.end(), 0);
+    auto root = [&parent](unsigned int i) { 
+        while (parent[i] != i) { parent[i] = parent[parent[i]]; i = parent[i]; } 
+        return i; 
+    };
+    std::map<std::string, unsigned int> owner;
+    auto claim = [&owner,&parent,&root](const RooAbsArg *a, unsigned int ic) {
+        auto it = owner.find(a->GetName());
+        if (it == owner.end()) owner.emplace(a->GetName(), ic);
+        else parent[root(it->second)] = root(ic);
+    };
+    for (unsigned int ic = 0, nc = channels.size(); ic < nc; ++ic) {
+        if (channels[ic] == 0) continue;
+        for (RooAbsArg *a : channels[ic]->params()) {
+            if (a->isConstant() || pois.find(*a)) continue;
+            claim(a, ic);
+        }
+        for (RooAbsArg *a : channels[ic]->catParams()) {
+            if (a->isConstant()) continue;
+            claim(a, ic);
+        }
+    }
+    // generic constraint terms (e.g. multivariate gaussians) can correlate nuisances of different channels
+    for (RooAbsPdf *pdf : simnll->genericConstraints()) {
+        std::unique_ptr<RooArgSet> cpars(pdf->getParameters((const RooArgSet*)0));
+        int first = -1;
+        for (RooAbsArg *a : *cpars) {
+            if (a->isConstant()) continue;
+            auto it = owner.find(a->GetName());
+            if (it == owner.end()) continue;
+            if (first == -1) first = it->second;
+            else parent[root(it->second)] = root(first);
+        }
+    }
+
+    std::set<unsigned int> roots;
+    for (unsigned int ic = 0, nc = channels.size(); ic < nc; ++ic) {
+        if (channels[ic] != 0) roots.insert(root(ic));
+    }
+    if (roots.size() < 2) return false;
+
+    std::map<unsigned int, unsigned int> blockOfRoot;
+    for (int id = 0, n = pdfCategories.getSize(); id < n; ++id) {
+        const RooAbsArg *cat = pdfCategories.at(id);
+        if (cat->isConstant()) continue;
+        auto it = owner.find(cat->GetName());
+        if (it == owner.end()) continue;
+        unsigned int r = root(it->second);
+        auto ib = blockOfRoot.find(r);
+        if (ib == blockOfRoot.end()) {
+            ib = blockOfRoot.emplace(r, blocks.size()).first;
+            blocks.emplace_back();
+            DiscreteBlock &block = blocks.back();
+            block.channels.resize(channels.size(), false);
+            for (unsigned int ic = 0, nc = channels.size(); ic < nc; ++ic) {
+                if (channels[ic] == 0 || root(ic) != r) continue;
+                block.channels[ic] = true;
+                for (RooAbsArg *a : channels[ic]->params()) {
+                    if (a->isConstant() || pois.find(*a)) continue;
+                    block.params.add(*a, /*silent=*/true);
+                }
+            }
+        }
+        blocks[ib->second].categories.push_back(id);
+    }
+    return true;
+}
+
+bool CascadeMinimizer::profileIndependentBlocks(std::vector<DiscreteBlock> &blocks, int verbose, bool cascade) {
+    static bool freezeDisassParams = runtimedef::get(std::string("MINIMIZER_freezeDisassociatedParams"));
+    cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
+    const RooArgList & pdfCategories = CascadeMinimizerGlobalConfigs::O().pdfCategories;
+
+    // as in multipleMinimize, no need to toggle the barlow-beeston minimisation for each index
+    int currentNoBarlowBeeston = runtimedef::get(std::string("MINIMIZER_no_analytic"));
+    runtimedef::set("MINIMIZER_no_analytic", 1);
+    double backupStrategy = ROOT::Math::MinimizerOptions::DefaultStrategy();
+    ROOT::Math::MinimizerOptions::SetDefaultStrategy(0);
+
+    // everything floating that is not part of the block being profiled (POIs included) is frozen
+    std::unique_ptr<RooArgSet> allParams(nll_.getParameters((const RooArgSet *)0));
+    allParams->remove(pdfCategories);
+    RooStats::RemoveConstantParameters(&*allParams);
+
+    bool newDiscreteMinimum = false;
+    TStopwatch tw; tw.Start();
+    int fitCounter = 0;
+    for (DiscreteBlock &block : blocks) {
+        RooArgSet frozen(*allParams);
+        frozen.remove(block.params, /*silent=*/true, /*matchByNameOnly=*/true);
+        utils::setAllConstant(frozen, true);
+        simnll->setActiveChannels(block.channels);
+        simnll->setHideConstants(true);
+        minimizer_.reset(); // will be recreated when needed by whoever needs it
+
+        std::vector<int> pdfSizes, startIndeces, bestIndeces;
+        for (int id : block.categories) {
+            RooCategory *cat = (RooCategory*)(pdfCategories.at(id));
+            pdfSizes.push_back(cat->numTypes());
+            startIndeces.push_back(cat->getIndex());
+        }
+        bestIndeces = startIndeces;
+        std::vector<std::vector<int> > myCombos = utils::generateCombinations(pdfSizes);
+        utils::reorderCombinations(myCombos, pdfSizes, startIndeces);
+
+        RooArgSet clean, best;
+        block.params.snapshot(clean);
+        block.params.snapshot(best);
+        double minimumNLL = std::numeric_limits<double>::infinity();
+        for (unsigned int ic = 0, nc = myCombos.size(); ic < nc; ++ic) {
+            const std::vector<int> &combo = myCombos[ic];
+            for (unsigned int i = 0, n = combo.size(); i < n; ++i) {
+                ((RooCategory*)(pdfCategories.at(block.categories[i])))->setIndex(combo[i]);
+            }
+            if (ic > 0) block.params.assignValueOnly(clean);
+
+            freezeDiscParams(true);
+            improve(verbose, cascade, freezeDisassParams);
+            freezeDiscParams(false);
+            ++fitCounter;
+
+            double thisNllValue = nll_.getVal();
+            if (verbose > 2) {
+                std::cout << "Block with " << block.categories.size() << " indices, setting indices := ";
+                for (int idx : combo) std::cout << idx << " ";
+                std::cout << " --> NLL = " << thisNllValue << std::endl;
+            }
+            if (thisNllValue < minimumNLL) {
+                minimumNLL = thisNllValue;
+                best.assignValueOnly(block.params);
+                bestIndeces = combo;
+            }
+        }
+
+        for (unsigned int i = 0, n = bestIndeces.size(); i < n; ++i) {
+            ((RooCategory*)(pdfCategories.at(block.categories[i])))->setIndex(bestIndeces[i]);
+        }
+        if (bestIndeces != startIndeces) newDiscreteMinimum = true;
+        block.params.assignValueOnly(best);
+
+        simnll->setActiveChannels(std::vector<bool>());
+        simnll->setHideConstants(false);
+        utils::setAllConstant(frozen, false);
+        minimizer_.reset();
+    }
+
+    runtimedef::set("MINIMIZER_no_analytic", currentNoBarlowBeeston);
+    ROOT::Math::MinimizerOptions::SetDefaultStrategy(backupStrategy);
+
+    tw.Stop(); if (verbose > 2) std::cout << "Profiled " << blocks.size() << " independent blocks with " << fitCounter << " fits in " << tw.RealTime() << " s. New discrete minimum? " << newDiscreteMinimum << std::endl;
+    return newDiscreteMinimum;
+}
+
+bool CascadeMinimizer::factorizedMinimize(bool &ret, int verbose, bool cascade) {
+    std::vector<DiscreteBlock> blocks;
+    if (!findIndependentBlocks(blocks)) {
+        if (verbose > 0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,"The model does not factorise in independent blocks, will use the standard discrete profiling",__func__);
+        return false;
+    }
+    if (verbose > 0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Discrete indices will be profiled within %d independent blocks",int(blocks.size()))),__func__);
+
+    // Initial fit under current index values, to get the POIs at which the blocks are profiled
+    ret = improve(verbose, cascade);
+    int maxIterations = 15;
+    for (int iterationCounter = 0; iterationCounter < maxIterations; ++iterationCounter) {
+        bool changed = profileIndependentBlocks(blocks, verbose, cascade);
+        // One fully floating fit with the new indices
+        ret = improve(verbose, cascade, true);
+        if (!changed) break;
+    }
+    return true;
+}
+
+bool CascadeMinimizer::findLocalBlocks(std::vector<DiscreteBlock> &blocks, RooArgSet &global) const {
+    blocks.clear();
+    cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
+    if (!simnll) return false;
+    const std::vector<cacheutils::CachingAddNLL*> & channels = simnll->channelNLLs();
+    const RooArgList & pois = CascadeMinimizerGlobalConfigs::O().parametersOfInterest;
+
+    // channel using each floating parameter, -1 if used by more than one
+    std::map<std::string, int> owner;
+    for (int ic = 0, nc = channels.size(); ic < nc; ++ic) {
+        if (channels[ic] == 0) continue;
+        for (RooAbsArg *a : channels[ic]->params()) {
+            if (a->isConstant()) continue;
+            auto it = owner.find(a->GetName());
+            if (it == owner.end()) owner.emplace(a->GetName(), ic);
+            else if (it->second != ic) it->second = -1;
+        }
+    }
+    // generic constraint terms correlating parameters of different channels make them all global
+    for (RooAbsPdf *pdf : simnll->genericConstraints()) {
+        std::unique_ptr<RooArgSet> cpars(pdf->getParameters((const RooArgSet*)0));
+        std::set<int> owners;
+        for (RooAbsArg *a : *cpars) {
+            auto it = owner.find(a->GetName());
+            if (it != owner.end()) owners.insert(it->second);
+        }
+        if (owners.size() < 2) continue;
+        for (RooAbsArg *a : *cpars) {
+            auto it = owner.find(a->GetName());
+            if (it != owner.end()) it->second = -1;
+        }
+    }
+
+    std::unique_ptr<RooArgSet> allParams(nll_.getParameters((const RooArgSet *)0));
+    allParams->remove(CascadeMinimizerGlobalConfigs::O().pdfCategories);
+    RooStats::RemoveConstantParameters(&*allParams);
+    std::map<int, unsigned int> blockOfChannel;
+    for (RooAbsArg *a : *allParams) {
+        auto it = owner.find(a->GetName());
+        if (it == owner.end() || it->second < 0 || pois.find(*a)) { 
+            global.add(*a); 
+            continue; 
+        }
+        auto ib = blockOfChannel.find(it->second);
+        if (ib == blockOfChannel.end()) {
+            ib = blockOfChannel.emplace(it->second, blocks.size()).first;
+            blocks.emplace_back();
+            blocks.back().channels.resize(channels.size(), false);
+            blocks.back().channels[it->second] = true;
+        }
+        blocks[ib->second].params.add(*a);
+    }
+    return !blocks.empty();
+}
+
+bool CascadeMinimizer::blockCoordinateMinimize(bool &ret, int verbose, bool cascade) {
+    std::vector<DiscreteBlock> blocks; RooArgSet global;
+    if (!findLocalBlocks(blocks, global)) {
+        if (verbose > 0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,"No parameter enters a single channel, will not use the block-coordinate minimization",__func__);
+        return false;
+    }
+    cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nll_);
+    RooArgSet local;
+    for (const DiscreteBlock &block : blocks) local.add(block.params);
+    if (verbose > 0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Block-coordinate minimization with %d channel-local blocks (%d parameters) and %d global parameters",int(blocks.size()),local.getSize(),global.getSize())),__func__);
+
+    // the partial fits only need to get close to the minimum, the final full fit takes care of the rest
+    double backupStrategy = ROOT::Math::MinimizerOptions::DefaultStrategy();
+    ROOT::Math::MinimizerOptions::SetDefaultStrategy(0);
+    TStopwatch tw; tw.Start();
+    double previousNLL = nll_.getVal();
+    int rounds = 0;
+    while (rounds < blockCoordinate_) {
+        ++rounds;
+        // 1) the parameters entering several channels, with the channel-local ones frozen
+        if (global.getSize() > 0) {
+            utils::setAllConstant(local, true);
+            minimizer_.reset();
+            improve(verbose, false);
+            utils::setAllConstant(local, false);
+        }
+        // 2) each channel-local block with everything else frozen, evaluating only that channel
+        for (const DiscreteBlock &block : blocks) {
+            RooArgSet frozen(global);
+            frozen.add(local);
+            frozen.remove(block.params);
+            utils::setAllConstant(frozen, true);
+            simnll->setActiveChannels(block.channels);
+            simnll->setHideConstants(true);
+            minimizer_.reset();
+            improve(verbose, false);
+            simnll->setActiveChannels(std::vector<bool>());
+            simnll->setHideConstants(false);
+            utils::setAllConstant(frozen, false);
+        }
+        double thisNLL = nll_.getVal();
+        if (verbose > 1) COMBINE_LOG("Block-coordinate round %d: NLL change %g",rounds,thisNLL-previousNLL);
+        if (fabs(previousNLL - thisNLL) < discreteMinTol_) break;
+        previousNLL = thisNLL;
+    }
+    ROOT::Math::MinimizerOptions::SetDefaultStrategy(backupStrategy);
+
+    // final fit of all the parameters together, starting next to the minimum, to have consistent results and errors
+    ret = improve(verbose, cascade, true);
+    tw.Stop(); 
+    if (verbose > 0) CombineLogger::instance().log("CascadeMinimizer.cc",__LINE__,std::string(Form("Block-coordinate minimization: %d rounds and final fit done in %.2f s",rounds,tw.RealTime())),__func__);
+    return true;
+}
+
 bool CascadeMinimizer::multipleMinimize(const RooArgSet &reallyCleanParameters, bool& ret, double& minimumNLL, int verbose, bool cascade,int mode, std::vector<std::vector<bool> >&contributingIndeces){
     static bool freezeDisassParams = runtimedef::get(std::string("MINIMIZER_freezeDisassociatedParams"));
     static bool hideConstants = freezeDisassParams && runtimedef::get(std::string("MINIMIZER_multiMin_hideConstants"));
@@ -704,6 +1028,15 @@ bool CascadeMinimizer::multipleMinimize(const RooArgSet &reallyCleanParameters,
     return newDiscreteMinimum;
 }
 
+void CascadeMinimizer::recordStage(const std::string &name, int strategy, double tolerance, int status)
+{
+    MinimizerTelemetry::Call *call = MinimizerTelemetry::Call::current();
+    if (call == nullptr) return;
+    // the edm of the last run, as kept by the fitter: no fit result is saved for it
+    const ROOT::Fit::Fitter *fitter = minimizer_->fitter();
+    call->stage(name, strategy, tolerance, status, fitter ? fitter->Result().Edm() : std::numeric_limits<double>::quiet_NaN());
+}
+
 void CascadeMinimizer::initOptions() 
 {
     options_.add_options()
@@ -726,6 +1059,8 @@ void CascadeMinimizer::initOptions()
         ("cminRunAllDiscreteCombinations",  "Run all combinations for discrete nuisances")
         ("cminDiscreteMinTol", boost::program_options::value<double>(&discreteMinTol_)->default_value(discreteMinTol_), "Tolerance on min NLL for discrete combination iterations")
         ("cminM2StorageLevel", boost::program_options::value<int>(&minuit2StorageLevel_)->default_value(minuit2StorageLevel_), "Storage level for minuit2 (0 = don't store intermediate covariances, 1 = store them)")
+        ("cminBlockCoordinate", boost::program_options::value<int>(&blockCoordinate_)->default_value(blockCoordinate_), "If N > 0, before the full fit do up to N rounds of alternating fits of the parameters entering several channels and of the parameters of each single channel (evaluating only that channel). Rounds stop when the NLL changes by less than --cminDiscreteMinTol")
+        ("cminTelemetry", boost::program_options::value<std::string>(&telemetryFile_)->default_value(telemetryFile_), "Write a record of each minimize/improve/minos/hesse call (minimizer runs, fallbacks, status, edm, time and NLL evaluations) to this file, as one JSON object per line")
         //("cminNuisancePruning", boost::program_options::value<float>(&nuisancePruningThreshold_)->default_value(nuisancePruningThreshold_), "if non-zero, discard constrained nuisances whose effect on the NLL when changing by 0.2*range is less than the absolute value of the threshold; if threshold is negative, repeat afterwards the fit with these floating")
 
         //("cminDefaultIntegratorEpsAbs", boost::program_options::value<double>(), "RooAbsReal::defaultIntegratorConfig()->setEpsAbs(x)")
@@ -761,6 +1096,7 @@ void CascadeMinimizer::applyOptions(const boost::program_options::variables_map
     singleNuisFit_ = vm.count("cminSingleNuisFit");
     setZeroPoint_  = vm.count("cminSetZeroPoint");
     runShortCombinations = !(vm.count("cminRunAllDiscreteCombinations"));
+    if (!telemetryFile_.empty()) MinimizerTelemetry::instance().open(telemetryFile_);
 
     // check default minimizer type/algo if they are set and make sense
     if (vm.count("cminDefaultMinimizerAlgo")){
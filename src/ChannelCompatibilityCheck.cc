@@ -144,8 +144,8 @@ bool ChannelCompatibilityCheck::runSpecific(RooWorkspace *w, RooStats::ModelConf
   std::cout << "Chi2-like compatibility variable: " << limit << std::endl;
 
   if (saveFitResult_) {
-      writeToysHere->GetFile()->WriteTObject(result_nominal.release(),  "fit_nominal"  );
-      writeToysHere->GetFile()->WriteTObject(result_freeform.release(), "fit_alternate");
+      Combine::writeOutput(writeToysHere->GetFile(), result_nominal.release(),  "fit_nominal"  );
+      Combine::writeOutput(writeToysHere->GetFile(), result_freeform.release(), "fit_alternate");
   }
   return true;
 }
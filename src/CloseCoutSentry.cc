@@ -1,11 +1,58 @@
 #include "../interface/CloseCoutSentry.h"
+#include "../interface/ProfilingTools.h"
 
 #include <cstdio>
 #include <cassert>
 #include <unistd.h>
 
+#include <iostream>
+#include <mutex>
+#include <streambuf>
 #include <stdexcept>
 #include <fcntl.h>
+#include <TError.h>
+
+namespace {
+    // whether the output of this thread is silenced (when not using the file descriptors)
+    thread_local bool threadSilenced_ = false;
+
+    // forwards to the original buffer of the stream, unless the thread writing is silenced.
+    // It has no buffer of its own, so that what each thread writes is routed separately
+    class SilenceableStreamBuf : public std::streambuf {
+        public:
+            SilenceableStreamBuf(std::streambuf *target) : target_(target) {}
+        protected:
+            int overflow(int c) override {
+                if (threadSilenced_ || traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+                return target_->sputc(traits_type::to_char_type(c));
+            }
+            std::streamsize xsputn(const char *s, std::streamsize n) override {
+                return threadSilenced_ ? n : target_->sputn(s, n);
+            }
+            int sync() override {
+                return threadSilenced_ ? 0 : target_->pubsync();
+            }
+        private:
+            std::streambuf *target_;
+    };
+
+    ErrorHandlerFunc_t previousErrorHandler_ = nullptr;
+    void silenceableErrorHandler(int level, Bool_t abort, const char *location, const char *msg) {
+        if (threadSilenced_ && level < kFatal) return;
+        previousErrorHandler_(level, abort, location, msg);
+    }
+
+    void installSilenceableStreams() {
+        static std::once_flag once;
+        std::call_once(once, [] {
+            std::cout.rdbuf(new SilenceableStreamBuf(std::cout.rdbuf()));
+            std::cerr.rdbuf(new SilenceableStreamBuf(std::cerr.rdbuf()));
+            std::clog.rdbuf(new SilenceableStreamBuf(std::clog.rdbuf()));
+            previousErrorHandler_ = SetErrorHandler(&silenceableErrorHandler);
+            if (previousErrorHandler_ == nullptr) previousErrorHandler_ = &DefaultErrorHandler;
+        });
+    }
+}
 
 bool CloseCoutSentry::open_ = true;
 int  CloseCoutSentry::fdOut_ = 0;
@@ -16,10 +63,22 @@ FILE * CloseCoutSentry::trueStdOut_ = 0;
 CloseCoutSentry *CloseCoutSentry::owner_ = 0;
 
 
+bool CloseCoutSentry::useFileDescriptors()
+{
+    // decided once: the two modes can't be mixed
+    static const bool fd = !runtimedef::get("CLOSECOUT_THREAD");
+    return fd;
+}
+
 CloseCoutSentry::CloseCoutSentry(bool silent) :
-    silent_(silent)
+    silent_(silent),
+    fd_(useFileDescriptors())
 {
-    if (silent_) {
+    if (silent_ && !fd_) {
+        installSilenceableStreams();
+        if (threadSilenced_) silent_ = false;
+        else threadSilenced_ = true;
+    } else if (silent_) {
         if (open_) {
             open_ = false;
             if (fdOut_ == 0 && fdErr_ == 0) {
@@ -49,7 +108,8 @@ void CloseCoutSentry::clear()
         fclose(trueStdOut_); trueStdOut_ = 0; stdOutIsMine_ = false;
     }
     if (silent_) {
-        reallyClear();
+        if (fd_) reallyClear();
+        else threadSilenced_ = false;
         silent_ = false;
     }
 }
@@ -67,7 +127,8 @@ void CloseCoutSentry::reallyClear()
 
 void CloseCoutSentry::breakFree() 
 {
-    reallyClear();
+    if (useFileDescriptors()) reallyClear();
+    else threadSilenced_ = false;
 }
 
 FILE *CloseCoutSentry::trueStdOutGlobal()
@@ -25,6 +25,8 @@
 #include <TSystem.h>
 #include <TStopwatch.h>
 #include <TTree.h>
+#include <TBranch.h>
+#include <TROOT.h>
 #include <TInterpreter.h>
 
 #include <RooAbsData.h>
@@ -64,6 +66,9 @@
 #include "../interface/CMSHistSum.h"
 
 #include "../interface/CombineLogger.h"
+#include "../interface/TemplatePool.h"
+#include "../interface/AsyncOutputWriter.h"
+#include "../interface/ForkedJobs.h"
 
 using namespace RooStats;
 using namespace RooFit;
@@ -86,6 +91,7 @@ float cl = 0.95;
 bool bypassFrequentistFit_ = false;
 bool g_fillTree_ = true;
 TTree *Combine::tree_ = 0;
+std::unique_ptr<AsyncOutputWriter> Combine::asyncOutput_;
 
 std::string setPhysicsModelParameterExpression_ = "";
 std::string setPhysicsModelParameterRangeExpression_ = "";
@@ -125,6 +131,7 @@ Combine::Combine() :
       ("hintStatOnly", "Ignore systematics when computing the hint")
       ("toysNoSystematics", "Generate all toys with the central value of the nuisance parameters, without fluctuating them")
       ("toysFrequentist",   "Generate all toys in the frequentist way. Note that this affects the toys generated by option '-t' that happen in the main loop, not the ones within the Hybrid(New) algorithm.")
+      ("toysFork", po::value<unsigned int>(&toysFork_)->default_value(0), "Split the toys of option '-t' among N forked processes (0 = run them one after the other, the default). Only for the methods that just fill the output tree for each toy (e.g. GoodnessOfFit without --plots), and not with --saveToys")
       ("expectSignal", po::value<float>(&expectSignal_)->default_value(0.), "If set to non-zero, generate *signal* toys instead of background ones, with the specified signal strength.")
       ("expectSignalMass", po::value<float>(&expectSignalMass_)->default_value(-99.), "If set to non-zero, generate *signal* toys instead of background ones, with the specified mass.")            
       ("unbinned,U", "Generate unbinned datasets instead of binned ones (works only for extended pdfs)")
@@ -150,6 +157,10 @@ Combine::Combine() :
 
       ("validateModel,V", "Perform some sanity checks on the model and abort if they fail.")
       ("saveToys",   "Save results of toy MC in output file")
+      ("asyncOutput", po::value<unsigned int>(&asyncOutputQueue_)->default_value(0), "Fill the output tree and write the toys from a background thread, with up to N entries waiting in the queue (0 = write them directly, the default)")
+      ("logFormat", po::value<std::string>()->default_value("text"), "Format of the log file (combine_logger.out): 'text' or 'json' (one JSON object per line)")
+      ("logMaxPerSite", po::value<unsigned int>()->default_value(CombineLogger::maxPerSite()), "Max number of messages written in the log by each place in the code that logs repeatedly, e.g. underflows in the likelihood (0 = no limit)")
+      ("outputCompression", po::value<int>(&outputCompression_)->default_value(-1), "Compression settings of the output file, as 100*algorithm + level (e.g. 505 for ZSTD level 5; -1 = ROOT default)")
       ("floatAllNuisances", po::value<bool>(&floatAllNuisances_)->default_value(false), "Make all nuisance parameters floating")
       ("floatParameters", po::value<string>(&floatNuisances_)->default_value(""), "Set these parameters floating(note freeze will take priority over float), also accepts regexp with syntax 'rgx{<my regexp>}' or 'var{<my regexp>}'")
       ("freezeAllGlobalObs", po::value<bool>(&freezeAllGlobalObs_)->default_value(true), "Make all global observables constant")
@@ -199,6 +210,11 @@ void Combine::applyOptions(const boost::program_options::variables_map &vm) {
   overrideSnapshotMass_ = vm.count("overrideSnapshotMass");
   mass_ = vm["mass"].as<float>();
   saveToys_ = vm.count("saveToys");
+  if (asyncOutputQueue_) ROOT::EnableThreadSafety(); // before any other thread is started
+  const std::string &logFormat = vm["logFormat"].as<std::string>();
+  if (logFormat != "text" && logFormat != "json") throw std::invalid_argument("Unknown --logFormat '"+logFormat+"', must be 'text' or 'json'");
+  CombineLogger::instance().setJSON(logFormat == "json");
+  CombineLogger::setMaxPerSite(vm["logMaxPerSite"].as<unsigned int>());
   validateModel_ = vm.count("validateModel");
   const std::string &method = vm["method"].as<std::string>();
   if (!(vm["expectSignal"].defaulted())) expectSignalSet_=true;
@@ -397,6 +413,7 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
     }
 
 
+    if (verbose > 0 && TemplatePool::instance().requested()) TemplatePool::instance().report(std::cout);
     if (verbose > 3) { std::cout << "Input workspace '" << workspaceName_ << "': \n"; w->Print("V"); }
     RooRealVar *MH = w->var("MH");
     if (MH!=0) {
@@ -805,6 +822,26 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
   addPOI(POI);
 
   tree_ = tree;
+  if (outputCompression_ >= 0 && outputFile) {
+      // the branches made so far took the settings of the file when they were created
+      if (outputFile->GetFile()) outputFile->GetFile()->SetCompressionSettings(outputCompression_);
+      for (TObject *b : *tree_->GetListOfBranches()) static_cast<TBranch *>(b)->SetCompressionSettings(outputCompression_);
+  }
+  // the writer must be done before the caller writes the tree
+  struct AsyncOutputSentry {
+      ~AsyncOutputSentry() {
+          if (!asyncOutput_) return;
+          std::unique_ptr<AsyncOutputWriter> writer(asyncOutput_.release());
+          double blocked = writer->blockedTime();
+          unsigned long rows = writer->rows(), objects = writer->objects();
+          writer.reset();
+          if (verbose > 0) {
+              std::cout << "Output: " << rows << " entries and " << objects << " objects written in the background, " << blocked << " s spent waiting for the writer" << std::endl;
+              CombineLogger::instance().log("Combine.cc",__LINE__,std::string(Form("Output: %lu entries and %lu objects written in the background, %.3f s spent waiting for the writer", rows, objects, blocked)),__func__);
+          }
+      }
+  } asyncOutputSentry;
+  if (asyncOutputQueue_) asyncOutput_.reset(new AsyncOutputWriter(tree_, asyncOutputQueue_));
 
   // Set up additional branches
   addBranches(trackParametersNameString_,w,trackedParametersMap_,"Param");
@@ -888,6 +925,10 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
     CMSHistFunc::EnableFastVertical();
     CMSHistSum::EnableFastVertical();
   }
+  if (runtimedef::get("FLOAT_TEMPLATE_STORAGE")) {
+    CMSHistFunc::EnableFloatStorage();
+    CMSHistSum::EnableFloatStorage();
+  }
 
   // Warn the user that they might be using funky values of POIs 
   if (nToys!=0 && !expectSignalSet_ && setPhysicsModelParameterExpression_ == "" && !(POI->getSize()==1 && POI->find("r"))) {
@@ -968,10 +1009,10 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
       return;
     }
     if (saveToys_) {
-	writeToysHere->WriteTObject(dobs, "toy_asimov");
+	writeOutput(writeToysHere, dobs->Clone(), "toy_asimov");
         if (toysFrequentist_ && mc->GetGlobalObservables()) { 
             RooAbsCollection *snap = mc->GetGlobalObservables()->snapshot();
-            if (snap) writeToysHere->WriteTObject(snap, "toy_asimov_snapshot");
+            if (snap) writeOutput(writeToysHere, snap, "toy_asimov_snapshot");
         }
     }
     if (MH) MH->setVal(mass_);    
@@ -1020,7 +1061,9 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
     std::unique_ptr<RooArgSet> vars(genPdf->getVariables());
     algo->setNToys(nToys);
 
-    for (iToy = 1; iToy <= nToys; ++iToy) {
+    // generate or read toy iToy and run the method on it; returns whether a result was found. toyMissing is set if the toy can't be read
+    bool toyMissing = false;
+    auto runToy = [&]() -> bool {
 
       // Reset ranges --> for likelihood scans
       if (setPhysicsModelParameterRangeExpression_ != "") {
@@ -1069,14 +1112,16 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
 	if (absdata_toy == 0) {
 	  std::cerr << "Toy toy_"<<iToy<<" not found in " << readToysFromHere->GetName() << ". List follows:\n";
 	  readToysFromHere->ls();
-	  return;
+	  toyMissing = true;
+	  return false;
 	}
         if (toysFrequentist_ && mc->GetGlobalObservables()) {
             RooAbsCollection *snap = dynamic_cast<RooAbsCollection *>(readToysFromHere->Get(TString::Format("toys/toy_%d_snapshot",iToy)));
             if (!snap) {
                 std::cerr << "Snapshot of global observables toy_"<<iToy<<"_snapshot not found in " << readToysFromHere->GetName() << ". List follows:\n";
                 readToysFromHere->ls();
-                return;
+                toyMissing = true;
+                return false;
             }
             vars->assignValueOnly(*snap);
 	    // note, we save over the "clean" values also for the parameters, so we've made sure they are the same as they were in (*)
@@ -1088,23 +1133,89 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
       w->loadSnapshot("clean");
       if (toysFrequentist_ && makeToyGenSnapshot_) w->saveSnapshot("toyGenSnapshot",utils::returnAllVars(w));
       //if (verbose > 1) utils::printPdf(w, "model_b");
-      if (mklimit(w,mc,mc_bonly,*absdata_toy,limit,limitErr)) {
+      bool found = mklimit(w,mc,mc_bonly,*absdata_toy,limit,limitErr);
+      if (found) {
 	commitPoint(0,g_quantileExpected_);//tree->Fill();
-	++nLimits;
-	expLimit += limit; 
-        limitHistory.push_back(limit);
       }
       // Set the global flag to write output to the tree again since some Methods overwrite this to avoid the fill above. 
       toggleGlobalFillTree(true);
 
       if (saveToys_) {
-	writeToysHere->WriteTObject(absdata_toy, TString::Format("toy_%d", iToy));
         if (toysFrequentist_ && mc->GetGlobalObservables()) { 
             RooAbsCollection *snap = mc->GetGlobalObservables()->snapshot();
-            writeToysHere->WriteTObject(snap, TString::Format("toy_%d_snapshot", iToy));
+            writeOutput(writeToysHere, snap, TString::Format("toy_%d_snapshot", iToy));
+        }
+	writeOutput(writeToysHere, absdata_toy, TString::Format("toy_%d", iToy));
+      } else {
+        delete absdata_toy;
+      }
+      return found;
+    };
+    if (toysFork_ && nToys > 1) {
+      if (!algo->canForkToys() || saveToys_) throw std::invalid_argument("--toysFork can't be used with --saveToys, nor with methods that write more than rows of the output tree for each toy");
+      // each toy gets a seed drawn here, so that the toys don't depend on the number of processes
+      std::vector<UInt_t> seeds(nToys);
+      for (UInt_t &seed : seeds) seed = 1 + RooRandom::randomGenerator()->Integer(std::numeric_limits<UInt_t>::max() - 1);
+      ForkedJobs jobs("toy", nToys, toysFork_);
+      if (verbose) CombineLogger::instance().log("Combine.cc",__LINE__,std::string(Form("Running %d toys in %u processes",nToys,jobs.children())),__func__);
+      TTree *parentTree = tree_;
+      bool childSetUp = false;
+      jobs.run([&](unsigned int j, FILE *out) {
+        if (!childSetUp) {
+          // the output file of the parent is not touched: the rows go into a file of each toy, and the toys are read from a file opened here
+          asyncOutput_.reset();
+          if (readToysFromHere) readToysFromHere = TFile::Open(readToysFromHere->GetName());
+          childSetUp = true;
+        }
+        TFile toyFile(jobs.file(j, ".root").c_str(), "RECREATE");
+        tree_ = parentTree->CloneTree(0);
+        tree_->SetDirectory(&toyFile);
+        RooRandom::randomGenerator()->SetSeed(seeds[j]);
+        iToy = j + 1;
+        bool found = runToy();
+        if (toyMissing) throw std::runtime_error(Form("Toy %d not found in %s", iToy, readToysFromHere->GetName()));
+        toyFile.cd();
+        tree_->Write();
+        toyFile.Close();
+        fprintf(out, "%d %.17g", found ? 1 : 0, limit);
+      });
+      // fill the rows of the toys into the output tree in the order of the toys, as the serial loop does
+      for (unsigned int j = 0; j < jobs.jobs(); ++j) {
+        int found = 0;
+        double toyLimit = 0;
+        std::unique_ptr<TFile> toyFile(jobs.done(j) && sscanf(jobs.result(j).c_str(), "%d %lg", &found, &toyLimit) == 2 ? TFile::Open(jobs.file(j, ".root").c_str()) : nullptr);
+        TTree *toyTree = toyFile ? dynamic_cast<TTree *>(toyFile->Get(tree_->GetName())) : nullptr;
+        if (toyTree == nullptr) {
+          CombineLogger::instance().log("Combine.cc",__LINE__,std::string(Form("Toy %u did not complete (process %u): it is skipped",j+1,jobs.child(j))),__func__);
+          continue;
+        }
+        for (TObject *b : *tree_->GetListOfBranches()) {
+          TBranch *branch = static_cast<TBranch *>(b);
+          toyTree->SetBranchAddress(branch->GetName(), asyncOutput_ ? asyncOutput_->userAddress(branch) : branch->GetAddress());
+        }
+        for (Long64_t e = 0, n = toyTree->GetEntries(); e < n; ++e) {
+          toyTree->GetEntry(e);
+          if (asyncOutput_) asyncOutput_->fill();
+          else tree_->Fill();
+        }
+        toyFile.reset();
+        if (found) {
+          ++nLimits;
+          expLimit += toyLimit;
+          limitHistory.push_back(toyLimit);
+        }
+      }
+      iToy = nToys + 1;
+    } else {
+      for (iToy = 1; iToy <= nToys; ++iToy) {
+        bool found = runToy();
+        if (toyMissing) return;
+        if (found) {
+          ++nLimits;
+          expLimit += limit;
+          limitHistory.push_back(limit);
         }
       }
-      delete absdata_toy;
     }
     if (weightVar_) delete weightVar_;
     expLimit /= nLimits;
@@ -1134,6 +1245,7 @@ void Combine::run(TString hlfFile, const std::string &dataset, double &limit, do
   if (saveWorkspace_) {
     w->SetName(workspaceName_.c_str());
     w->loadSnapshot("clean");
+    syncOutput();
     outputFile->WriteTObject(w,workspaceName_.c_str());
   }  
 
@@ -1154,13 +1266,34 @@ void Combine::commitPoint(bool expected, float quantile) {
       it.second = (it.first)->getError();
     }
 
-    if (g_fillTree_) tree_->Fill();
+    if (g_fillTree_) {
+        if (asyncOutput_) asyncOutput_->fill();
+        else tree_->Fill();
+    }
     g_quantileExpected_ = saveQuantile;
 }
 
 void Combine::addBranch(const char *name, void *address, const char *leaflist) {
+    syncOutput();
     tree_->Branch(name,address,leaflist);
 }
+void Combine::setTreeMass(double mass) {
+    TBranch *branch = tree_ ? tree_->GetBranch("mh") : 0;
+    void *address = (branch && asyncOutput_ ? asyncOutput_->userAddress(branch) : (branch ? branch->GetAddress() : 0));
+    if (branch == 0 || address == 0) throw std::logic_error("Combine::setTreeMass: no branch 'mh' in the output tree");
+    *reinterpret_cast<double *>(address) = mass;
+}
+void Combine::writeOutput(TDirectory *dir, TObject *obj, const char *name) {
+    if (asyncOutput_) {
+        asyncOutput_->write(dir, obj, name);
+    } else {
+        dir->WriteTObject(obj, name);
+        delete obj;
+    }
+}
+void Combine::syncOutput() {
+    if (asyncOutput_) asyncOutput_->sync();
+}
 void Combine::addPOI(const RooArgSet *poi){
    // RooArgSet *nuisances = (RooArgSet*) w->set("nuisances");
     CascadeMinimizerGlobalConfigs::O().parametersOfInterest = RooArgList();
@@ -1,37 +1,214 @@
 #include "../interface/CombineLogger.h"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <pthread.h>
+#include <unistd.h>
 using namespace std;
 
 // counter for Logger calls
-int CombineLogger::nLogs=0;
+std::atomic<int> CombineLogger::nLogs(0);
 
 const char*  CombineLogger::fName = "combine_logger.out";
 
+std::atomic<unsigned int> CombineLogger::maxPerSite_(100);
+
 CombineLogger* CombineLogger::pL = nullptr;
 
-CombineLogger& CombineLogger::instance()
+namespace {
+	const unsigned long ringSize = 8192; // must be a power of 2
+}
+
+CombineLogger::Site::Site(const char *file, int line, const char *function) :
+	file_(strrchr(file, '/') ? strrchr(file, '/') + 1 : file),
+	line_(line),
+	function_(function),
+	calls_(0)
 {
+}
 
+CombineLogger& CombineLogger::instance()
+{
+	// the first call is made from main, before there are other threads
 	if (pL == nullptr)
 		pL = new CombineLogger();
 
 	return *pL;
 }
 
-CombineLogger::CombineLogger()
+CombineLogger::CombineLogger() :
+	ring_(ringSize),
+	head_(0),
+	tail_(0),
+	dropped_(0),
+	flushed_(0),
+	writer_(0)
 {
+	for (unsigned long i = 0; i < ringSize; ++i) ring_[i].sequence.store(i, std::memory_order_relaxed);
 	outStream.open(fName, ios_base::out);
+	pthread_atfork(&CombineLogger::beforeFork_, nullptr, &CombineLogger::afterForkChild_);
+	atexit(&CombineLogger::atExit_);
 }
 
 void CombineLogger::log(const std::string & _file, const int _lineN, const string& _logmsg, const string& _function)
 {
-	std::cout << _logmsg << std::endl;
-	outStream << _file << "[" << _lineN << "] " << ": (in function: " << _function << ") - "  << _logmsg << endl;
-	nLogs++; 
+	{
+		std::lock_guard<std::mutex> lock(printMutex_);
+		std::cout << _logmsg << std::endl;
+	}
+	push_(Record{_file, _function, _logmsg, _lineN, 0., 0});
+	nLogs++;
+}
+
+void CombineLogger::logf(const Site &site, unsigned int n, const char *format, ...)
+{
+	char buff[512];
+	std::string message;
+	va_list args, args2;
+	va_start(args, format);
+	va_copy(args2, args);
+	int size = vsnprintf(buff, sizeof(buff), format, args);
+	if (size >= int(sizeof(buff))) {
+		message.resize(size);
+		vsnprintf(&message[0], size + 1, format, args2);
+	} else if (size > 0) {
+		message.assign(buff, size);
+	}
+	va_end(args2);
+	va_end(args);
+	if (n == maxPerSite_) message += " [further messages from here are suppressed]";
+	log(site.file(), site.line(), message, site.function());
+}
+
+void CombineLogger::push_(Record &&record)
+{
+	record.time = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record.pid = getpid();
+	if (writer_.load(std::memory_order_acquire) == 0) startWriter_();
+	// bounded queue with many producers: claim a slot by moving head_, then publish it through its sequence
+	unsigned long pos = head_.load(std::memory_order_relaxed);
+	Slot *slot;
+	while (true) {
+		slot = &ring_[pos & (ringSize - 1)];
+		long diff = long(slot->sequence.load(std::memory_order_acquire)) - long(pos);
+		if (diff == 0) {
+			if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (diff < 0) {
+			// full: don't stall the caller, the message is already on stdout
+			dropped_++;
+			return;
+		} else {
+			pos = head_.load(std::memory_order_relaxed);
+		}
+	}
+	slot->record = std::move(record);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+void CombineLogger::startWriter_()
+{
+	std::lock_guard<std::mutex> lock(startMutex_);
+	if (writer_.load(std::memory_order_acquire) != 0) return;
+	writer_.store(1, std::memory_order_release);
+	// detached, so that after a fork the child can simply start its own
+	std::thread(&CombineLogger::runWriter_, this).detach();
+}
+
+void CombineLogger::runWriter_()
+{
+	unsigned long reported = 0;
+	while (true) {
+		unsigned long pos = tail_.load(std::memory_order_relaxed);
+		Slot &slot = ring_[pos & (ringSize - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) == pos + 1) {
+			Record record = std::move(slot.record);
+			slot.sequence.store(pos + ringSize, std::memory_order_release);
+			write_(record);
+			tail_.store(pos + 1, std::memory_order_release);
+			continue;
+		}
+		unsigned long dropped = dropped_.load(std::memory_order_relaxed);
+		if (dropped != reported) {
+			outStream << "[" << (dropped - reported) << " messages not written in this file: the buffer was full]" << endl;
+			reported = dropped;
+		}
+		if (flushed_.load(std::memory_order_relaxed) != pos) {
+			outStream.flush();
+			flushed_.store(pos, std::memory_order_release);
+		}
+		if (writer_.load(std::memory_order_acquire) == 2 && head_.load(std::memory_order_acquire) == pos) break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+	writer_.store(0, std::memory_order_release);
+}
+
+void CombineLogger::write_(const Record &record)
+{
+	if (!json_) {
+		outStream << record.file << "[" << record.line << "] " << ": (in function: " << record.function << ") - "  << record.message << '\n';
+		return;
+	}
+	auto quote = [this](const std::string &str) {
+		outStream << '"';
+		for (char c : str) {
+			switch (c) {
+				case '"':  outStream << "\\\""; break;
+				case '\\': outStream << "\\\\"; break;
+				case '\n': outStream << "\\n"; break;
+				case '\t': outStream << "\\t"; break;
+				default:
+					if ((unsigned char)(c) < 0x20) { char esc[8]; snprintf(esc, sizeof(esc), "\\u%04x", (unsigned int)(c)); outStream << esc; }
+					else outStream << c;
+			}
+		}
+		outStream << '"';
+	};
+	char time[32];
+	snprintf(time, sizeof(time), "%.6f", record.time);
+	outStream << "{\"time\": " << time << ", \"pid\": " << record.pid << ", \"file\": ";
+	quote(record.file);
+	outStream << ", \"line\": " << record.line << ", \"function\": ";
+	quote(record.function);
+	outStream << ", \"message\": ";
+	quote(record.message);
+	outStream << "}\n";
+}
+
+void CombineLogger::flush()
+{
+	if (writer_.load(std::memory_order_acquire) != 1) return;
+	// the writer flushes the file whenever it finds the buffer empty
+	unsigned long target = head_.load(std::memory_order_acquire);
+	while (flushed_.load(std::memory_order_acquire) < target) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void CombineLogger::atExit_()
+{
+	if (pL == nullptr || pL->writer_.load(std::memory_order_acquire) != 1) return;
+	pL->writer_.store(2, std::memory_order_release);
+	while (pL->writer_.load(std::memory_order_acquire) != 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void CombineLogger::beforeFork_()
+{
+	// so that the messages so far are written only once, by the parent
+	if (pL) pL->flush();
+}
+
+void CombineLogger::afterForkChild_()
+{
+	// the writer thread is not copied: the child starts its own at the first message
+	if (pL) pL->writer_.store(0, std::memory_order_release);
 }
 
 void CombineLogger::printLog()
 {
-	std::cout << nLogs << " log messages saved to " << fName << std::endl;
+	flush();
+	std::cout << nLogs.load() << " log messages saved to " << fName << std::endl;
+	if (dropped_.load() > 0) std::cout << dropped_.load() << " of them could not be written, as they came faster than they could be written" << std::endl;
 }
 
 CombineLogger::~CombineLogger()
@@ -40,4 +217,4 @@ CombineLogger::~CombineLogger()
 	outStream.close();
 	delete CombineLogger::pL;
 	CombineLogger::pL = nullptr;
-}
\ No newline at end of file
+}
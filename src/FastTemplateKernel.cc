@@ -0,0 +1,146 @@
+#include "../interface/FastTemplateKernel.h"
+#include "../interface/Accumulators.h"
+
+#include <algorithm>
+#include <cmath>
+
+FastTemplateKernel & FastTemplateKernel::add(Type type, T x, T y, T z)
+{
+    Op op;
+    op.type = type; op.x = x; op.y = y; op.z = z;
+    ops_.push_back(op);
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::copy(const FastTemplate &other)
+{
+    add(Copy);
+    ops_.back().a = &other[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::multiply(const std::vector<T> &values)
+{
+    add(Multiply);
+    ops_.back().a = &values[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::meld(const FastTemplate &diff, const FastTemplate &sum, T x, T y)
+{
+    add(Meld, x, y);
+    ops_.back().a = &diff[0]; ops_.back().b = &sum[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::meld(const std::vector<float> &diff, const std::vector<float> &sum, T x, T y)
+{
+    add(MeldF, x, y);
+    ops_.back().fa = &diff[0]; ops_.back().fb = &sum[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::diffMeld(const FastTemplate &diff, const FastTemplate &sum, T xNew, T yNew, T xOld, T yOld)
+{
+    add(DiffMeld, xNew - xOld, xNew*yNew - xOld*yOld);
+    ops_.back().a = &diff[0]; ops_.back().b = &sum[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::diffMeld(const std::vector<float> &diff, const std::vector<float> &sum, T xNew, T yNew, T xOld, T yOld)
+{
+    add(DiffMeldF, xNew - xOld, xNew*yNew - xOld*yOld);
+    ops_.back().fa = &diff[0]; ops_.back().fb = &sum[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::subtract(const FastTemplate &reference)
+{
+    add(Subtract);
+    ops_.back().a = &reference[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::logRatio(const FastTemplate &reference)
+{
+    add(LogRatio);
+    ops_.back().a = &reference[0];
+    return *this;
+}
+
+FastTemplateKernel & FastTemplateKernel::log() { return add(Log); }
+FastTemplateKernel & FastTemplateKernel::exp() { return add(Exp); }
+FastTemplateKernel & FastTemplateKernel::scale(T factor) { return add(Scale, factor); }
+FastTemplateKernel & FastTemplateKernel::cropUnderflows(T minimum) { return add(Crop, minimum); }
+
+FastTemplateKernel & FastTemplateKernel::addTo(T coeff, T *target)
+{
+    add(AddTo, coeff);
+    ops_.back().target = target;
+    return *this;
+}
+
+FastTemplateKernel::T FastTemplateKernel::run()
+{
+    DefaultAccumulator<double> total = 0;
+    unsigned int n = out_->size();
+    T *out = n ? &(*out_)[0] : nullptr;
+    for (unsigned int first = 0; first < n; first += blockSize) {
+        unsigned int nb = std::min(blockSize, n - first);
+        T * __restrict__ o = out + first;
+        for (const Op &op : ops_) {
+            const T * __restrict__ a = op.a ? op.a + first : nullptr;
+            const T * __restrict__ b = op.b ? op.b + first : nullptr;
+            const float * __restrict__ fa = op.fa ? op.fa + first : nullptr;
+            const float * __restrict__ fb = op.fb ? op.fb + first : nullptr;
+            const T x = op.x, y = op.y;
+            switch (op.type) {
+                case Copy:
+                    std::copy(a, a + nb, o);
+                    break;
+                case Multiply:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] *= a[i];
+                    break;
+                case Meld:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] += x*(a[i] + y*b[i]);
+                    break;
+                case MeldF:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] += x*(T(fa[i]) + y*T(fb[i]));
+                    break;
+                case DiffMeld:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] += x*a[i] + y*b[i];
+                    break;
+                case DiffMeldF:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] += x*T(fa[i]) + y*T(fb[i]);
+                    break;
+                case Subtract:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] -= a[i];
+                    break;
+                case LogRatio:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] = (o[i] > 0 && a[i] > 0) ? std::log(o[i]/a[i]) : T(0);
+                    break;
+                case Log:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] = o[i] > 0 ? std::log(o[i]) : T(-999);
+                    break;
+                case Exp:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] = std::exp(o[i]);
+                    break;
+                case Scale:
+                    for (unsigned int i = 0; i < nb; ++i) o[i] *= x;
+                    break;
+                case Crop:
+                    for (unsigned int i = 0; i < nb; ++i) if (o[i] < x) o[i] = x;
+                    break;
+                case AddTo:
+                    {
+                        T * __restrict__ t = op.target + first;
+                        for (unsigned int i = 0; i < nb; ++i) t[i] += x*o[i];
+                    }
+                    break;
+            }
+        }
+        for (unsigned int i = 0; i < nb; ++i) total += o[i];
+    }
+    ops_.clear();
+    return total.sum();
+}
@@ -139,14 +139,19 @@ FastHisto2D::FastHisto2D(const FastHisto2D &other) :
 {
 }
 
-FastHisto2D::T FastHisto2D::GetAt(const T &x, const T &y) const {
+int FastHisto2D::FindBin(const T &x, const T &y) const {
     auto matchx = std::lower_bound(binEdgesX_.begin(), binEdgesX_.end(), x);
-    if (matchx == binEdgesX_.begin() || matchx == binEdgesX_.end()) return T(0.0);
+    if (matchx == binEdgesX_.begin() || matchx == binEdgesX_.end()) return -1;
     int ix = (matchx - binEdgesX_.begin() - 1);
     auto matchy = std::lower_bound(binEdgesY_.begin(), binEdgesY_.end(), y);
-    if (matchy == binEdgesY_.begin() || matchy == binEdgesY_.end()) return T(0.0);
+    if (matchy == binEdgesY_.begin() || matchy == binEdgesY_.end()) return -1;
     int iy = (matchy - binEdgesY_.begin() - 1);
-    return values_[ix * binY_ + iy];
+    return ix * binY_ + iy;
+}
+
+FastHisto2D::T FastHisto2D::GetAt(const T &x, const T &y) const {
+    int bin = FindBin(x, y);
+    return bin < 0 ? T(0.0) : values_[bin];
 }
 
 FastHisto2D::T FastHisto2D::IntegralWidth() const {
@@ -246,17 +251,22 @@ FastHisto3D::FastHisto3D(const FastHisto3D &other) :
 {
 }
 
-FastHisto3D::T FastHisto3D::GetAt(const T &x, const T &y, const T &z) const {
+int FastHisto3D::FindBin(const T &x, const T &y, const T &z) const {
     auto matchx = std::lower_bound(binEdgesX_.begin(), binEdgesX_.end(), x);
-    if (matchx == binEdgesX_.begin() || matchx == binEdgesX_.end()) return T(0.0);
+    if (matchx == binEdgesX_.begin() || matchx == binEdgesX_.end()) return -1;
     int ix = (matchx - binEdgesX_.begin() - 1);
     auto matchy = std::lower_bound(binEdgesY_.begin(), binEdgesY_.end(), y);
-    if (matchy == binEdgesY_.begin() || matchy == binEdgesY_.end()) return T(0.0);
+    if (matchy == binEdgesY_.begin() || matchy == binEdgesY_.end()) return -1;
     int iy = (matchy - binEdgesY_.begin() - 1);
     auto matchz = std::lower_bound(binEdgesZ_.begin(), binEdgesZ_.end(), z);
-    if (matchz == binEdgesZ_.begin() || matchz == binEdgesZ_.end()) return T(0.0);
+    if (matchz == binEdgesZ_.begin() || matchz == binEdgesZ_.end()) return -1;
     int iz = (matchz - binEdgesZ_.begin() - 1);
-    return values_[ix * binY_ *binZ_ +binZ_*iy + iz];
+    return ix * binY_ *binZ_ +binZ_*iy + iz;
+}
+
+FastHisto3D::T FastHisto3D::GetAt(const T &x, const T &y, const T &z) const {
+    int bin = FindBin(x, y, z);
+    return bin < 0 ? T(0.0) : values_[bin];
 }
 
 
@@ -328,6 +338,17 @@ namespace {
             out[i] += (xNew - xOld)*diff[i] + (xNew*yNew - xOld*yOld)*sum[i];
         }
     }
+    // same as above, with the templates in single precision: the sum is still done in double precision
+    void meld(FastTemplate::T * __restrict__ out, unsigned int n, float const * __restrict__ diff, float const * __restrict__ sum, FastTemplate::T x, FastTemplate::T y) {
+        for (unsigned int i = 0; i < n; ++i) {
+            out[i] += x*(FastTemplate::T(diff[i]) + y*FastTemplate::T(sum[i]));
+        }
+    }
+    void diffmeld(FastTemplate::T * __restrict__ out, unsigned int n, float const * __restrict__ diff, float const * __restrict__ sum, FastTemplate::T xNew, FastTemplate::T yNew, FastTemplate::T xOld, FastTemplate::T yOld) {
+        for (unsigned int i = 0; i < n; ++i) {
+            out[i] += (xNew - xOld)*FastTemplate::T(diff[i]) + (xNew*yNew - xOld*yOld)*FastTemplate::T(sum[i]);
+        }
+    }
 }
 
 void FastTemplate::Subtract(const FastTemplate & ref) {
@@ -349,6 +370,19 @@ void FastTemplate::DiffMeld(const FastTemplate & diff, const FastTemplate & sum,
     diffmeld(&values_[0], size_, &diff[0], &sum[0], xNew, yNew, xOld, yOld);
 }
 
+void FastTemplate::Meld(const std::vector<float> & diff, const std::vector<float> & sum, T x, T y) {
+    meld(&values_[0], size_, &diff[0], &sum[0], x, y);
+}
+
+void FastTemplate::DiffMeld(const std::vector<float> & diff, const std::vector<float> & sum, T xNew, T yNew, T xOld, T yOld) {
+    diffmeld(&values_[0], size_, &diff[0], &sum[0], xNew, yNew, xOld, yOld);
+}
+
+void FastTemplate::ToFloat(std::vector<float> &out) const {
+    out.resize(size_);
+    for (unsigned int i = 0; i < size_; ++i) out[i] = float(values_[i]);
+}
+
 void FastTemplate::Log() {
     for (unsigned int i = 0; i < size_; ++i) {
         //if (values_[i] <= 0) printf("WARNING: log(%g) at bin %d of %d bins (%d active bins)\n", values_[i], i, int(values_.size()), size_);
@@ -1,6 +1,8 @@
 #include "../interface/FitterAlgoBase.h"
 #include <limits>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 
 #include "RooRealVar.h"
 #include "RooArgSet.h"
@@ -32,6 +34,7 @@
 #include "../interface/ProfilingTools.h"
 #include "../interface/CachingNLL.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/ForkedJobs.h"
 
 #include <Math/MinimizerOptions.h>
 #include <Math/QuantFuncMathCore.h>
@@ -50,6 +53,7 @@ int         FitterAlgoBase::minimizerStrategyForMinos_ = 0;  // also default fro
 float       FitterAlgoBase::preFitValue_ = 1.0;
 float       FitterAlgoBase::stepSize_ = 0.1;
 bool        FitterAlgoBase::robustFit_ = false;
+unsigned int FitterAlgoBase::robustFitFork_ = 0;
 int         FitterAlgoBase::maxFailedSteps_ = 5;
 bool        FitterAlgoBase::do95_ = false;
 bool        FitterAlgoBase::forceRecreateNLL_ = false;
@@ -72,6 +76,7 @@ FitterAlgoBase::FitterAlgoBase(const char *title) :
         ("preFitValue",        boost::program_options::value<float>(&preFitValue_)->default_value(preFitValue_),  "Value of signal strength pre-fit, also used for pre-fit plots, normalizations and uncertainty calculations (note this overrides --expectSignal for these features)")
         ("do95",       boost::program_options::value<bool>(&do95_)->default_value(do95_),  "Also compute 2-sigma interval from delta(nll) = 1.92 instead of 0.5")
         ("robustFit",  boost::program_options::value<bool>(&robustFit_)->default_value(robustFit_),  "Search manually for 1 and 2 sigma bands instead of using Minos")
+        ("robustFitFork",  boost::program_options::value<unsigned int>(&robustFitFork_)->default_value(robustFitFork_),  "With --robustFit 1, and with MultiDimFit --algo cross, split the crossing searches of the POIs (up and down separately) among N forked processes (0 by default == no forking)")
         ("maxFailedSteps",  boost::program_options::value<int>(&maxFailedSteps_)->default_value(maxFailedSteps_),  "How many failed steps to retry before giving up")
         ("stepSize",        boost::program_options::value<float>(&stepSize_)->default_value(stepSize_),  "Step size for robust fits (multiplier of the range)")
         ("setRobustFitAlgo",      boost::program_options::value<std::string>(&minimizerAlgoForMinos_)->default_value(minimizerAlgoForMinos_), "Choice of minimizer (Minuit vs Minuit2) for profiling in robust fits")
@@ -276,6 +281,7 @@ RooFitResult *FitterAlgoBase::doFit(RooAbsPdf &pdf, RooAbsData &data, const RooA
 
     std::unique_ptr<RooArgSet> allpars(pdf.getParameters(data));
     RooArgSet* bestFitPars = (RooArgSet*)allpars->snapshot() ;
+    std::vector<CrossingSearch> crossingSearches;
 
     // I'm done here
     if (rs.getSize() == 0 && parametersToFreeze_.getSize() == 0) {
@@ -360,6 +366,11 @@ RooFitResult *FitterAlgoBase::doFit(RooAbsPdf &pdf, RooAbsData &data, const RooA
                rf.setAsymError(r.getAsymErrorLo(), r.getAsymErrorHi());
             }
        } else {
+            if (robustFitFork_) {
+                // the searches are done at the end, all together
+                crossingSearches.push_back(CrossingSearch{&r, &rf, r0, rMin, rMax});
+                continue;
+            }
             r.setVal(r0); r.setConstant(true);
 
             if (verbose) { 
@@ -388,20 +399,71 @@ RooFitResult *FitterAlgoBase::doFit(RooAbsPdf &pdf, RooAbsData &data, const RooA
             double lo68 = findCrossing(minim2, *nll, r, threshold68, r0,   rMin); 
             double lo95 = do95_ ? findCrossing(minim2, *nll, r, threshold95, std::isnan(lo68) ? r0 : lo68, rMin) : r0;
 
-            rf.setAsymError(!std::isnan(lo68) ? lo68 - r0 : 0, !std::isnan(hi68) ? hi68 - r0 : 0);
-            rf.setRange("err68", !std::isnan(lo68) ? lo68 : r0, !std::isnan(hi68) ? hi68 : r0);
-            if (do95_ && (!std::isnan(lo95) || !std::isnan(hi95))) {
-                rf.setRange("err95", !std::isnan(lo95) ? lo95 : r0, !std::isnan(hi95) ? hi95 : r0);
-            }
+            setCrossings(rf, r0, lo68, hi68, lo95, hi95);
 
             r.setVal(r0); r.setConstant(false);
         }
     }
+    if (!crossingSearches.empty()) findCrossingsWithFork(crossingSearches, *bestFitPars, delta68, delta95);
 
     *allpars = *bestFitPars;
     return ret;
 }
 
+void FitterAlgoBase::setCrossings(RooRealVar &rf, double r0, double lo68, double hi68, double lo95, double hi95) {
+    rf.setAsymError(!std::isnan(lo68) ? lo68 - r0 : 0, !std::isnan(hi68) ? hi68 - r0 : 0);
+    rf.setRange("err68", !std::isnan(lo68) ? lo68 : r0, !std::isnan(hi68) ? hi68 : r0);
+    if (do95_ && (!std::isnan(lo95) || !std::isnan(hi95))) {
+        rf.setRange("err95", !std::isnan(lo95) ? lo95 : r0, !std::isnan(hi95) ? hi95 : r0);
+    }
+}
+
+void FitterAlgoBase::findCrossingsWithFork(const std::vector<CrossingSearch> &searches, const RooArgSet &bestFit, double delta68, double delta95) {
+    // one job for each side of each POI: job 2*i is up, 2*i+1 is down
+    ForkedJobs jobs("crossing search", 2*searches.size(), robustFitFork_);
+    if (verbose) CombineLogger::instance().log("FitterAlgoBase.cc",__LINE__,std::string(Form("Running RobustFit for %d POIs in %u processes",int(searches.size()),jobs.children())),__func__);
+    TStopwatch tw;
+    jobs.run([&](unsigned int j, FILE *out) {
+        const CrossingSearch &s = searches[j/2];
+        bool up = (j % 2 == 0);
+        // every job starts from the best fit, as the serial search does for each side
+        std::unique_ptr<RooArgSet> allpars(nll->getParameters((const RooArgSet *)0));
+        *allpars = bestFit;
+        RooRealVar &r = *s.r;
+        r.setVal(s.r0); r.setConstant(true);
+        CascadeMinimizer minim2(*nll, CascadeMinimizer::Constrained);
+        minim2.setStrategy(minimizerStrategyForMinos_);
+        double nll0 = nll->getVal();
+        double c68 = findCrossing(minim2, *nll, r, nll0 + delta68, s.r0, up ? s.rMax : s.rMin);
+        double c95 = s.r0;
+        if (do95_) {
+            // start from the 68% crossing, where the parameters have been left
+            double start = std::isnan(c68) ? s.r0 : c68;
+            double bound = up ? std::max(s.rMax, std::isnan(c68*2-s.r0) ? s.r0 : c68*2-s.r0) : s.rMin;
+            c95 = findCrossing(minim2, *nll, r, nll0 + delta95, start, bound);
+        }
+        r.setConstant(false);
+        fprintf(out, "%.17g %.17g", c68, c95);
+    });
+
+    // the searches whose results are missing are left undetermined (NaN), as when the serial search fails
+    std::vector<double> c68(jobs.jobs(), std::numeric_limits<double>::quiet_NaN()), c95(jobs.jobs(), std::numeric_limits<double>::quiet_NaN());
+    for (unsigned int j = 0; j < jobs.jobs(); ++j) {
+        char s68[64], s95[64];
+        if (jobs.done(j) && sscanf(jobs.result(j).c_str(), "%63s %63s", s68, s95) == 2) {
+            c68[j] = atof(s68); c95[j] = atof(s95);
+        } else {
+            CombineLogger::instance().log("FitterAlgoBase.cc",__LINE__,std::string(Form("The search of the %s crossing of %s did not complete (process %u): it is left undetermined",
+                    j % 2 == 0 ? "upper" : "lower", searches[j/2].r->GetName(), jobs.child(j))),__func__);
+        }
+    }
+    // gather the results in the order of the POIs
+    for (unsigned int i = 0, n = searches.size(); i < n; ++i) {
+        setCrossings(*searches[i].rf, searches[i].r0, c68[2*i+1], c68[2*i], c95[2*i+1], c95[2*i]);
+    }
+    if (verbose>1) CombineLogger::instance().log("FitterAlgoBase.cc",__LINE__,std::string(Form("Crossing searches done in %f seconds",tw.RealTime())),__func__);
+}
+
 double FitterAlgoBase::findCrossing(CascadeMinimizer &minim, RooAbsReal &nll, RooRealVar &r, double level, double rStart, double rBound) {
     if (runtimedef::get("FITTER_NEW_CROSSING_ALGO")) {
         return findCrossingNew(minim, nll, r, level, rStart, rBound);
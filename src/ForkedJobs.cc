@@ -0,0 +1,128 @@
+#include "../interface/ForkedJobs.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+
+#include <TString.h>
+#include "../interface/Combine.h"
+#include "../interface/CombineLogger.h"
+
+ForkedJobs::ForkedJobs(const char *what, unsigned int njobs, unsigned int nchildren) :
+    what_(what),
+    njobs_(njobs),
+    nchildren_(std::max(1u, std::min(nchildren, njobs))),
+    results_(njobs),
+    done_(njobs, false),
+    failed_(nchildren_, false)
+{
+    char tmpdir[999]; snprintf(tmpdir, 998, "%s/rfork-XXXXXX", P_tmpdir);
+    if (mkdtemp(tmpdir) == nullptr) {
+        throw std::runtime_error(Form("Could not make a temporary directory for the %s processes: %s", what, strerror(errno)));
+    }
+    dir_ = tmpdir;
+}
+
+ForkedJobs::~ForkedJobs() {
+    bool keep = false;
+    DIR *dir = opendir(dir_.c_str());
+    if (dir == nullptr) return;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        unsigned int ich;
+        char tail[16];
+        if (sscanf(name.c_str(), "%u.%15s", &ich, tail) == 2 && ich < nchildren_ && failed_[ich] && strcmp(tail, "err.txt") == 0) {
+            keep = true;
+            continue;
+        }
+        unlink((dir_ + "/" + name).c_str());
+    }
+    closedir(dir);
+    if (!keep) rmdir(dir_.c_str());
+}
+
+std::string ForkedJobs::file(unsigned int j, const char *ext) const {
+    return std::string(TString::Format("%s/job%u%s", dir_.c_str(), j, ext).Data());
+}
+
+void ForkedJobs::run(const std::function<void(unsigned int job, FILE *out)> &job) {
+    // the children must not inherit pending output: drain the output writer and the log buffer before forking
+    Combine::syncOutput();
+    CombineLogger::instance().flush();
+    fflush(stdout); fflush(stderr);
+
+    unsigned int ich = 0;
+    std::vector<pid_t> pids(nchildren_, -1);
+    for (ich = 0; ich < nchildren_; ++ich) {
+        pids[ich] = fork();
+        if (pids[ich] == 0) break; // spawn children (but only in the parent thread)
+        if (pids[ich] == -1) CombineLogger::instance().log("ForkedJobs.cc",__LINE__,std::string(Form("Could not fork process %u for the %ss: %s",ich,what_.c_str(),strerror(errno))),__func__);
+    }
+    if (ich < nchildren_) { // if i'm a child
+        if (freopen(TString::Format("%s/%u.out.txt", dir_.c_str(), ich).Data(), "w", stdout) == nullptr ||
+            freopen(TString::Format("%s/%u.err.txt", dir_.c_str(), ich).Data(), "w", stderr) == nullptr) {
+            _exit(1);
+        }
+        FILE *out = fopen(TString::Format("%s/%u.txt", dir_.c_str(), ich).Data(), "w");
+        if (out == nullptr) _exit(1);
+        int status = 0;
+        try {
+            for (unsigned int j = ich; j < njobs_; j += nchildren_) {
+                fprintf(out, "%u ", j);
+                job(j, out);
+                fprintf(out, "\n");
+                fflush(out); // the results of the jobs done so far are kept if a later one crashes
+            }
+        } catch (const std::exception &e) {
+            fprintf(stderr, "Error in the %s process %u: %s\n", what_.c_str(), ich, e.what());
+            status = 2;
+        }
+        fclose(out);
+        fflush(stdout); fflush(stderr);
+        CombineLogger::instance().flush();
+        _exit(status); // no unwinding: the child must not touch the output files of the parent
+    }
+
+    for (ich = 0; ich < nchildren_; ++ich) {
+        if (pids[ich] == -1) continue;
+        int cstatus, ret;
+        do { ret = waitpid(pids[ich], &cstatus, 0); } while (ret == -1 && errno == EINTR);
+        failed_[ich] = (ret == -1 || WIFSIGNALED(cstatus) || WEXITSTATUS(cstatus) != 0);
+        if (ret == -1) {
+            CombineLogger::instance().log("ForkedJobs.cc",__LINE__,std::string(Form("Could not wait for the %s process %u: %s",what_.c_str(),ich,strerror(errno))),__func__);
+        } else if (WIFSIGNALED(cstatus)) {
+            CombineLogger::instance().log("ForkedJobs.cc",__LINE__,std::string(Form("The %s process %u was killed by signal %d",what_.c_str(),ich,WTERMSIG(cstatus))),__func__);
+        } else if (WEXITSTATUS(cstatus) != 0) {
+            CombineLogger::instance().log("ForkedJobs.cc",__LINE__,std::string(Form("The %s process %u failed with status %d",what_.c_str(),ich,WEXITSTATUS(cstatus))),__func__);
+        }
+        if (failed_[ich]) {
+            CombineLogger::instance().log("ForkedJobs.cc",__LINE__,std::string(Form("The error output of the %s process %u is kept in %s/%u.err.txt",what_.c_str(),ich,dir_.c_str(),ich)),__func__);
+        }
+    }
+
+    // only complete lines count: the last one of a child that crashed may be truncated
+    for (ich = 0; ich < nchildren_; ++ich) {
+        FILE *in = fopen(TString::Format("%s/%u.txt", dir_.c_str(), ich).Data(), "r");
+        if (in == nullptr) continue;
+        char *line = nullptr;
+        size_t size = 0;
+        ssize_t len;
+        while ((len = getline(&line, &size, in)) > 0) {
+            if (line[len-1] != '\n') break;
+            line[len-1] = '\0';
+            unsigned int j; int pos;
+            if (sscanf(line, "%u %n", &j, &pos) < 1 || j >= njobs_) continue;
+            results_[j] = line + pos;
+            done_[j] = true;
+        }
+        free(line);
+        fclose(in);
+    }
+}
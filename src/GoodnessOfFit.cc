@@ -11,6 +11,7 @@
 #include <RooConstVar.h>
 #include <RooDataHist.h>
 #include <RooHistPdf.h>
+#include <RooAbsBinning.h>
 #include <TCanvas.h>
 #include <TStyle.h>
 #include <TH2.h>
@@ -24,9 +25,11 @@
 #include "../interface/RooSimultaneousOpt.h"
 #include "../interface/utils.h"
 #include "../interface/CachingNLL.h"
+#include "../interface/ProfilingTools.h"
 
 #include <numeric>
 #include <memory>
+#include <map>
 
 
 #include <Math/MinimizerOptions.h>
@@ -89,6 +92,7 @@ bool GoodnessOfFit::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
     if (!is_init) {
       initKSandAD(mc_s);
       if (makePlots_) {
+        Combine::syncOutput();
         plotDir_ = outputFile ? outputFile->mkdir("GoodnessOfFit") : 0;
       }
       is_init = true;
@@ -119,11 +123,36 @@ void GoodnessOfFit::initKSandAD(RooStats::ModelConfig *mc_s) {
 
 bool GoodnessOfFit::runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) { 
   RooAbsPdf *pdf_nominal = mc_s->GetPdf();
+  // factorize away constraints anyway (this also creates the nll of the nominal model)
+  RooAbsReal &nominal_nll = nominalNLL(mc_s, data);
+  const RooArgList &constraints = constraints_;
+  RooAbsPdf *obsOnlyPdf = obsOnlyPdf_;
+  // the saturated model has expected = observed in every bin, so its nll can be computed from the data
+  // and only the constraint terms need to be fitted
+  static bool saturatedFit = runtimedef::get("GOF_SATURATED_FIT");
+  cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(&nominal_nll);
+  std::vector<double> channelNLLs;
+  if (!saturatedFit && simnll && saturatedChannelNLLs(data, channelNLLs)) {
+    CloseCoutSentry sentry(verbose < 2);
+    double nll_nominal = fitNominalNLL(w, nominal_nll);
+    double nll_saturated = saturatedConstraintsNLL(w, mc_s, *simnll);
+    RooSimultaneousOpt* simopt = dynamic_cast<RooSimultaneousOpt*>(pdf_nominal);
+    const RooArgList *masks = (simopt && simopt->channelMasks().getSize() > 0) ? &simopt->channelMasks() : nullptr;
+    for (int ic = 0, nc = channelNLLs.size(); ic < nc; ++ic) {
+      if (masks && static_cast<RooAbsReal *>(masks->at(ic))->getVal() != 0.) continue;
+      nll_saturated += channelNLLs[ic];
+    }
+    sentry.clear();
+
+    if (fabs(nll_nominal) > 1e10 || fabs(nll_saturated) > 1e10) return false;
+    limit = 2*(nll_nominal-nll_saturated);
+
+    std::cout << "\n --- GoodnessOfFit --- " << std::endl;
+    std::cout << "Best fit test statistic: " << limit << std::endl;
+    return true;
+  }
   // now I need to make the saturated pdf
   std::unique_ptr<RooAbsPdf> saturated;
-  // factorize away constraints anyway
-  RooArgList constraints;
-  RooAbsPdf *obsOnlyPdf = utils::factorizePdf(*mc_s->GetObservables(), *pdf_nominal, constraints);
   // case 1:
   RooSimultaneous *sim = dynamic_cast<RooSimultaneous *>(obsOnlyPdf);
   if (sim) {
@@ -173,26 +202,9 @@ bool GoodnessOfFit::runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc
   CloseCoutSentry sentry(verbose < 2);
 
   RooArgSet const *cPars = withSystematics ? mc_s->GetNuisanceParameters() : nullptr;
-  auto nominal_nll = combineCreateNLL(*pdf_nominal, data, /*constrain=*/cPars, /*offset=*/false);
   auto saturated_nll = combineCreateNLL(*saturated, data, /*constrain=*/cPars, /*offset=*/false);
 
-  if (setParametersForFit_ != "") {
-    utils::setModelParameters(setParametersForFit_, w->allVars());
-  }
-  CascadeMinimizer minimn(*nominal_nll, CascadeMinimizer::Unconstrained);
- // minimn.setStrategy(minimizerStrategy_);
-  minimn.minimize(verbose-2);
-  // This test is a special case where we are comparing the likelihoods of two
-  // different models and so we can't re-zero the NLL with respect to the
-  // initial parameters.
-  if (dynamic_cast<cacheutils::CachingSimNLL*>(nominal_nll.get())) {
-    static_cast<cacheutils::CachingSimNLL*>(nominal_nll.get())->clearConstantZeroPoint();
-  }
-
-  if (setParametersForEval_ != "") {
-    utils::setModelParameters(setParametersForEval_, w->allVars());
-  }
-  double nll_nominal = nominal_nll->getVal();
+  double nll_nominal = fitNominalNLL(w, nominal_nll);
 
   if (setParametersForFit_ != "") {
     utils::setModelParameters(setParametersForFit_, w->allVars());
@@ -223,13 +235,132 @@ bool GoodnessOfFit::runSaturatedModel(RooWorkspace *w, RooStats::ModelConfig *mc
   return true;
 }
 
+double GoodnessOfFit::fitNominalNLL(RooWorkspace *w, RooAbsReal &nominal_nll) {
+  if (setParametersForFit_ != "") {
+    utils::setModelParameters(setParametersForFit_, w->allVars());
+  }
+  CascadeMinimizer minimn(nominal_nll, CascadeMinimizer::Unconstrained);
+ // minimn.setStrategy(minimizerStrategy_);
+  minimn.minimize(verbose-2);
+  // This test is a special case where we are comparing the likelihoods of two
+  // different models and so we can't re-zero the NLL with respect to the
+  // initial parameters.
+  if (dynamic_cast<cacheutils::CachingSimNLL*>(&nominal_nll)) {
+    static_cast<cacheutils::CachingSimNLL*>(&nominal_nll)->clearConstantZeroPoint();
+  }
+
+  if (setParametersForEval_ != "") {
+    utils::setModelParameters(setParametersForEval_, w->allVars());
+  }
+  return nominal_nll.getVal();
+}
+
+bool GoodnessOfFit::saturatedChannelNLLs(RooAbsData &data, std::vector<double> &nlls) {
+  RooSimultaneous *sim = dynamic_cast<RooSimultaneous *>(obsOnlyPdf_);
+  if (sim == 0) return false;
+  std::unique_ptr<RooAbsCategoryLValue> cat(static_cast<RooAbsCategoryLValue *>(sim->indexCat().Clone()));
+  std::unique_ptr<TList> datasets(data.split(*cat, true));
+  int nbins = cat->numBins((const char *)0);
+  nlls.assign(nbins, 0.);
+  for (int ic = 0; ic < nbins; ++ic) {
+    cat->setBin(ic);
+    RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
+    if (pdfi == 0) continue;
+    RooAbsData *datai = (RooAbsData *) datasets->FindObject(cat->getLabel());
+    if (datai == 0) throw std::runtime_error(std::string("Error: missing dataset for category label ")+cat->getLabel());
+    std::unique_ptr<RooArgSet> data_observables(pdfi->getObservables(datai));
+    if (!saturatedChannelNLL(*datai, *data_observables, nlls[ic])) return false;
+  }
+  return true;
+}
+
+bool GoodnessOfFit::saturatedChannelNLL(const RooAbsData &data, const RooArgSet &observables, double &nll) {
+  // Same value that CachingAddNLL gives for the pdf of makeSaturatedPdf: the entries are grouped in the bins
+  // of the default binning of the observables, and in each bin the pdf is sumw(bin)/(sumw * volume(bin)).
+  // The extended term vanishes, since the expected events are equal to the observed ones.
+  const RooArgSet *row = data.get();
+  std::vector<RooRealVar *> vars;
+  std::vector<RooAbsCategoryLValue *> cats;
+  for (RooAbsArg *a : observables) {
+    RooAbsArg *ai = row->find(a->GetName());
+    RooRealVar *v = dynamic_cast<RooRealVar *>(ai);
+    RooAbsCategoryLValue *c = dynamic_cast<RooAbsCategoryLValue *>(ai);
+    if (v) vars.push_back(v);
+    else if (c) cats.push_back(c);
+    else return false;
+  }
+  std::map<std::vector<int>, std::pair<double,double> > bins; // sumw, volume
+  std::vector<int> key(vars.size() + cats.size());
+  for (int i = 0, n = data.numEntries(); i < n; ++i) {
+    data.get(i);
+    double w = data.weight();
+    if (w == 0) continue;
+    double volume = 1.0;
+    for (int j = 0, nv = vars.size(); j < nv; ++j) {
+      const RooAbsBinning &binning = vars[j]->getBinning();
+      key[j] = binning.binNumber(vars[j]->getVal());
+      volume *= binning.binWidth(key[j]);
+    }
+    for (int j = 0, nk = cats.size(); j < nk; ++j) key[vars.size()+j] = cats[j]->getCurrentIndex();
+    std::pair<double,double> &bin = bins[key];
+    bin.first += w;
+    bin.second = volume;
+  }
+  double sumw = data.sumEntries();
+  nll = 0;
+  if (sumw <= 0) return true;
+  for (const auto &bin : bins) {
+    if (bin.second.first <= 0) continue;
+    nll -= bin.second.first * std::log(bin.second.first/(sumw * bin.second.second));
+  }
+  return true;
+}
+
+double GoodnessOfFit::saturatedConstraintsNLL(RooWorkspace *w, RooStats::ModelConfig *mc_s, cacheutils::CachingSimNLL &nll) {
+  // the channels of the saturated model have no parameters, so its best fit is the best fit of the constraint terms alone:
+  // evaluate only the constraints of the nominal nll, and float only the parameters that enter them
+  RooArgSet constrPars;
+  for (RooAbsArg *a : constraints_) {
+    std::unique_ptr<RooArgSet> cpars(static_cast<RooAbsPdf *>(a)->getParameters(*mc_s->GetObservables()));
+    constrPars.add(*cpars, /*silent=*/true);
+  }
+  std::unique_ptr<RooArgSet> params(nll.getParameters((const RooArgSet *)0));
+  RooArgSet toFreeze;
+  bool floating = false;
+  for (RooAbsArg *a : *params) {
+    if (a->isConstant()) continue;
+    if (constrPars.contains(*a)) floating = true;
+    else toFreeze.add(*a);
+  }
+  // the parameters are put back at the end, so that masking the channels leaves the nominal nll unchanged
+  RooArgSet allVars(w->allVars());
+  utils::CheapValueSnapshot snap(allVars);
+  utils::setAllConstant(toFreeze, true);
+  nll.setMaskChannels(true);
+  if (setParametersForFit_ != "") {
+    utils::setModelParameters(setParametersForFit_, w->allVars());
+  }
+  if (floating) {
+    CascadeMinimizer minimc(nll, CascadeMinimizer::Unconstrained);
+    minimc.minimize(verbose-2);
+  }
+  if (setParametersForEval_ != "") {
+    utils::setModelParameters(setParametersForEval_, w->allVars());
+  }
+  double ret = nll.constraintsNLL();
+  snap.writeTo(allVars);
+  nll.setMaskChannels(false);
+  utils::setAllConstant(toFreeze, false);
+  return ret;
+}
+
 // Code for the Anderson-Darling test originates from https://gist.github.com/neggert/4586791
 bool GoodnessOfFit::runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint, bool kolmo) { 
   RooAbsPdf *pdf = mc_s->GetPdf();
 
   // Don't want the constraints here
-  RooArgList constraints;
-  RooAbsPdf *obsOnlyPdf = utils::factorizePdf(*mc_s->GetObservables(), *pdf, constraints);
+  RooAbsReal &nll = nominalNLL(mc_s, data);
+  RooAbsPdf *obsOnlyPdf = obsOnlyPdf_;
 
   //First, find the best fit values
   CloseCoutSentry sentry(verbose < 2);
@@ -243,9 +374,7 @@ bool GoodnessOfFit::runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, Roo
   sentry.clear();
   */
 
-  RooArgSet const *cPars = withSystematics ? mc_s->GetNuisanceParameters() : nullptr;
-  auto nll = combineCreateNLL(*pdf, data, /*constrain=*/cPars, /*offset=*/false);
-  CascadeMinimizer minim(*nll, CascadeMinimizer::Unconstrained);
+  CascadeMinimizer minim(nll, CascadeMinimizer::Unconstrained);
   //minims.setStrategy(minimizerStrategy_);
   minim.minimize(verbose-2);
 
@@ -298,17 +427,33 @@ bool GoodnessOfFit::runKSandAD(RooWorkspace *w, RooStats::ModelConfig *mc_s, Roo
   return true;
 }
 
+RooAbsReal & GoodnessOfFit::nominalNLL(RooStats::ModelConfig *mc_s, RooAbsData &data) {
+  // the pdf does not change between the toys of a job, so the factorisation and the nll can be kept
+  cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(nominalNLL_.get());
+  if (iToy_ > 0 && simnll && cachedPdf_ == mc_s->GetPdf()) {
+    simnll->setData(data);
+    simnll->setValueDirty();
+    return *simnll;
+  }
+  cachedPdf_ = mc_s->GetPdf();
+  constraints_.removeAll();
+  obsOnlyPdf_ = utils::factorizePdf(*mc_s->GetObservables(), *cachedPdf_, constraints_);
+  RooArgSet const *cPars = withSystematics ? mc_s->GetNuisanceParameters() : nullptr;
+  nominalNLL_ = combineCreateNLL(*cachedPdf_, data, /*constrain=*/cPars, /*offset=*/false);
+  return *nominalNLL_;
+}
+
 Double_t GoodnessOfFit::EvaluateADDistance(RooAbsPdf& pdf, RooAbsData& data, RooRealVar& observable, bool kolmo) {
     typedef std::pair<double, double> double_pair;
     std::vector<double_pair> data_points;
     Int_t n_data = data.numEntries();
     Double_t s_data = data.sumEntries();
 
-    const RooArgSet* datavals;
-    RooRealVar* observable_val;
+    // the dataset returns always the same RooArgSet, so the observable can be looked up once
+    RooRealVar* observable_val = (RooRealVar*)(data.get()->find(observable.GetName()));
+    data_points.reserve(n_data);
     for (int i = 0; i < n_data; i++) {
-        datavals = data.get(i);
-        observable_val = (RooRealVar*)(datavals->find(observable.GetName()));
+        data.get(i);
         data_points.push_back(std::make_pair(observable_val->getVal(), data.weight()));
     }
 
@@ -341,6 +486,11 @@ Double_t GoodnessOfFit::EvaluateADDistance(RooAbsPdf& pdf, RooAbsData& data, Roo
       hDiff->SetName((std::string(data.GetName())+"_diff").c_str());
     }
 
+    // the cdf is only evaluated at the upper edges of the bins, so each edge is computed once
+    // (several entries can fall in the same bin, e.g. for unbinned data)
+    const RooAbsBinning &binning = observable.getBinning();
+    std::vector<double> cdfAtBin(binning.numBins(), -1.);
+
     int bin = 0;
     for (std::vector<double_pair>::const_iterator d = data_points.begin();
          d != data_points.end(); d++, ++bin) {
@@ -348,11 +498,13 @@ Double_t GoodnessOfFit::EvaluateADDistance(RooAbsPdf& pdf, RooAbsData& data, Roo
       
         // This is a better way to get the upper bin edge in the case where we
         // have variable bin widths (I hope)
-        observableval = observable.getBinning().binHigh(
-            observable.getBinning().binNumber(d->first));
-        observable.setVal(observableval);
-        // observable.bin
-        current_cdf_val = cdf->getVal();
+        int ibin = binning.binNumber(d->first);
+        observableval = binning.binHigh(ibin);
+        if (cdfAtBin[ibin] < 0) {
+            observable.setVal(observableval);
+            cdfAtBin[ibin] = cdf->getVal();
+        }
+        current_cdf_val = cdfAtBin[ibin];
         if (d->second==0 && s_data ==0){
           empirical_df = -1.;
         } else {
@@ -402,6 +554,7 @@ Double_t GoodnessOfFit::EvaluateADDistance(RooAbsPdf& pdf, RooAbsData& data, Roo
     }
 
     if (plotDir_ && makePlots_) {
+      Combine::syncOutput();
       plotDir_->WriteTObject(hCdf);
       plotDir_->WriteTObject(hEdf);
       plotDir_->WriteTObject(hDiff);
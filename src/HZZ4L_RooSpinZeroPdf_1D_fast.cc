@@ -56,29 +56,36 @@ HZZ4L_RooSpinZeroPdf_1D_fast::HZZ4L_RooSpinZeroPdf_1D_fast(
 {}
 
 
-Float_t HZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn(Int_t code, const char* rangeName) const{
+Bool_t HZZ4L_RooSpinZeroPdf_1D_fast::getCouplingCoefficients(vector<Float_t>& coefs) const{
   Float_t absfai1 = fabs(fai1);
   Float_t fa1 = 1.-absfai1;
   
-  if (fa1<0.) return 0;
+  coefs.clear();
+  if (fa1<0.) return false;
 
-  DefaultAccumulator<Float_t> value = 0;
   Float_t sgn_fai1 = (fai1>=0. ? 1. : -1.);
 
-  vector<Float_t> coefs; coefs.reserve(3);
+  coefs.reserve(3);
   coefs.push_back((Float_t)fa1);
   coefs.push_back((Float_t)absfai1);
   coefs.push_back((Float_t)sgn_fai1*sqrt(fa1*absfai1));
   if (coefList.getSize() != (Int_t)coefs.size()){
-    cerr << "HZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
+    cerr << "HZZ4L_RooSpinZeroPdf_1D_fast::getCouplingCoefficients: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
     assert(0);
   }
+  return true;
+}
 
+Float_t HZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn(Int_t code, const char* rangeName) const{
+  vector<Float_t> coefs;
+  if (!getCouplingCoefficients(coefs)) return 0;
+
+  DefaultAccumulator<Float_t> value = 0;
   if (code==0){
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
   }
   else{
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
   }
 
   Float_t result = value.sum();
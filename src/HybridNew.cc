@@ -318,7 +318,7 @@ bool HybridNew::runSignificance(RooWorkspace *w, RooStats::ModelConfig *mc_s, Ro
             name += Form("_%s%g", rIn->GetName(), static_cast<RooRealVar*>(rIn)->getVal());
         }
         name += Form("_%u", RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1));
-        writeToysHere->WriteTObject(new HypoTestResult(*hcResult), name);
+        Combine::writeOutput(writeToysHere, new HypoTestResult(*hcResult), name);
         if (verbose) std::cout << "Hybrid result saved as " << name << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
     }
     if (verbose > 1) {
@@ -1157,7 +1157,7 @@ HybridNew::eval(RooStats::HybridCalculator &hc, const RooAbsCollection & rVals,
             name += Form("_%s%g", rIn->GetName(), static_cast<RooRealVar*>(rIn)->getVal());
         }
         name += Form("_%u", RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1));
-        writeToysHere->WriteTObject(new HypoTestResult(*hcResult), name);
+        Combine::writeOutput(writeToysHere, new HypoTestResult(*hcResult), name);
         if (verbose) std::cout << "Hybrid result saved as " << name << " in " << writeToysHere->GetFile()->GetName() << " : " << writeToysHere->GetPath() << std::endl;
     }
 
@@ -1,6 +1,9 @@
 #include "../interface/MarkovChainMC.h"
 #include <stdexcept> 
+#include <algorithm>
 #include <cmath> 
+#include <chrono>
+#include <cstdio>
 #include "TKey.h"
 #include "RooRealVar.h"
 #include "RooArgSet.h"
@@ -8,12 +11,14 @@
 #include "RooWorkspace.h"
 #include "RooFitResult.h"
 #include "RooRandom.h"
+#include "TRandom3.h"
 #ifndef ROOT_THnSparse
 class THnSparse;
 #define ROOT_THnSparse
 #endif
 #include "RooStats/MCMCCalculator.h"
 #include "RooStats/MCMCInterval.h"
+#include "RooStats/MarkovChain.h"
 #include "RooStats/ModelConfig.h"
 #include "RooStats/ProposalHelper.h"
 #include "RooStats/ProposalFunction.h"
@@ -27,6 +32,7 @@ class THnSparse;
 
 #include "../interface/ProfilingTools.h"
 #include "../interface/utils.h"
+#include "../interface/ForkedJobs.h"
 
 using namespace RooStats;
 using namespace std;
@@ -49,6 +55,15 @@ bool MarkovChainMC::saveChain_ = false;
 bool MarkovChainMC::noSlimChain_ = false;
 bool MarkovChainMC::mergeChains_ = false;
 bool MarkovChainMC::readChains_ = false;
+unsigned int MarkovChainMC::nChains_ = 0;
+float MarkovChainMC::rHatTarget_ = 1.05;
+float MarkovChainMC::essTarget_ = 1000;
+unsigned int MarkovChainMC::checkEvery_ = 1000;
+unsigned int MarkovChainMC::chainsFork_ = 0;
+std::string MarkovChainMC::chainSamplerName_ = "metropolis";
+bool MarkovChainMC::hmc_ = false;
+unsigned int MarkovChainMC::hmcSteps_ = 10;
+float MarkovChainMC::hmcStepSize_ = 0.1;
 float MarkovChainMC::proposalHelperWidthRangeDivisor_ = 5.;
 float MarkovChainMC::proposalHelperUniformFraction_ = 0.0;
 bool  MarkovChainMC::alwaysStepPoi_ = true;
@@ -97,6 +112,19 @@ MarkovChainMC::MarkovChainMC() :
         ("noSlimChain", "Include also nuisance parameters in the chain that is saved to file")
         ("mergeChains", "Merge MarkovChains instead of averaging limits")
         ("readChains", "Just read MarkovChains from toysFile instead of running MCMC directly")
+        ("chains", boost::program_options::value<unsigned int>(&nChains_)->default_value(nChains_),
+                "If N > 0, run N chains of a native Metropolis sampler over the optimized NLL (stepping as the 'ortho' proposal) instead of the RooStats one. "
+                "Each chain runs for up to --iteration steps, stopping earlier once --rHatTarget and --essTarget are met")
+        ("rHatTarget", boost::program_options::value<float>(&rHatTarget_)->default_value(rHatTarget_), "With --chains, Gelman-Rubin R-hat of the POI below which the chains are considered converged")
+        ("essTarget", boost::program_options::value<float>(&essTarget_)->default_value(essTarget_), "With --chains, effective sample size of the POI (all chains together) needed to stop")
+        ("checkEvery", boost::program_options::value<unsigned int>(&checkEvery_)->default_value(checkEvery_), "With --chains, check the convergence every N steps of each chain")
+        ("chainsFork", boost::program_options::value<unsigned int>(&chainsFork_)->default_value(chainsFork_),
+                "With --chains, run each block of --checkEvery steps of the chains in N forked processes, which write the points of their chains back to be merged (0 = run the chains one after the other in this process, the default)")
+        ("chainSampler", boost::program_options::value<std::string>(&chainSamplerName_)->default_value(chainSamplerName_),
+                "With --chains, sampler to use: 'metropolis' (steps as the 'ortho' proposal) or 'hmc' (Hamiltonian Monte Carlo with numerical gradients of the NLL)")
+        ("hmcSteps", boost::program_options::value<unsigned int>(&hmcSteps_)->default_value(hmcSteps_), "With --chainSampler hmc, number of leapfrog steps in each trajectory")
+        ("hmcStepSize", boost::program_options::value<float>(&hmcStepSize_)->default_value(hmcStepSize_),
+                "With --chainSampler hmc, initial leapfrog step size, in units of the range of each parameter divided by --propHelperWidthRangeDivisor. It is adapted during the first --burnInSteps steps")
         ("discreteModelPoints",
                 boost::program_options::value<std::vector<std::string> >(&discreteModelPoints_)->multitoken(),
                 "Define multiple points in a subset of the POI space among which to step discretely (works only with ortho and test proposals)");
@@ -125,6 +153,11 @@ void MarkovChainMC::applyOptions(const boost::program_options::variables_map &vm
     readChains_  = vm.count("readChains");
 
     if (mergeChains_ && !saveChain_ && !readChains_) chains_.SetOwner(true);
+    if (nChains_ > 0 && !discreteModelPoints_.empty()) throw std::invalid_argument("MarkovChainMC: --discreteModelPoints is not supported with --chains");
+    if (nChains_ > 0 && checkEvery_ == 0) throw std::invalid_argument("MarkovChainMC: --checkEvery must be positive");
+    if      (chainSamplerName_ == "metropolis") hmc_ = false;
+    else if (chainSamplerName_ == "hmc")        hmc_ = true;
+    else throw std::invalid_argument("MarkovChainMC: unsupported --chainSampler "+chainSamplerName_);
 }
 
 bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
@@ -142,6 +175,17 @@ bool MarkovChainMC::run(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::
   modelNDF_ = mc_s->GetParametersOfInterest()->getSize(); 
   if (withSystematics) modelNDF_ += mc_s->GetNuisanceParameters()->getSize();
 
+  if (nChains_ > 0 && !readChains_) {
+      bool ok = runChains(w, mc_s, data, limit, limitErr, hint);
+      coutSentry.clear();
+      if (ok && verbose >= 0) {
+          RooRealVar *r = dynamic_cast<RooRealVar *>(mc_s->GetParametersOfInterest()->first());
+          std::cout << "\n -- MarkovChainMC -- " << "\n";
+          std::cout << "Limit: " << r->GetName() <<" < " << limit << " +/- " << limitErr << " @ " << cl * 100 << "% credibility (" << nChains_ << " chains)" << std::endl;
+      }
+      return ok;
+  }
+
   double suma = 0; int num = 0;
   double savhint = (hint ? *hint : -1); const double *thehint = hint;
   std::vector<double> limits;
@@ -330,6 +374,7 @@ int MarkovChainMC::runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
       //RooStats::MarkovChain *chain = new RooStats::MarkovChain(*mcInt->GetChain());
       RooStats::MarkovChain *chain = slimChain(*mc_s->GetParametersOfInterest(), *mcInt->GetChain());
       if (mergeChains_) chains_.Add(chain);
+      if (saveChain_)  Combine::syncOutput();
       if (saveChain_)  writeToysHere->WriteTObject(chain,  TString::Format("MarkovChain_mh%g_%u",mass_, RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1)));
       return chain->Size();
   } else {
@@ -337,6 +382,333 @@ int MarkovChainMC::runOnce(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStat
   }
 }
 
+bool MarkovChainMC::runChains(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooAbsData &data, double &limit, double &limitErr, const double *hint) {
+  RooArgList poi(*mc_s->GetParametersOfInterest());
+  RooRealVar *r = dynamic_cast<RooRealVar *>(poi.first());
+  if ((hint != 0) && (*hint > r->getMin())) {
+    r->setMax(hintSafetyFactor_*(*hint));
+  }
+  if (withSystematics && (mc_s->GetNuisanceParameters() == 0)) {
+    throw std::logic_error("MarkovChainMC: running with systematics enabled, but nuisance parameters not defined.");
+  }
+  w->loadSnapshot("clean");
+
+  // the chains are run over the same nll as the fits, so they get all the caching and optimizations of CachingSimNLL
+  std::unique_ptr<RooAbsReal> nll = combineCreateNLL(*mc_s->GetPdf(), data, withSystematics ? mc_s->GetNuisanceParameters() : nullptr, /*offset=*/false);
+  RooAbsPdf *prior = dynamic_cast<RooUniform*>(mc_s->GetPriorPdf()) ? nullptr : mc_s->GetPriorPdf();
+
+  // floating parameters to step: first the POIs, then the nuisances
+  RooArgList params;
+  for (RooAbsArg *a : poi) {
+    RooRealVar *v = dynamic_cast<RooRealVar *>(a);
+    if (v && !v->isConstant()) params.add(*v);
+  }
+  int npoi = params.getSize();
+  if (npoi == 0) throw std::logic_error("MarkovChainMC: no floating parameter of interest");
+  if (withSystematics) {
+    for (RooAbsArg *a : *mc_s->GetNuisanceParameters()) {
+      RooRealVar *v = dynamic_cast<RooRealVar *>(a);
+      if (v && !v->isConstant()) params.add(*v);
+    }
+  }
+  int npar = params.getSize();
+  double divisor = 1./proposalHelperWidthRangeDivisor_, poiDivisor = divisor;
+  if (alwaysStepPoi_ && npoi > 1) poiDivisor /= sqrt(double(npoi));
+
+  // each chain has its own random number stream, seeded from the global one so that -s still makes the job reproducible
+  struct Chain {
+      std::unique_ptr<TRandom3> rnd;
+      utils::CheapValueSnapshot state;
+      double nll;
+      unsigned int accepted;
+      std::unique_ptr<RooStats::MarkovChain> chain;
+      double eps;                 // hmc step size
+      std::vector<double> grad;   // hmc gradient at the current point
+  };
+  std::vector<Chain> chains(nChains_);
+  std::vector<std::vector<double> > traces(nChains_);
+  RooArgSet poiSet(*mc_s->GetParametersOfInterest());
+  auto nllAndPrior = [&]() -> double {
+      double ret = nll->getVal();
+      if (prior) ret -= std::log(prior->getVal());
+      return ret;
+  };
+  // hmc works in the parameters divided by the width of the steps of the metropolis sampler,
+  // and needs the gradient of the nll with respect to those (from central differences)
+  std::vector<double> scale(npar);
+  for (int k = 0; k < npar; ++k) {
+      RooRealVar *var = static_cast<RooRealVar *>(params.at(k));
+      scale[k] = (var->getMax() - var->getMin()) * divisor;
+  }
+  auto gradient = [&](std::vector<double> &g) {
+      g.resize(npar);
+      for (int k = 0; k < npar; ++k) {
+          RooRealVar *var = static_cast<RooRealVar *>(params.at(k));
+          double x = var->getVal(), h = 1e-3 * scale[k];
+          double hi = std::min(x + h, var->getMax()), lo = std::max(x - h, var->getMin());
+          var->setVal(hi); double fhi = nllAndPrior();
+          var->setVal(lo); double flo = nllAndPrior();
+          var->setVal(x);
+          g[k] = (hi > lo ? (fhi - flo)/(hi - lo) : 0) * scale[k];
+      }
+  };
+  for (unsigned int c = 0; c < nChains_; ++c) {
+      Chain &ch = chains[c];
+      ch.rnd.reset(new TRandom3(RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1) + 1));
+      w->loadSnapshot("clean");
+      // start the chains spread over the range of the POIs, as needed for R-hat to be meaningful
+      for (int i = 0; i < npoi; ++i) {
+          RooRealVar *v = static_cast<RooRealVar *>(params.at(i));
+          v->setVal(v->getMin() + ch.rnd->Uniform() * (v->getMax() - v->getMin()));
+      }
+      ch.state.readFrom(params);
+      ch.nll = nllAndPrior();
+      ch.accepted = 0;
+      ch.eps = hmcStepSize_;
+      if (hmc_) gradient(ch.grad);
+      ch.chain.reset(new RooStats::MarkovChain(TString::Format("MarkovChain_%u", c), "", poiSet));
+      traces[c].reserve(iterations_);
+  }
+
+  std::vector<double> oldVals(npar), momentum(npar), newGrad(npar);
+  std::vector<int> stepped;
+  auto metropolisStep = [&](Chain &ch) {
+      int j = floor(ch.rnd->Uniform() * npar);
+      stepped.clear();
+      for (int k = 0; k < npar; ++k) {
+          bool isPoi = (k < npoi);
+          if (isPoi ? !(alwaysStepPoi_ || k == j) : (k != j)) continue;
+          RooRealVar *var = static_cast<RooRealVar *>(params.at(k));
+          stepped.push_back(k);
+          oldVals[k] = var->getVal();
+          double val = var->getVal(), max = var->getMax(), min = var->getMin(), len = max - min;
+          val += ch.rnd->Gaus() * len * (isPoi && alwaysStepPoi_ ? poiDivisor : divisor);
+          while (val > max) val -= len;
+          while (val < min) val += len;
+          var->setVal(val);
+      }
+      double newNll = nllAndPrior();
+      if (std::isfinite(newNll) && std::log(ch.rnd->Uniform()) < ch.nll - newNll) {
+          ch.nll = newNll;
+          ch.accepted++;
+      } else {
+          for (int k : stepped) static_cast<RooRealVar *>(params.at(k))->setVal(oldVals[k]);
+      }
+  };
+  auto hmcStep = [&](Chain &ch, bool adapt) {
+      double h0 = ch.nll;
+      for (int k = 0; k < npar; ++k) {
+          oldVals[k] = static_cast<RooRealVar *>(params.at(k))->getVal();
+          momentum[k] = ch.rnd->Gaus();
+          h0 += 0.5*momentum[k]*momentum[k];
+      }
+      // jitter the step size a bit, to avoid periodic trajectories
+      double eps = ch.eps * (0.8 + 0.4*ch.rnd->Uniform());
+      newGrad = ch.grad;
+      for (unsigned int l = 0; l < hmcSteps_; ++l) {
+          for (int k = 0; k < npar; ++k) {
+              RooRealVar *var = static_cast<RooRealVar *>(params.at(k));
+              momentum[k] -= 0.5 * eps * newGrad[k];
+              double u = var->getVal()/scale[k] + eps * momentum[k];
+              double umin = var->getMin()/scale[k], umax = var->getMax()/scale[k];
+              // reflect at the boundaries of the parameter
+              for (int t = 0; t < 10 && (u < umin || u > umax); ++t) {
+                  u = (u > umax ? 2*umax - u : 2*umin - u);
+                  momentum[k] = -momentum[k];
+              }
+              var->setVal(std::max(umin, std::min(umax, u)) * scale[k]);
+          }
+          gradient(newGrad);
+          for (int k = 0; k < npar; ++k) momentum[k] -= 0.5 * eps * newGrad[k];
+      }
+      double newNll = nllAndPrior(), h1 = newNll;
+      for (int k = 0; k < npar; ++k) h1 += 0.5*momentum[k]*momentum[k];
+      double acceptProb = std::isfinite(h1) ? std::min(1.0, std::exp(h0 - h1)) : 0.0;
+      if (ch.rnd->Uniform() < acceptProb) {
+          ch.nll = newNll;
+          ch.grad = newGrad;
+          ch.accepted++;
+      } else {
+          for (int k = 0; k < npar; ++k) static_cast<RooRealVar *>(params.at(k))->setVal(oldVals[k]);
+      }
+      // during the burn-in, move the step size towards an acceptance probability of 0.65
+      if (adapt) ch.eps *= std::exp(0.1 * (acceptProb - 0.65));
+  };
+
+  // one job for each chain, which runs a block of steps in a child and writes the points into its scratch file.
+  // The parent adds them to the chain and sets the chain where the child left it. Each chain draws a seed for
+  // each block from its own stream, so the chains don't depend on the number of processes
+  auto runBlockWithFork = [&](unsigned int nstep, unsigned int steps) {
+      std::vector<UInt_t> seeds(nChains_);
+      for (unsigned int c = 0; c < nChains_; ++c) seeds[c] = chains[c].rnd->Integer(std::numeric_limits<UInt_t>::max() - 1) + 1;
+      ForkedJobs jobs("chain", nChains_, chainsFork_);
+      jobs.run([&](unsigned int c, FILE *out) {
+          Chain &ch = chains[c];
+          ch.rnd->SetSeed(seeds[c]);
+          ch.state.writeTo(params);
+          FILE *points = fopen(jobs.file(c, ".txt").c_str(), "w");
+          if (points == nullptr) throw std::runtime_error(Form("Can't write the points of chain %u", c));
+          for (unsigned int i = 0; i < nstep; ++i) {
+              if (hmc_) hmcStep(ch, steps + i < burnInSteps_);
+              else metropolisStep(ch);
+              for (RooAbsArg *a : poiSet) fprintf(points, "%.17g ", static_cast<RooRealVar *>(a)->getVal());
+              fprintf(points, "%.17g\n", ch.nll);
+          }
+          fclose(points);
+          fprintf(out, "%.17g %u %.17g", ch.nll, ch.accepted, ch.eps);
+          for (int k = 0; k < npar; ++k) fprintf(out, " %.17g", static_cast<RooRealVar *>(params.at(k))->getVal());
+          for (double g : ch.grad) fprintf(out, " %.17g", g);
+      });
+      for (unsigned int c = 0; c < nChains_; ++c) {
+          Chain &ch = chains[c];
+          // a chain that did not complete its block can't go on, nor be merged with the others
+          std::vector<double> vals(3 + npar + ch.grad.size());
+          const char *line = jobs.result(c).c_str();
+          unsigned int nread = 0;
+          for (int pos = 0; nread < vals.size() && sscanf(line, "%lg%n", &vals[nread], &pos) == 1; ++nread) line += pos;
+          FILE *points = jobs.done(c) && nread == vals.size() ? fopen(jobs.file(c, ".txt").c_str(), "r") : nullptr;
+          if (points == nullptr) {
+              throw std::runtime_error(Form("MarkovChainMC: chain %u did not complete its block of steps (process %u)", c, jobs.child(c)));
+          }
+          for (unsigned int i = 0; i < nstep; ++i) {
+              double v, nllVal;
+              bool ok = true;
+              for (RooAbsArg *a : poiSet) {
+                  ok = ok && fscanf(points, "%lg", &v) == 1;
+                  static_cast<RooRealVar *>(a)->setVal(v);
+              }
+              if (!ok || fscanf(points, "%lg", &nllVal) != 1) {
+                  fclose(points);
+                  throw std::runtime_error(Form("MarkovChainMC: the points of chain %u are truncated (process %u)", c, jobs.child(c)));
+              }
+              ch.chain->Add(poiSet, nllVal, 1.0);
+              traces[c].push_back(r->getVal());
+          }
+          fclose(points);
+          ch.nll = vals[0];
+          ch.accepted = vals[1];
+          ch.eps = vals[2];
+          std::copy(vals.begin() + 3 + npar, vals.end(), ch.grad.begin());
+          for (int k = 0; k < npar; ++k) static_cast<RooRealVar *>(params.at(k))->setVal(vals[3 + k]);
+          ch.state.readFrom(params);
+      }
+  };
+
+  auto startTime = std::chrono::steady_clock::now();
+  unsigned int steps = 0;
+  double rhat = 0, ess = 0;
+  while (steps < iterations_) {
+      unsigned int nstep = std::min(checkEvery_, iterations_ - steps);
+      if (chainsFork_) {
+          runBlockWithFork(nstep, steps);
+      } else {
+          // run each chain for a block of steps, so that the caches of the nll are reused between consecutive steps
+          for (unsigned int c = 0; c < nChains_; ++c) {
+              Chain &ch = chains[c];
+              ch.state.writeTo(params);
+              for (unsigned int i = 0; i < nstep; ++i) {
+                  if (hmc_) hmcStep(ch, steps + i < burnInSteps_);
+                  else metropolisStep(ch);
+                  ch.chain->Add(poiSet, ch.nll, 1.0);
+                  traces[c].push_back(r->getVal());
+              }
+              ch.state.readFrom(params);
+          }
+      }
+      steps += nstep;
+      int burnIn = max<int>(burnInSteps_, steps * burnInFraction_);
+      if (int(steps) < burnIn + 2) continue;
+      rhat = gelmanRubin(traces, burnIn);
+      ess  = effectiveSampleSize(traces, burnIn);
+      if (verbose > 1) std::cout << "After " << steps << " steps of " << nChains_ << " chains: R-hat " << rhat << ", effective sample size " << ess << std::endl;
+      if ((nChains_ == 1 || rhat < rHatTarget_) && ess > essTarget_) break;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  if (verbose > 0) {
+      std::cout << "Ran " << nChains_ << " " << chainSamplerName_ << " chains for " << steps << " steps each: R-hat " << rhat << ", effective sample size " << ess
+                << " (" << (seconds > 0 ? ess/seconds : 0.) << " effective samples per second)" << std::endl;
+      if (nChains_ > 1 && rhat >= rHatTarget_) std::cout << "WARNING: the chains did not reach R-hat < " << rHatTarget_ << std::endl;
+  }
+
+  int burnIn = max<int>(burnInSteps_, steps * burnInFraction_);
+  if (int(steps) <= burnIn) return false;
+  std::vector<double> limits;
+  RooStats::MarkovChain merged("Merged", "", poiSet);
+  for (unsigned int c = 0; c < nChains_; ++c) {
+      RooStats::MarkovChain &chain = *chains[c].chain;
+      double mylim, myerr;
+      limitFromChain(mylim, myerr, poiSet, chain, burnIn);
+      limits.push_back(mylim);
+      if (verbose > 1) std::cout << "Limit from chain " << c << ": " << mylim << " (acceptance " << chains[c].accepted/double(steps) << ")" << std::endl;
+      for (int i = burnIn, n = chain.Size(); i < n; ++i) {
+          RooArgSet point(*chain.Get(i));
+          merged.Add(point, chain.NLL(), chain.Weight());
+      }
+      if (saveChain_) Combine::syncOutput();
+      if (saveChain_) writeToysHere->WriteTObject(&chain, TString::Format("MarkovChain_mh%g_%u",mass_, RooRandom::integer(std::numeric_limits<UInt_t>::max() - 1)));
+  }
+  limitAndError(limit, limitErr, limits);
+  if (verbose > 0) std::cout << "Limit from averaging the chains: " << limit << " +/- " << limitErr << std::endl;
+  double spread = limitErr;
+  limitFromChain(limit, limitErr, poiSet, merged, 0);
+  limitErr = spread;
+  w->loadSnapshot("clean");
+  return true;
+}
+
+double MarkovChainMC::gelmanRubin(const std::vector<std::vector<double> > &traces, int first) {
+  int m = traces.size(), n = traces.front().size() - first;
+  if (m < 2 || n < 2) return std::numeric_limits<double>::infinity();
+  std::vector<double> mean(m, 0.);
+  double w = 0, meanAll = 0;
+  for (int j = 0; j < m; ++j) {
+      for (int i = first, e = traces[j].size(); i < e; ++i) mean[j] += traces[j][i];
+      mean[j] /= n;
+      double var = 0;
+      for (int i = first, e = traces[j].size(); i < e; ++i) var += (traces[j][i]-mean[j])*(traces[j][i]-mean[j]);
+      w += var/(n-1);
+      meanAll += mean[j];
+  }
+  w /= m; meanAll /= m;
+  double b = 0;
+  for (int j = 0; j < m; ++j) b += (mean[j]-meanAll)*(mean[j]-meanAll);
+  b *= n/double(m-1);
+  if (w <= 0) return (b > 0 ? std::numeric_limits<double>::infinity() : 1.0);
+  double varHat = (n-1)/double(n) * w + b/n;
+  return std::sqrt(varHat/w);
+}
+
+double MarkovChainMC::effectiveSampleSize(const std::vector<std::vector<double> > &traces, int first) {
+  // batch means: the variance of the means of batches of b points is var/b for independent points,
+  // and larger by the integrated autocorrelation time otherwise. The batches are compared to the
+  // overall mean, so that chains that disagree also reduce the effective size.
+  int m = traces.size(), n = traces.front().size() - first;
+  int b = std::floor(std::sqrt(double(n))), nb = (b > 0 ? n/b : 0);
+  if (nb < 2) return 0;
+  double meanAll = 0, var = 0;
+  int ntot = 0;
+  for (int j = 0; j < m; ++j) {
+      for (int i = first; i < first + nb*b; ++i) { meanAll += traces[j][i]; ++ntot; }
+  }
+  meanAll /= ntot;
+  double varBatch = 0;
+  for (int j = 0; j < m; ++j) {
+      for (int k = 0; k < nb; ++k) {
+          double bmean = 0;
+          for (int i = first + k*b; i < first + (k+1)*b; ++i) {
+              bmean += traces[j][i];
+              var += (traces[j][i]-meanAll)*(traces[j][i]-meanAll);
+          }
+          bmean /= b;
+          varBatch += (bmean-meanAll)*(bmean-meanAll);
+      }
+  }
+  var /= (ntot-1);
+  varBatch /= (m*nb-1);
+  if (varBatch <= 0) return ntot;
+  return std::min<double>(ntot, ntot * var / (b * varBatch));
+}
+
 void MarkovChainMC::limitAndError(double &limit, double &limitErr, const std::vector<double> &limitsIn) const {
   std::vector<double> limits(limitsIn);
   int num = limits.size();
@@ -0,0 +1,101 @@
+#include "../interface/MinimizerTelemetry.h"
+#include "../interface/CachingNLL.h"
+#include "../interface/CascadeMinimizer.h"
+
+#include <RooRealVar.h>
+#include <TString.h>
+
+#include <cmath>
+#include <stdexcept>
+
+MinimizerTelemetry & MinimizerTelemetry::instance()
+{
+    static MinimizerTelemetry telemetry;
+    return telemetry;
+}
+
+void MinimizerTelemetry::open(const std::string &fileName)
+{
+    if (out_.is_open()) out_.close();
+    out_.open(fileName.c_str(), std::ios_base::out);
+    if (!out_.is_open()) throw std::runtime_error("MinimizerTelemetry: cannot open "+fileName+" for writing");
+}
+
+long MinimizerTelemetry::nllCalls(const RooAbsReal &nll)
+{
+    const cacheutils::CachingSimNLL *simnll = dynamic_cast<const cacheutils::CachingSimNLL *>(&nll);
+    return simnll ? long(simnll->evalCount()) : -1;
+}
+
+std::string MinimizerTelemetry::escape(const std::string &str)
+{
+    std::string ret;
+    for (char c : str) {
+        if (c == '"' || c == '\\') ret += '\\';
+        ret += c;
+    }
+    return ret;
+}
+
+MinimizerTelemetry::Call * MinimizerTelemetry::Call::current()
+{
+    MinimizerTelemetry &t = instance();
+    return t.open_.empty() ? nullptr : t.open_.back();
+}
+
+MinimizerTelemetry::Call::Call(const char *what, const RooAbsReal &nll) :
+    active_(instance().enabled()),
+    nll_(&nll),
+    id_(0), parent_(0), depth_(0),
+    nllCallsStart_(-1), nllCallsLast_(-1),
+    ok_(false)
+{
+    if (!active_) return;
+    MinimizerTelemetry &t = instance();
+    what_ = what;
+    nllName_ = nll.GetName();
+    id_ = ++t.nCalls_;
+    parent_ = t.open_.empty() ? 0 : t.open_.back()->id_;
+    depth_ = t.open_.size();
+    start_ = last_ = std::chrono::steady_clock::now();
+    nllCallsStart_ = nllCallsLast_ = nllCalls(nll);
+    t.open_.push_back(this);
+}
+
+void MinimizerTelemetry::Call::stage(const std::string &name, int strategy, double tolerance, int status, double edm)
+{
+    if (!active_) return;
+    auto now = std::chrono::steady_clock::now();
+    long calls = nllCalls(*nll_);
+    if (!stages_.empty()) stages_ += ",";
+    stages_ += Form("{\"name\":\"%s\",\"strategy\":%d,\"tolerance\":%g,\"status\":%d,", escape(name).c_str(), strategy, tolerance, status);
+    stages_ += std::isfinite(edm) ? std::string(Form("\"edm\":%g,", edm)) : std::string("\"edm\":null,");
+    stages_ += Form("\"time\":%.4f,\"nllCalls\":%ld}", std::chrono::duration<double>(now - last_).count(), calls >= 0 ? calls - nllCallsLast_ : -1L);
+    last_ = now; nllCallsLast_ = calls;
+}
+
+MinimizerTelemetry::Call::~Call()
+{
+    if (!active_) return;
+    MinimizerTelemetry &t = instance();
+    // calls are nested, so this is the last one opened
+    if (!t.open_.empty() && t.open_.back() == this) t.open_.pop_back();
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    long calls = nllCalls(*nll_);
+    std::string poi;
+    for (RooAbsArg *a : CascadeMinimizerGlobalConfigs::O().parametersOfInterest) {
+        RooRealVar *rrv = dynamic_cast<RooRealVar *>(a);
+        if (rrv == 0) continue;
+        if (!poi.empty()) poi += ",";
+        poi += Form("\"%s\":%g", escape(rrv->GetName()).c_str(), rrv->getVal());
+    }
+    t.out_ << Form("{\"id\":%lu,\"parent\":%lu,\"depth\":%d,\"call\":\"%s\",\"nll\":\"%s\",\"ok\":%s,\"time\":%.4f,\"nllCalls\":%ld,",
+                   id_, parent_, depth_, what_.c_str(), escape(nllName_).c_str(), ok_ ? "true" : "false", time, calls >= 0 ? calls - nllCallsStart_ : -1L);
+    // only the value left by the last evaluation: the record must not evaluate the NLL itself
+    if (!nll_->isValueDirty()) {
+        double nllValue = nll_->getVal();
+        if (std::isfinite(nllValue)) t.out_ << Form("\"nllValue\":%.6f,", nllValue);
+    }
+    t.out_ << "\"fallback\":" << (fallback_.empty() ? std::string("null") : "\""+escape(fallback_)+"\"");
+    t.out_ << ",\"poi\":{" << poi << "},\"stages\":[" << stages_ << "]}" << std::endl;
+}
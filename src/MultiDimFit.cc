@@ -1,6 +1,8 @@
 #include "../interface/MultiDimFit.h"
 #include <stdexcept>
 #include <cmath>
+#include <cstdio>
+#include <limits>
 
 #include "TMath.h"
 #include "TFile.h"
@@ -20,6 +22,7 @@
 #include "../interface/ProfilingTools.h"
 #include "../interface/RandStartPt.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/ForkedJobs.h"
 
 #include <Math/Minimizer.h>
 #include <Math/MinimizerOptions.h>
@@ -84,6 +87,9 @@ std::vector<float>        MultiDimFit::specifiedVals_;
 RooArgList                MultiDimFit::specifiedList_;
 bool MultiDimFit::saveInactivePOI_= false;
 bool MultiDimFit::skipDefaultStart_ = false;
+bool MultiDimFit::impactWarmStart_ = false;
+bool MultiDimFit::approxImpacts_ = false;
+unsigned int MultiDimFit::impactFork_ = 0;
 
 MultiDimFit::MultiDimFit() :
     FitterAlgoBase("MultiDimFit specific options")
@@ -118,6 +124,9 @@ MultiDimFit::MultiDimFit() :
         ("robustHesseSave",  boost::program_options::value<std::string>(&robustHesseSave_)->default_value(robustHesseSave_),  "Save the calculated Hessian")
         ("pointsRandProf",  boost::program_options::value<int>(&pointsRandProf_)->default_value(pointsRandProf_),  "Number of random start points to try for the profiled POIs")
         ("randPointsSeed",  boost::program_options::value<int>(&randPointsSeed_)->default_value(randPointsSeed_),  "Seed to use when generating random start points to try for the profiled POIs")
+        ("impactWarmStart",  boost::program_options::value<bool>(&impactWarmStart_)->default_value(impactWarmStart_),  "With --algo impact, start the fits at each parameter -/+ 1 sigma from the prediction of the covariance matrix of the best fit, instead of from the best fit")
+        ("approxImpacts",  "With --algo impact, take the impacts from the covariance matrix of the best fit (Hesse) without doing the fits")
+        ("impactFork",  boost::program_options::value<unsigned int>(&impactFork_)->default_value(impactFork_),  "With --algo impact, split the fits of the parameters (up and down separately) among N forked processes (0 by default == no forking)")
         ("setParameterRandomInitialValueRanges",  boost::program_options::value<std::string>(&setParameterRandomInitialValueRanges_)->default_value(""),  "Range from which to draw random start points for the profiled POIs. This range should be equal to or smaller than the max and min values for the profiled POIs. Does not override max/min ranges for the given POIs. E.g. usage: c1=-5,5:c2=-1,1")
         ;
 }
@@ -163,6 +172,8 @@ void MultiDimFit::applyOptions(const boost::program_options::variables_map &vm)
     massName_ = vm["massName"].as<std::string>();
     toyName_ = vm["toyName"].as<std::string>();
     saveFitResult_ = (vm.count("saveFitResult") > 0);
+    approxImpacts_ = (vm.count("approxImpacts") > 0);
+    if (approxImpacts_ && algo_ != Impact) throw std::invalid_argument("option 'approxImpacts' can only be used with --algo impact");
 }
 
 bool MultiDimFit::runSpecific(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooStats::ModelConfig *mc_b, RooAbsData &data, double &limit, double &limitErr, const double *hint) { 
@@ -200,7 +211,12 @@ bool MultiDimFit::runSpecific(RooWorkspace *w, RooStats::ModelConfig *mc_s, RooS
     bool doHesse = (algo_ == Singles || algo_ == Impact) || (saveFitResult_) ;
     if ( !skipInitialFit_){
         std::cout << "Doing initial fit: " << std::endl;
-        res.reset(doFit(pdf, data, (doHesse ? poiList_ : RooArgList()), constrainCmdArg, (saveFitResult_ && !robustHesse_), 1, true, false));
+        if (algo_ == Impact && (impactWarmStart_ || approxImpacts_)) {
+            // the impacts need the covariance matrix; the approximate ones don't need the uncertainties of the parameters from the crossings
+            res.reset(doFit(pdf, data, (approxImpacts_ ? RooArgList() : poiList_), constrainCmdArg, !robustHesse_, 1, true, approxImpacts_));
+        } else {
+            res.reset(doFit(pdf, data, (doHesse ? poiList_ : RooArgList()), constrainCmdArg, (saveFitResult_ && !robustHesse_), 1, true, false));
+        }
         if (!res.get()) {
             std::cout << "\n " <<std::endl;
             std::cout << "\n ---------------------------" <<std::endl;
@@ -528,19 +544,14 @@ void MultiDimFit::doImpact(RooFitResult &res, RooAbsReal &nll) {
   }
   printf("\n");
 
+  if (impactFork_ && !approxImpacts_) {
+    doImpactWithFork(res, nll, *params, init_snap);
+    return;
+  }
 
   for (int i = 0, n = poi_.size(); i < n; ++i) {
-    RooAbsArg *rfloat = res.floatParsFinal().find(poi_[i].c_str());
-    if (!rfloat) {
-      rfloat = res.constPars().find(poi_[i].c_str());
-    }
-    RooRealVar *rf = dynamic_cast<RooRealVar *>(rfloat);
-    double bestFitVal = rf->getVal();
-
-    double hiErr = +(rf->hasRange("err68") ? rf->getMax("err68") - bestFitVal
-                                           : rf->getAsymErrorHi());
-    double loErr = -(rf->hasRange("err68") ? rf->getMin("err68") - bestFitVal
-                                           : rf->getAsymErrorLo());
+    double bestFitVal, loErr, hiErr;
+    impactRange(res, i, bestFitVal, loErr, hiErr);
       printf("  %-*s : %+8.3f  %+6.3f/%+6.3f", len, poi_[i].c_str(),
                     bestFitVal, -loErr, hiErr);
     // Reset all parameters to initial state
@@ -555,9 +566,13 @@ void MultiDimFit::doImpact(RooFitResult &res, RooAbsReal &nll) {
     std::vector<double> doVals = {bestFitVal - loErr, bestFitVal + hiErr};
     for (unsigned x = 0; x < doVals.size(); ++x) {
       *params = snap;
+      bool ok = true;
+      if (impactWarmStart_ || approxImpacts_) {
+        ok = setLinearPrediction(res, *params, poi_[i], doVals[x] - bestFitVal);
+      }
       poiVals_[i] = doVals[x];
       poiVars_[i]->setVal(doVals[x]);
-      bool ok = minim.minimize(verbose - 1);
+      if (!approxImpacts_) ok = minim.minimize(verbose - 1);
       if (ok) {
         for (unsigned int j = 0; j < poiVars_.size(); j++) {
           poiVals_[j] = poiVars_[j]->getVal();
@@ -589,6 +604,119 @@ void MultiDimFit::doImpact(RooFitResult &res, RooAbsReal &nll) {
 }
 
 
+void MultiDimFit::impactRange(const RooFitResult &res, int i, double &bestFitVal, double &loErr, double &hiErr) {
+    RooAbsArg *rfloat = res.floatParsFinal().find(poi_[i].c_str());
+    if (!rfloat) {
+      rfloat = res.constPars().find(poi_[i].c_str());
+    }
+    RooRealVar *rf = dynamic_cast<RooRealVar *>(rfloat);
+    bestFitVal = rf->getVal();
+
+    hiErr = +(rf->hasRange("err68") ? rf->getMax("err68") - bestFitVal
+                                    : rf->getAsymErrorHi());
+    loErr = -(rf->hasRange("err68") ? rf->getMin("err68") - bestFitVal
+                                    : rf->getAsymErrorLo());
+    if (approxImpacts_) hiErr = loErr = rf->getError();
+}
+
+void MultiDimFit::doImpactWithFork(RooFitResult &res, RooAbsReal &nll, RooArgSet &params, const RooArgSet &init_snap) {
+  // one job for each side of each parameter: job 2*i is down, 2*i+1 is up
+  unsigned int njobs = 2*poi_.size();
+  ForkedJobs jobs("impact fit", njobs, impactFork_);
+  if (verbose) CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("Running the impact fits of %d parameters in %u processes",int(poi_.size()),jobs.children())),__func__);
+  std::vector<double> bestFitVals(poi_.size()), doVals(njobs);
+  std::vector<std::pair<double, double> > errs(poi_.size());
+  for (unsigned int i = 0; i < poi_.size(); ++i) {
+    impactRange(res, i, bestFitVals[i], errs[i].first, errs[i].second);
+    doVals[2*i] = bestFitVals[i] - errs[i].first;
+    doVals[2*i+1] = bestFitVals[i] + errs[i].second;
+  }
+  // each job returns whether the fit succeeded, and the values of the POIs, of the saved parameters, functions and indexes
+  unsigned int nvals = poiVars_.size() + specifiedVars_.size() + specifiedFunc_.size() + specifiedCat_.size();
+  jobs.run([&](unsigned int j, FILE *out) {
+    unsigned int i = j/2;
+    // every job starts from the initial fit, as the serial loop does for each side
+    params = init_snap;
+    poiVars_[i]->setConstant(true);
+    CascadeMinimizer minim(nll, CascadeMinimizer::Constrained);
+    if (impactWarmStart_) setLinearPrediction(res, params, poi_[i], doVals[j] - bestFitVals[i]);
+    poiVars_[i]->setVal(doVals[j]);
+    bool ok = minim.minimize(verbose - 1);
+    fprintf(out, "%d", ok ? 1 : 0);
+    for (RooRealVar *v : poiVars_) fprintf(out, " %.17g", v->getVal());
+    for (RooRealVar *v : specifiedVars_) fprintf(out, " %.17g", v->getVal());
+    for (RooAbsReal *f : specifiedFunc_) fprintf(out, " %.17g", f->getVal());
+    for (RooCategory *c : specifiedCat_) fprintf(out, " %d", c->getIndex());
+  });
+
+  std::vector<std::vector<double> > vals(njobs);
+  std::vector<bool> ok(njobs, false);
+  for (unsigned int j = 0; j < njobs; ++j) {
+    if (!jobs.done(j)) continue;
+    const char *line = jobs.result(j).c_str();
+    int jok, pos;
+    if (sscanf(line, "%d%n", &jok, &pos) != 1) continue;
+    line += pos;
+    std::vector<double> v(nvals);
+    unsigned int k = 0;
+    for (; k < nvals && sscanf(line, "%lg%n", &v[k], &pos) == 1; ++k) line += pos;
+    if (k < nvals) continue; // truncated line
+    vals[j].swap(v); ok[j] = jok;
+  }
+
+  // commit the fits and print the impacts in the order of the parameters; a fit whose results are missing leaves its impacts undetermined (NaN)
+  params = init_snap;
+  int len = 9;
+  for (int i = 0, n = poi_.size(); i < n; ++i) {
+    len = std::max<int>(len, poi_[i].length());
+  }
+  std::vector<float> specifiedVals = specifiedVals_;
+  for (unsigned int i = 0; i < poi_.size(); ++i) {
+    printf("  %-*s : %+8.3f  %+6.3f/%+6.3f", len, poi_[i].c_str(), bestFitVals[i], -errs[i].first, errs[i].second);
+    std::vector<float> impact[2] = { std::vector<float>(specifiedVals.size(), std::numeric_limits<float>::quiet_NaN()),
+                                     std::vector<float>(specifiedVals.size(), std::numeric_limits<float>::quiet_NaN()) };
+    for (unsigned int x = 0; x < 2; ++x) {
+      unsigned int j = 2*i + x;
+      if (vals[j].empty()) {
+        CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("The %s impact fit of %s did not complete (process %u): its impacts are left undetermined",
+                x == 0 ? "lower" : "upper", poi_[i].c_str(), jobs.child(j))),__func__);
+        continue;
+      }
+      const double *v = vals[j].data();
+      for (unsigned int k = 0; k < specifiedVals.size(); ++k) impact[x][k] = v[poiVars_.size() + k] - specifiedVals[k];
+      if (!ok[j]) continue;
+      for (unsigned int k = 0; k < poiVars_.size(); ++k) poiVals_[k] = *v++;
+      for (unsigned int k = 0; k < specifiedVars_.size(); ++k) specifiedVals_[k] = *v++;
+      for (unsigned int k = 0; k < specifiedFunc_.size(); ++k) specifiedFuncVals_[k] = *v++;
+      for (unsigned int k = 0; k < specifiedCat_.size(); ++k) specifiedCatVals_[k] = int(*v++);
+      Combine::commitPoint(true, /*quantile=*/0.32);
+    }
+    for (unsigned k = 0; k < specifiedVals.size(); ++k) {
+      printf("  %+6.3f/%+6.3f", impact[0][k], impact[1][k]);
+    }
+    printf("\n");
+  }
+}
+
+bool MultiDimFit::setLinearPrediction(const RooFitResult &res, RooArgSet &params, const std::string &name, double shift) {
+  // shift of the other parameters when this one is moved by shift and they are profiled, at first order: cov(k,i)/cov(i,i) * shift
+  const RooArgList &floats = res.floatParsFinal();
+  const TMatrixDSym &cov = res.covarianceMatrix();
+  int idx = floats.index(name.c_str());
+  if (idx < 0 || cov.GetNrows() != floats.getSize() || !(cov(idx, idx) > 0)) {
+    if (verbose > 0) CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("No covariance from the best fit for %s: starting from the best fit",name.c_str())),__func__);
+    return !approxImpacts_;
+  }
+  for (int k = 0, n = floats.getSize(); k < n; ++k) {
+    if (k == idx) continue;
+    RooRealVar *var = dynamic_cast<RooRealVar *>(params.find(floats.at(k)->GetName()));
+    if (var == 0 || var->isConstant()) continue;
+    double val = static_cast<RooRealVar *>(floats.at(k))->getVal() + cov(k, idx) / cov(idx, idx) * shift;
+    var->setVal(std::max(var->getMin(), std::min(var->getMax(), val)));
+  }
+  return true;
+}
+
 void MultiDimFit::doGrid(RooWorkspace *w, RooAbsReal &nll) 
 {
     unsigned int n = poi_.size();
@@ -1135,6 +1263,11 @@ void MultiDimFit::doBox(RooAbsReal &nll, double cl, const char *name, bool commi
         poiVars_[i]->setConstant(false);
     }
 
+    if (robustFitFork_) {
+        doBoxWithFork(nll, cl, name, commitPoints, nll0, threshold, p0);
+        return;
+    }
+
     verbose--; // reduce verbosity due to findCrossing
     for (unsigned int i = 0; i < n; ++i) {
         RooRealVar *xv = poiVars_[i];
@@ -1178,6 +1311,66 @@ void MultiDimFit::doBox(RooAbsReal &nll, double cl, const char *name, bool commi
     verbose++; // restore verbosity 
 }
 
+void MultiDimFit::doBoxWithFork(RooAbsReal &nll, double cl, const char *name, bool commitPoints, double nll0, double threshold, const std::vector<double> &p0) {
+    // one job for each side of each POI: job 2*i is the minimum, 2*i+1 the maximum
+    unsigned int n = poi_.size();
+    ForkedJobs jobs("crossing search", 2*n, robustFitFork_);
+    if (verbose) CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("Running the crossing searches of %u POIs in %u processes",n,jobs.children())),__func__);
+    std::unique_ptr<RooArgSet> params(nll.getParameters((const RooArgSet *)0));
+    RooArgSet start;
+    params->snapshot(start);
+
+    verbose--; // reduce verbosity due to findCrossing
+    // each job returns the crossing, the NLL and the values of the POIs where the search stopped
+    jobs.run([&](unsigned int j, FILE *out) {
+        // every job starts from the best fit, while the serial searches start from where the previous one stopped
+        *params = start;
+        RooRealVar *xv = poiVars_[j/2];
+        xv->setConstant(true);
+        CascadeMinimizer minimX(nll, CascadeMinimizer::Constrained);
+        if (!autoBoundsPOIs_.empty()) minimX.setAutoBounds(&autoBoundsPOISet_);
+        if (!autoMaxPOIs_.empty()) minimX.setAutoMax(&autoMaxPOISet_);
+        for (unsigned int k = 0; k < n; ++k) poiVars_[k]->setVal(p0[k]);
+        double x = findCrossing(minimX, nll, *xv, threshold, p0[j/2], j % 2 == 0 ? xv->getMin() : xv->getMax());
+        fprintf(out, "%.17g %.17g", x, nll.getVal());
+        for (unsigned int k = 0; k < n; ++k) fprintf(out, " %.17g", poiVars_[k]->getVal());
+    });
+    verbose++; // restore verbosity
+    *params = start;
+
+    // commit the points and set the ranges in the order of the serial searches
+    for (unsigned int i = 0; i < n; ++i) {
+        RooRealVar *xv = poiVars_[i];
+        double range[2] = { xv->getMin(), xv->getMax() };
+        for (unsigned int x = 0; x < 2; ++x) {
+            unsigned int j = 2*i + x;
+            const char *what = (x == 0 ? "Minimum" : "Maximum");
+            std::vector<double> v(n+2);
+            const char *line = jobs.result(j).c_str();
+            unsigned int k = 0;
+            for (int pos = 0; k < n+2 && sscanf(line, "%lg%n", &v[k], &pos) == 1; ++k) line += pos;
+            if (!jobs.done(j) || k < n+2) {
+                // the range is left at the boundary, as when the search fails
+                CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("The search of the %s of %s did not complete (process %u): the range is left at the boundary",
+                        x == 0 ? "minimum" : "maximum", xv->GetName(), jobs.child(j))),__func__);
+                continue;
+            }
+            for (k = 0; k < n; ++k) poiVals_[k] = v[k+2];
+            if (!std::isnan(v[0])) {
+                range[x] = v[0];
+                if (verbose > 0) CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("%s of %s at %.4f CL for all others floating is %.3f",what,xv->GetName(),cl,v[0])),__func__);
+                if (commitPoints) Combine::commitPoint(true, /*quantile=*/1-cl);
+            } else {
+                double prob = ROOT::Math::chisquared_cdf_c(2*(v[1] - nll0), n+nOtherFloatingPoi_);
+                if (commitPoints) Combine::commitPoint(true, /*quantile=*/prob);
+                if (verbose > 0) CombineLogger::instance().log("MultiDimFit.cc",__LINE__,std::string(Form("%s of %s at %.4f CL for all others floating is %.3f  (on the boundary, p-val %f)",what,xv->GetName(),cl,range[x],prob)),__func__);
+            }
+        }
+        xv->setRange(name, range[0], range[1]);
+        xv->setConstant(false);
+    }
+}
+
 void MultiDimFit::saveResult(RooFitResult &res) {
     if (verbose>2) res.Print();
     if (out_ == "none") return;
@@ -1,6 +1,7 @@
 #include "../interface/ProcessNormalization.h"
 
 #include "../interface/CombineMathFuncs.h"
+#include "../interface/ProcessNormalizationEngine.h"
 
 #include <cmath>
 #include <cassert>
@@ -11,7 +12,8 @@ ProcessNormalization::ProcessNormalization(const char *name, const char *title,
         nominalValue_(nominal),
         thetaList_("thetaList","List of nuisances for symmetric kappas", this), 
         asymmThetaList_("asymmThetaList","List of nuisances for asymmetric kappas", this), 
-        otherFactorList_("otherFactorList","Other multiplicative terms", this)
+        otherFactorList_("otherFactorList","Other multiplicative terms", this),
+        engineRow_(-1)
 { 
 }
 
@@ -28,12 +30,19 @@ ProcessNormalization::ProcessNormalization(const ProcessNormalization &other, co
         thetaList_("thetaList", this, other.thetaList_), 
         logAsymmKappa_(other.logAsymmKappa_),
         asymmThetaList_("asymmThetaList", this, other.asymmThetaList_), 
-        otherFactorList_("otherFactorList", this, other.otherFactorList_)
+        otherFactorList_("otherFactorList", this, other.otherFactorList_),
+        engineRow_(-1)
 {
 }
 
+ProcessNormalization::~ProcessNormalization()
+{
+    releaseEngineRow();
+}
+
 void ProcessNormalization::addLogNormal(double kappa, RooAbsReal &theta) {
     if (kappa != 0.0 && kappa != 1.0) {
+        releaseEngineRow();
         logKappa_.push_back(std::log(kappa));
         thetaList_.add(theta);
     }
@@ -43,6 +52,7 @@ void ProcessNormalization::addAsymmLogNormal(double kappaLo, double kappaHi, Roo
     if (fabs(kappaLo*kappaHi - 1) < 1e-5) {
         addLogNormal(kappaHi, theta);
     } else {
+        releaseEngineRow();
         logAsymmKappa_.push_back(std::make_pair(std::log(kappaLo), std::log(kappaHi)));
         asymmThetaList_.add(theta);
     }
@@ -55,8 +65,10 @@ void ProcessNormalization::addOtherFactor(RooAbsReal &factor) {
 void ProcessNormalization::fillAsymmKappaVecs() const
 {
     if (logAsymmKappaLow_.size() != logAsymmKappa_.size()) {
+       logAsymmKappaLow_.clear();
+       logAsymmKappaHigh_.clear();
        logAsymmKappaLow_.reserve(logAsymmKappa_.size());
-       logAsymmKappaLow_.reserve(logAsymmKappa_.size());
+       logAsymmKappaHigh_.reserve(logAsymmKappa_.size());
        for (auto [lo, hi] : logAsymmKappa_) {
           logAsymmKappaLow_.push_back(lo);
           logAsymmKappaHigh_.push_back(hi);
@@ -64,8 +76,48 @@ void ProcessNormalization::fillAsymmKappaVecs() const
     }
 }
 
+bool ProcessNormalization::registerWithEngine() const
+{
+    if (!ProcessNormalizationEngine::enabled()) return false;
+    fillAsymmKappaVecs();
+    std::vector<const RooAbsReal *> thetas, asymmThetas;
+    for (std::size_t i = 0; i < thetaList_.size(); ++i) {
+        thetas.push_back(&static_cast<RooAbsReal const&>(thetaList_[i]));
+    }
+    for (std::size_t i = 0; i < asymmThetaList_.size(); ++i) {
+        asymmThetas.push_back(&static_cast<RooAbsReal const&>(asymmThetaList_[i]));
+    }
+    engineRow_ = ProcessNormalizationEngine::instance().addProcess(thetas, logKappa_, asymmThetas, logAsymmKappaLow_, logAsymmKappaHigh_);
+    return true;
+}
+
+void ProcessNormalization::releaseEngineRow() const
+{
+    if (engineRow_ >= 0) {
+        ProcessNormalizationEngine::instance().removeProcess(engineRow_);
+        engineRow_ = -1;
+    }
+}
+
+bool ProcessNormalization::redirectServersHook(const RooAbsCollection &newServerList, bool mustReplaceAll, bool nameChange, bool isRecursiveStep)
+{
+    // the engine refers to the nuisances by address
+    releaseEngineRow();
+    return RooAbsReal::redirectServersHook(newServerList, mustReplaceAll, nameChange, isRecursiveStep);
+}
+
 Double_t ProcessNormalization::evaluate() const
 {
+    if (engineRow_ >= 0 || registerWithEngine()) {
+        // the log-normal terms come from the engine, shared by all the processes
+        double norm = nominalValue_;
+        norm *= ProcessNormalizationEngine::instance().value(engineRow_);
+        for (std::size_t i = 0; i < otherFactorList_.size(); ++i) {
+            norm *= static_cast<RooAbsReal const&>(otherFactorList_[i]).getVal();
+        }
+        return norm;
+    }
+
     thetaListVec_.resize(thetaList_.size());
     asymmThetaListVec_.resize(asymmThetaList_.size());
     otherFactorListVec_.resize(otherFactorList_.size());
@@ -0,0 +1,181 @@
+#include "../interface/ProcessNormalizationEngine.h"
+#include "../interface/ProfilingTools.h"
+#include "../interface/CombineMathFuncs.h"
+
+#include <algorithm>
+#include <cmath>
+
+ProcessNormalizationEngine & ProcessNormalizationEngine::instance()
+{
+    // never deleted: the ProcessNormalization objects owned by ROOT can be destroyed at exit after any static
+    static ProcessNormalizationEngine *engine = new ProcessNormalizationEngine();
+    return *engine;
+}
+
+bool ProcessNormalizationEngine::enabled()
+{
+    static bool engine = runtimedef::get("PROCNORM_ENGINE");
+    return engine;
+}
+
+unsigned int ProcessNormalizationEngine::column_(const RooAbsReal *theta)
+{
+    auto match = columns_.find(theta);
+    if (match != columns_.end()) return match->second;
+    unsigned int col;
+    if (!freeCols_.empty()) {
+        col = freeCols_.back();
+        freeCols_.pop_back();
+        thetas_[col] = theta;
+        thetaVals_[col] = theta->getVal();
+    } else {
+        col = thetas_.size();
+        thetas_.push_back(theta);
+        thetaVals_.push_back(theta->getVal());
+        colRows_.emplace_back();
+    }
+    columns_.emplace(theta, col);
+    return col;
+}
+
+unsigned int ProcessNormalizationEngine::addProcess(const std::vector<const RooAbsReal *> &thetas, const std::vector<double> &logKappas,
+                                                    const std::vector<const RooAbsReal *> &asymmThetas,
+                                                    const std::vector<double> &logKappasLow, const std::vector<double> &logKappasHigh)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (deadEntries_ > cols_.size() + asymmCols_.size() - deadEntries_) compact_();
+    unsigned int row;
+    if (!freeRows_.empty()) {
+        row = freeRows_.back();
+        freeRows_.pop_back();
+    } else {
+        row = rows_.size();
+        rows_.emplace_back();
+        values_.push_back(1.0);
+        stale_.push_back(0);
+    }
+    Row &r = rows_[row];
+    r.begin = cols_.size();
+    for (unsigned int i = 0, n = thetas.size(); i < n; ++i) {
+        cols_.push_back(column_(thetas[i]));
+        logKappa_.push_back(logKappas[i]);
+    }
+    r.end = cols_.size();
+    r.asymmBegin = asymmCols_.size();
+    for (unsigned int i = 0, n = asymmThetas.size(); i < n; ++i) {
+        asymmCols_.push_back(column_(asymmThetas[i]));
+        logKappaLow_.push_back(logKappasLow[i]);
+        logKappaHigh_.push_back(logKappasHigh[i]);
+    }
+    r.asymmEnd = asymmCols_.size();
+    // a nuisance can appear more than once for the same process, but the row is added only once to its column
+    for (unsigned int e = r.begin; e < r.end; ++e) {
+        if (colRows_[cols_[e]].empty() || colRows_[cols_[e]].back() != row) colRows_[cols_[e]].push_back(row);
+    }
+    for (unsigned int e = r.asymmBegin; e < r.asymmEnd; ++e) {
+        if (colRows_[asymmCols_[e]].empty() || colRows_[asymmCols_[e]].back() != row) colRows_[asymmCols_[e]].push_back(row);
+    }
+    stale_[row] = 0;
+    markStale_(row);
+    return row;
+}
+
+void ProcessNormalizationEngine::removeProcess(unsigned int row)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Row &r = rows_[row];
+    auto unlink = [this,row](unsigned int col) {
+        std::vector<unsigned int> &rows = colRows_[col];
+        if (rows.empty()) return; // already freed, when the nuisance appears more than once in the row
+        rows.erase(std::remove(rows.begin(), rows.end(), row), rows.end());
+        if (rows.empty()) {
+            // no process uses it anymore, and it may be deleted: forget it
+            columns_.erase(thetas_[col]);
+            thetas_[col] = nullptr;
+            freeCols_.push_back(col);
+        }
+    };
+    for (unsigned int e = r.begin; e < r.end; ++e) unlink(cols_[e]);
+    for (unsigned int e = r.asymmBegin; e < r.asymmEnd; ++e) unlink(asymmCols_[e]);
+    deadEntries_ += (r.end - r.begin) + (r.asymmEnd - r.asymmBegin);
+    r.begin = r.end = r.asymmBegin = r.asymmEnd = 0;
+    if (stale_[row]) {
+        staleRows_.erase(std::remove(staleRows_.begin(), staleRows_.end(), row), staleRows_.end());
+        stale_[row] = 0;
+    }
+    freeRows_.push_back(row);
+}
+
+void ProcessNormalizationEngine::compact_()
+{
+    std::vector<unsigned int> cols, asymmCols;
+    std::vector<double> logKappa, logKappaLow, logKappaHigh;
+    cols.reserve(cols_.size() - deadEntries_);
+    logKappa.reserve(cols_.size() - deadEntries_);
+    for (Row &r : rows_) {
+        unsigned int begin = cols.size();
+        cols.insert(cols.end(), cols_.begin() + r.begin, cols_.begin() + r.end);
+        logKappa.insert(logKappa.end(), logKappa_.begin() + r.begin, logKappa_.begin() + r.end);
+        r.begin = begin; r.end = cols.size();
+        unsigned int asymmBegin = asymmCols.size();
+        asymmCols.insert(asymmCols.end(), asymmCols_.begin() + r.asymmBegin, asymmCols_.begin() + r.asymmEnd);
+        logKappaLow.insert(logKappaLow.end(), logKappaLow_.begin() + r.asymmBegin, logKappaLow_.begin() + r.asymmEnd);
+        logKappaHigh.insert(logKappaHigh.end(), logKappaHigh_.begin() + r.asymmBegin, logKappaHigh_.begin() + r.asymmEnd);
+        r.asymmBegin = asymmBegin; r.asymmEnd = asymmCols.size();
+    }
+    cols_.swap(cols); asymmCols_.swap(asymmCols);
+    logKappa_.swap(logKappa); logKappaLow_.swap(logKappaLow); logKappaHigh_.swap(logKappaHigh);
+    deadEntries_ = 0;
+}
+
+void ProcessNormalizationEngine::markStale_(unsigned int row)
+{
+    if (!stale_[row]) {
+        stale_[row] = 1;
+        staleRows_.push_back(row);
+    }
+}
+
+void ProcessNormalizationEngine::sync_(const Row &row)
+{
+    auto update = [this](unsigned int col) {
+        double val = thetas_[col]->getVal();
+        if (val != thetaVals_[col]) {
+            thetaVals_[col] = val;
+            for (unsigned int r : colRows_[col]) markStale_(r);
+        }
+    };
+    for (unsigned int e = row.begin; e < row.end; ++e) update(cols_[e]);
+    for (unsigned int e = row.asymmBegin; e < row.asymmEnd; ++e) update(asymmCols_[e]);
+}
+
+void ProcessNormalizationEngine::recompute_()
+{
+    // same order of the sums as in RooFit::Detail::MathFuncs::processNormalization
+    unsigned int n = staleRows_.size();
+    logValues_.resize(n);
+    for (unsigned int i = 0; i < n; ++i) {
+        const Row &r = rows_[staleRows_[i]];
+        double logVal = 0.0;
+        for (unsigned int e = r.begin; e < r.end; ++e) logVal += thetaVals_[cols_[e]] * logKappa_[e];
+        for (unsigned int e = r.asymmBegin; e < r.asymmEnd; ++e) {
+            double x = thetaVals_[asymmCols_[e]];
+            logVal += x * RooFit::Detail::MathFuncs::logKappaForX(x, logKappaLow_[e], logKappaHigh_[e]);
+        }
+        logValues_[i] = logVal;
+    }
+    for (unsigned int i = 0; i < n; ++i) logValues_[i] = std::exp(logValues_[i]);
+    for (unsigned int i = 0; i < n; ++i) {
+        values_[staleRows_[i]] = logValues_[i];
+        stale_[staleRows_[i]] = 0;
+    }
+    staleRows_.clear();
+}
+
+double ProcessNormalizationEngine::value(unsigned int row)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    sync_(rows_[row]);
+    if (stale_[row]) recompute_();
+    return values_[row];
+}
@@ -8,6 +8,7 @@
 #include <unistd.h>
 
 #include <cassert>
+#include <mutex>
 #include <unordered_map>
 
 void (*igProfRequestDump_)(const char *);
@@ -54,18 +55,31 @@ void PerfCounter::printAll()
 namespace runtimedef {
     std::unordered_map<const char *, std::pair<int,int> > defines_;
     std::unordered_map<std::string,  int>                 definesByString_;
+    std::mutex                                            mutex_; // get() also inserts into the maps
     int get(const char *name) {
-        std::pair<int,int> & ret = defines_[name];
-        if (ret.second == 0) {
-            ret.first = definesByString_[name];
-            ret.second = 1;
+        // each thread keeps its own copy of the values it has read, so that only the first lookup of a name takes the lock
+        thread_local std::unordered_map<const char *, int> cache;
+        auto match = cache.find(name);
+        if (match != cache.end()) return match->second;
+        int value;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::pair<int,int> & ret = defines_[name];
+            if (ret.second == 0) {
+                ret.first = definesByString_[name];
+                ret.second = 1;
+            }
+            value = ret.first;
         }
-        return ret.first;
+        cache.emplace(name, value);
+        return value;
     }
     int get(const std::string & name) {
+        std::lock_guard<std::mutex> lock(mutex_);
         return definesByString_[name];
     }
     void set(const std::string & name, int value) {
+        std::lock_guard<std::mutex> lock(mutex_);
         definesByString_[name] = value;
     }
 }
@@ -1,14 +1,20 @@
 #include "../interface/RooSplineND.h"
 //#include </afs/cern.ch/work/n/nckw/combine-versions/102x/CMSSW_10_2_13/src/HiggsAnalysis/CombinedLimit/cpStudies/eigen/Eigen/Dense>
 #include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <algorithm>
+#include <stdexcept>
 
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
-RooSplineND::RooSplineND(const char *name, const char *title, RooArgList &vars, TTree *tree, const char *fName, double eps, bool rescale, std::string cutstring) :
+RooSplineND::RooSplineND(const char *name, const char *title, RooArgList &vars, TTree *tree, const char *fName, double eps, bool rescale, std::string cutstring, int kernel, double cutoff) :
   RooAbsReal(name,title),
-  vars_("vars","Variables", this)
+  vars_("vars","Variables", this),
+  kernel_(kernel),
+  cutoff_(cutoff)
 {
+  checkKernel();
   rescaleAxis = rescale;
   ndim_ = vars.getSize();
   int nentries  = tree->GetEntries();
@@ -21,7 +27,7 @@ RooSplineND::RooSplineND(const char *name, const char *title, RooArgList &vars,
   std::cout << "RooSplineND -- Num Dimensions == " << ndim_ <<std::endl;
   std::cout << "RooSplineND -- Num Samples    == " << M_ << std::endl;
 
-  float *b_map = new float(ndim_);
+  float *b_map = new float[ndim_];
 
   int it_c=0;
   for (RooAbsArg *rIt : vars) {
@@ -61,13 +67,15 @@ RooSplineND::RooSplineND(const char *name, const char *title, RooArgList &vars,
   axis_pts_ = TMath::Power(M_,1./ndim_);
   eps_= eps;
   calculateWeights(F_vec); 
-  delete b_map;	
+  delete [] b_map;	
 }
 
 //_____________________________________________________________________________
 // Copy Constructor
 RooSplineND::RooSplineND(const RooSplineND& other, const char *name) :
- RooAbsReal(other, name),vars_("vars",this,RooListProxy())
+ RooAbsReal(other, name),vars_("vars",this,RooListProxy()),
+ kernel_(other.kernel_),
+ cutoff_(other.cutoff_)
 {
   ndim_ = other.ndim_;
   M_    = other.M_;
@@ -105,9 +113,12 @@ RooSplineND::RooSplineND(const RooSplineND& other, const char *name) :
 // Clone Constructor
 
 RooSplineND::RooSplineND(const char *name, const char *title, const RooListProxy &vars, 
- int ndim, int M, double eps, bool rescale, std::vector<double> &w, std::map<int,std::vector<double> > &map, std::map<int,std::pair<double,double> > &rmap,double wmean, double wrms) :
- RooAbsReal(name, title),vars_("vars",this,RooListProxy()) 
+ int ndim, int M, double eps, bool rescale, std::vector<double> &w, std::map<int,std::vector<double> > &map, std::map<int,std::pair<double,double> > &rmap,double wmean, double wrms, int kernel, double cutoff) :
+ RooAbsReal(name, title),vars_("vars",this,RooListProxy()),
+ kernel_(kernel),
+ cutoff_(cutoff)
 {
+  checkKernel();
   vars_.add(vars);
   ndim_ = ndim;
   M_    = M;
@@ -191,27 +202,61 @@ void RooSplineND::calculateWeights(std::vector<double> &f){
 	return;
   }
   
-  MatrixXd fMatrix(M_,M_);
-  for (int i=0;i<M_;i++){
-    fMatrix(i,i)=1.;
-    for (int j=i+1;j<M_;j++){
-        double d2  = getDistSquare(i,j);
-	if (d2 < 0.0001) {
-		std::cout << " ERROR  - points likely duplicated, which will lead to errors in solving for weights. \
-		The distance^2 is smaller than 0.0001 for points "<< i << " and " << j << " ... " <<  std::endl;
-		printPoint(i);
-		printPoint(j);
-	}
-	double rad = radialFunc(d2,eps_);
-        fMatrix(i,j) =  rad;
-	fMatrix(j,i) =  rad; // it is symmetric	
-    }
-  }
-  
   VectorXd weights(M_);
   for (int i=0;i<M_;i++) weights(i)=f[i];
-  
-  VectorXd x = fMatrix.colPivHouseholderQr().solve(weights);
+  VectorXd x;
+
+  if (kernel_ == Gaussian) {
+    MatrixXd fMatrix(M_,M_);
+    for (int i=0;i<M_;i++){
+      fMatrix(i,i)=1.;
+      for (int j=i+1;j<M_;j++){
+          double d2  = getDistSquare(i,j);
+  	if (d2 < 0.0001) {
+  		std::cout << " ERROR  - points likely duplicated, which will lead to errors in solving for weights. \
+  		The distance^2 is smaller than 0.0001 for points "<< i << " and " << j << " ... " <<  std::endl;
+  		printPoint(i);
+  		printPoint(j);
+  	}
+  	double rad = radialFunc(d2,eps_);
+          fMatrix(i,j) =  rad;
+  	fMatrix(j,i) =  rad; // it is symmetric	
+      }
+    }
+    x = fMatrix.colPivHouseholderQr().solve(weights);
+  } else {
+    // only the pairs of points within the support of the kernel are non-zero
+    buildIndex();
+    double cutoff = (kernel_ == TruncatedGaussian ? cutoff_ : -1);
+    std::vector<Eigen::Triplet<double> > elements;
+    for (int i=0;i<M_;i++){
+      forEachNeighbour(&pts_[i*ndim_], supportSquare(), [&](int j, double d2) {
+        if (j == i) { elements.emplace_back(i, i, 1.); return; }
+        if (d2 < 0.0001 && j > i) {
+  		std::cout << " ERROR  - points likely duplicated, which will lead to errors in solving for weights. \
+  		The distance^2 is smaller than 0.0001 for points "<< i << " and " << j << " ... " <<  std::endl;
+  		printPoint(i);
+  		printPoint(j);
+        }
+        double rad = radialFunc(d2,eps_,cutoff);
+        if (rad != 0) elements.emplace_back(i, j, rad);
+      });
+    }
+    Eigen::SparseMatrix<double> sMatrix(M_,M_);
+    sMatrix.setFromTriplets(elements.begin(), elements.end());
+    sMatrix.makeCompressed();
+    std::cout << "RooSplineND -- " << sMatrix.nonZeros() << " non-zero elements out of " << double(M_)*M_ << std::endl;
+    // the matrix is symmetric (and positive definite for the Wendland kernel): try LDLT first, and LU if it fails
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double> > ldlt(sMatrix);
+    if (ldlt.info() == Eigen::Success) x = ldlt.solve(weights);
+    if (ldlt.info() != Eigen::Success || !x.allFinite()) {
+      Eigen::SparseLU<Eigen::SparseMatrix<double> > lu;
+      lu.analyzePattern(sMatrix);
+      lu.factorize(sMatrix);
+      if (lu.info() != Eigen::Success) std::cout << " ERROR  - could not solve for the weights: " << lu.lastErrorMessage() << std::endl;
+      x = lu.solve(weights);
+    }
+  }
 
   std::cout << "RooSplineND -- ........ Done" << std::endl;
 
@@ -258,23 +303,115 @@ double RooSplineND::getDistFromSquare(int i) const{
 }
 //_____________________________________________________________________________
 double RooSplineND::radialFunc(double d2, double eps, double cutoff) const{
+  if (kernel_ == Wendland) {
+    // Wendland function with support eps, positive definite in ndim_ dimensions
+    double r = TMath::Sqrt(d2)/eps;
+    if (r >= 1) return 0.;
+    int l = ndim_/2 + 2;
+    return TMath::Power(1-r, l+1)*((l+1)*r + 1);
+  }
   double expo = (d2/(eps*eps));
   //double retval = 1./(1+(TMath::Power(expo,1.5)));
-  //if (cutoff > 0){
-    //if ( TMath::Sqrt(d2) > cutoff*eps ) return 0.;
-  //}
+  if (cutoff > 0 && expo > cutoff*cutoff) return 0.;
   double retval = TMath::Exp(-1*expo);
   return retval;
 }
 //_____________________________________________________________________________
+void RooSplineND::checkKernel() const{
+  if (kernel_ != Gaussian && kernel_ != TruncatedGaussian && kernel_ != Wendland) throw std::invalid_argument(Form("RooSplineND: unknown kernel %d", kernel_));
+  // a truncated gaussian with no support would be zero everywhere
+  if (kernel_ == TruncatedGaussian && !(cutoff_ > 0)) throw std::invalid_argument(Form("RooSplineND: the cutoff of the TruncatedGaussian kernel must be positive, not %g", cutoff_));
+}
+//_____________________________________________________________________________
+double RooSplineND::supportSquare() const{
+  if (kernel_ == Wendland) return eps_*eps_;
+  if (kernel_ == TruncatedGaussian) return cutoff_*cutoff_*eps_*eps_;
+  return -1;
+}
+//_____________________________________________________________________________
+void RooSplineND::buildIndex() const{
+  pts_.resize(M_*ndim_);
+  range_.resize(ndim_);
+  x_.resize(ndim_);
+  for (int k=0;k<ndim_;k++){
+    range_[k] = r_map[k].second-r_map[k].first;
+    const std::vector<double> &vk = v_map[k];
+    for (int i=0;i<M_;i++) pts_[i*ndim_+k] = vk[i];
+  }
+  kdOrder_.resize(M_);
+  kdDim_.assign(M_, 0);
+  for (int i=0;i<M_;i++) kdOrder_[i] = i;
+  if (kernel_ != Gaussian) {
+    // split each range along the axis with the largest spread, at the median
+    std::vector<std::pair<int,int> > todo(1, std::make_pair(0, M_));
+    while (!todo.empty()) {
+      int lo = todo.back().first, hi = todo.back().second; todo.pop_back();
+      if (hi - lo < 2) continue;
+      int dim = 0; double maxSpread = -1;
+      for (int k=0;k<ndim_;k++){
+        double min = 1e300, max = -1e300;
+        for (int j=lo;j<hi;j++){ double v = pts_[kdOrder_[j]*ndim_+k]; min = std::min(min, v); max = std::max(max, v); }
+        double spread = (rescaleAxis ? (max-min)/range_[k] : max-min);
+        if (spread > maxSpread) { maxSpread = spread; dim = k; }
+      }
+      int mid = (lo+hi)/2;
+      std::nth_element(kdOrder_.begin()+lo, kdOrder_.begin()+mid, kdOrder_.begin()+hi,
+              [&](int i, int j) { return pts_[i*ndim_+dim] < pts_[j*ndim_+dim]; });
+      kdDim_[mid] = dim;
+      todo.emplace_back(lo, mid);
+      todo.emplace_back(mid+1, hi);
+    }
+  }
+  indexReady_ = true;
+}
+//_____________________________________________________________________________
+template<typename F> void RooSplineND::forEachNeighbour(const double *x, double d2max, F f) const{
+  std::pair<int,int> stack[128];
+  int nstack = 0;
+  stack[nstack++] = std::make_pair(0, M_);
+  while (nstack > 0) {
+    int lo = stack[nstack-1].first, hi = stack[nstack-1].second; --nstack;
+    if (lo >= hi) continue;
+    int mid = (lo+hi)/2, i = kdOrder_[mid], dim = kdDim_[mid];
+    const double *p = &pts_[i*ndim_];
+    double d2 = 0.;
+    for (int k=0;k<ndim_;k++){
+      double dk = (rescaleAxis ? axis_pts_*(p[k]-x[k])/range_[k] : (p[k]-x[k]));
+      d2 += dk*dk;
+    }
+    if (d2 <= d2max) f(i, d2);
+    // x is on the lower side of the split if diff < 0: the other side is visited only if the plane is close enough
+    double diff = (rescaleAxis ? axis_pts_*(x[dim]-p[dim])/range_[dim] : (x[dim]-p[dim]));
+    std::pair<int,int> lower(lo, mid), upper(mid+1, hi);
+    if (diff*diff <= d2max) stack[nstack++] = (diff < 0 ? upper : lower);
+    stack[nstack++] = (diff < 0 ? lower : upper);
+  }
+}
+//_____________________________________________________________________________
 Double_t RooSplineND::evaluate() const {
+ if (!indexReady_) buildIndex();
+ for (int k=0;k<ndim_;k++) x_[k] = ((RooAbsReal*)vars_.at(k))->getVal();
  double ret = 0;
+ if (kernel_ != Gaussian) {
+   double cutoff = (kernel_ == TruncatedGaussian ? cutoff_ : -1);
+   forEachNeighbour(&x_[0], supportSquare(), [&](int i, double d2) {
+     double w = w_[i];
+     if (w!=0) ret+=((w)*radialFunc(d2,eps_,cutoff));
+   });
+   return ret;
+ }
  for (int i=0;i<M_;i++){
    //std::cout << "EVAL == "<< i << " " << w_[i] << " " << getDistFromSquare(i) << std::endl;
    double w = w_[i];
    if (w==0) continue;
    //if ( TMath::Abs(w)< 0.01*TMath::Abs(w_mean) )  continue;  
-   ret+=((w)*radialFunc(getDistFromSquare(i),eps_));
+   const double *p = &pts_[i*ndim_];
+   double d2 = 0.;
+   for (int k=0;k<ndim_;k++){
+     double dk = (rescaleAxis ? axis_pts_*(p[k]-x_[k])/range_[k] : (p[k]-x_[k]));
+     d2 += dk*dk;
+   }
+   ret+=((w)*radialFunc(d2,eps_));
  }
  //ret*=w_mean;
  return ret;
@@ -474,7 +474,7 @@ double Significance::significanceBruteForce(RooAbsPdf &pdf, RooAbsData &data, Ro
         }
 #endif
    }
-   if (points) outputFile->WriteTObject(points);
+   if (points) { Combine::syncOutput(); outputFile->WriteTObject(points); }
    return std::copysign(thisnll - minnll, rbest);
 }
 
@@ -556,6 +556,7 @@ double Significance::significanceFromScan(RooAbsPdf &pdf, RooAbsData &data, RooR
         //MinimizerSentry minimizerConfig(minimizerAlgo_, minimizerTolerance_);
         res = points->Fit(fit,"S0");
     }
+    Combine::syncOutput();
     outputFile->WriteTObject(points);
     outputFile->WriteTObject(fit);
     if (res.Get()->Status() == 0) {
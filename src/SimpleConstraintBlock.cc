@@ -0,0 +1,115 @@
+#include "../interface/SimpleConstraintBlock.h"
+#include "../interface/ProfilingTools.h"
+
+#include <RooRealVar.h>
+#include <RooConstVar.h>
+#include <algorithm>
+
+namespace {
+    // RooRealVar and RooConstVar keep their current value in RooAbsReal::_value: setVal() writes it and getVal()
+    // returns it, as they are never value-dirty. _value is protected, so its address is taken through a pointer to
+    // member formed in this derived class, which the access rules allow to apply to any RooAbsReal; no object of
+    // this class is ever created. The address stays valid as long as the constraint, which is a client of the
+    // parameter; the block must be rebuilt if the servers of the constraints are redirected, as the setup is.
+    struct ValueAddress : public RooAbsReal {
+        static const double * of(const RooAbsReal &arg) {
+            if (!arg.InheritsFrom(RooRealVar::Class()) && !arg.InheritsFrom(RooConstVar::Class())) return nullptr;
+            return &(arg.*(&ValueAddress::_value));
+        }
+    };
+    // placeholder for the parameters of the constraints that are not read directly
+    const double unused = 0;
+}
+
+void SimpleConstraintBlock::add(const SimpleGaussianConstraint * gaus) {
+    const double *x = ValueAddress::of(gaus->getX()), *mean = ValueAddress::of(gaus->getMean());
+    if (x == nullptr || mean == nullptr) {
+        gausOther_.push_back(gaus_.size());
+        x = mean = &unused;
+    }
+    gaus_.push_back(gaus);
+    gausX_.push_back(x);
+    gausMean_.push_back(mean);
+    gausScale_.push_back(gaus->scale());
+    gausZero_.push_back(0);
+    gausXVal_.push_back(0);
+    gausMeanVal_.push_back(0);
+    gausLogVal_.push_back(0);
+    init_ = false;
+}
+
+void SimpleConstraintBlock::add(const SimplePoissonConstraint * pois) {
+    const double *obs = ValueAddress::of(pois->getObserved()), *mean = ValueAddress::of(pois->getMean());
+    if (obs == nullptr || mean == nullptr) {
+        poisOther_.push_back(pois_.size());
+        obs = mean = &unused;
+    }
+    pois_.push_back(pois);
+    poisObs_.push_back(obs);
+    poisMean_.push_back(mean);
+    poisLogGamma_.push_back(pois->logGamma());
+    poisZero_.push_back(0);
+    poisObsVal_.push_back(0);
+    poisMeanVal_.push_back(0);
+    poisLogVal_.push_back(0);
+    init_ = false;
+}
+
+void SimpleConstraintBlock::update_() const {
+    // gaussians: find the terms whose parameters moved, and recompute either those or all of them at once
+    unsigned int n = gaus_.size();
+    changed_.clear();
+    for (unsigned int i = 0; i < n; ++i) {
+        double x = *gausX_[i], mean = *gausMean_[i];
+        if (!init_ || x != gausXVal_[i] || mean != gausMeanVal_[i]) {
+            gausXVal_[i] = x;
+            gausMeanVal_[i] = mean;
+            changed_.push_back(i);
+        }
+    }
+    // the full pass is vectorized and has no indexed loads, so it does several terms in the time the sparse one
+    // does one: it is used when more than one term in SIMNLL_CONSTRAINT_FULLPASS changed (8 by default, a rough
+    // break-even, not tuned). A minimizer moving one parameter at a time for the gradient stays on the sparse
+    // path, while a step moving all the parameters takes the full one.
+    static unsigned int fullPass = runtimedef::get("SIMNLL_CONSTRAINT_FULLPASS") > 0 ? runtimedef::get("SIMNLL_CONSTRAINT_FULLPASS") : 8;
+    if (fullPass*changed_.size() > n) {
+        const double * __restrict__ x = gausXVal_.data();
+        const double * __restrict__ mean = gausMeanVal_.data();
+        const double * __restrict__ scale = gausScale_.data();
+        double * __restrict__ logVal = gausLogVal_.data();
+        for (unsigned int i = 0; i < n; ++i) logVal[i] = SimpleGaussianConstraint::logValue(x[i], mean[i], scale[i]);
+    } else {
+        for (unsigned int i : changed_) gausLogVal_[i] = SimpleGaussianConstraint::logValue(gausXVal_[i], gausMeanVal_[i], gausScale_[i]);
+    }
+    for (unsigned int i : gausOther_) gausLogVal_[i] = gaus_[i]->getLogValFast();
+
+    // poissons: the log is not cheap, so recompute only the ones that changed
+    n = pois_.size();
+    for (unsigned int i = 0; i < n; ++i) {
+        double obs = *poisObs_[i], mean = *poisMean_[i];
+        if (!init_ || obs != poisObsVal_[i] || mean != poisMeanVal_[i]) {
+            poisObsVal_[i] = obs;
+            poisMeanVal_[i] = mean;
+            poisLogVal_[i] = SimplePoissonConstraint::logValue(obs, mean, poisLogGamma_[i]);
+        }
+    }
+    for (unsigned int i : poisOther_) poisLogVal_[i] = pois_[i]->getLogValFast();
+    init_ = true;
+}
+
+void SimpleConstraintBlock::setZeroPoint() {
+    update_();
+    for (unsigned int i = 0, n = gaus_.size(); i < n; ++i) gausZero_[i] = -gausLogVal_[i];
+    for (unsigned int i = 0, n = pois_.size(); i < n; ++i) poisZero_[i] = -poisLogVal_[i];
+}
+
+void SimpleConstraintBlock::clearZeroPoint() {
+    std::fill(gausZero_.begin(), gausZero_.end(), 0.);
+    std::fill(poisZero_.begin(), poisZero_.end(), 0.);
+}
+
+void SimpleConstraintBlock::addTo(DefaultAccumulator<double> &acc) const {
+    update_();
+    for (unsigned int i = 0, n = gaus_.size(); i < n; ++i) acc += (gausLogVal_[i] + gausZero_[i]);
+    for (unsigned int i = 0, n = pois_.size(); i < n; ++i) acc += (poisLogVal_[i] + poisZero_[i]);
+}
@@ -0,0 +1,63 @@
+#include "../interface/TemplatePool.h"
+#include "../interface/ProfilingTools.h"
+
+#include <cstring>
+
+TemplatePool & TemplatePool::instance()
+{
+    static TemplatePool pool;
+    return pool;
+}
+
+bool TemplatePool::enabled()
+{
+    static bool noPool = runtimedef::get("NO_TEMPLATE_POOL");
+    return !noPool;
+}
+
+std::size_t TemplatePool::hash(const FastTemplate &t)
+{
+    // FNV-1a over the sizes and the bytes of the values
+    std::size_t ret = 14695981039346656037ULL;
+    auto add = [&ret](const unsigned char *bytes, std::size_t n) {
+        for (std::size_t i = 0; i < n; ++i) { ret ^= bytes[i]; ret *= 1099511628211ULL; }
+    };
+    unsigned int sizes[2] = { t.size(), t.fullsize() };
+    add(reinterpret_cast<const unsigned char *>(sizes), sizeof(sizes));
+    if (t.fullsize()) add(reinterpret_cast<const unsigned char *>(&t[0]), t.fullsize() * sizeof(FastTemplate::T));
+    return ret;
+}
+
+bool TemplatePool::equal(const FastTemplate &t1, const FastTemplate &t2)
+{
+    if (t1.size() != t2.size() || t1.fullsize() != t2.fullsize()) return false;
+    return t1.fullsize() == 0 || std::memcmp(&t1[0], &t2[0], t1.fullsize() * sizeof(FastTemplate::T)) == 0;
+}
+
+TemplatePool::Ref TemplatePool::intern(const FastTemplate &t)
+{
+    std::size_t bytes = t.fullsize() * sizeof(FastTemplate::T);
+    std::size_t key = hash(t);
+    ++requested_;
+    auto range = pool_.equal_range(key);
+    for (auto it = range.first; it != range.second; ) {
+        Ref ref = it->second.lock();
+        if (!ref) { it = pool_.erase(it); continue; } // all its users are gone
+        if (equal(*ref, t)) {
+            ++shared_;
+            bytesSaved_ += bytes;
+            return ref;
+        }
+        ++it;
+    }
+    Ref ref = std::make_shared<const FastTemplate>(t);
+    pool_.emplace(key, ref);
+    bytesStored_ += bytes;
+    return ref;
+}
+
+void TemplatePool::report(std::ostream &out) const
+{
+    out << "TemplatePool: " << requested_ << " templates read, " << (requested_ - shared_) << " unique (" << bytesStored_/1048576. << " MB); "
+        << shared_ << " shared, saving " << bytesSaved_/1048576. << " MB" << std::endl;
+}
@@ -1,6 +1,7 @@
 #include "../interface/ToyMCSamplerOpt.h"
 #include "../interface/utils.h"
 #include "../interface/CombineLogger.h"
+#include "../interface/RooDirtyInhibitSentry.h"
 #include <memory>
 #include <stdexcept>
 #include <TH1.h>
@@ -174,12 +175,12 @@ toymcoptutils::SinglePdfGenInfo::generatePseudoAsimov(RooRealVar *&weightVar, in
         if (weightVar == 0) weightVar = new RooRealVar("_weight_","",1.0);
         RooArgSet obsPlusW(observables_); obsPlusW.add(*weightVar);
         RooDataSet *rds = new RooDataSet(data->GetName(), "", obsPlusW, RooFit::WeightVar(weightVar->GetName()));
-        RooAbsArg::setDirtyInhibit(true); // don't propagate dirty flags while filling histograms 
+        { RooDirtyInhibitSentry inhibit; // don't propagate dirty flags while filling histograms 
         for (int i = 0; i < nPoints; ++i) {
             observables_ = *data->get(i);
             rds->add(observables_, weightScale*expEvents/nPoints);
         }
-        RooAbsArg::setDirtyInhibit(false); // restore proper propagation of dirty flags
+        } // restore proper propagation of dirty flags
         return rds; 
     } else {
         return generateWithHisto(weightVar, true, weightScale, verbose);
@@ -217,7 +218,7 @@ toymcoptutils::SinglePdfGenInfo::generateWithHisto(RooRealVar *&weightVar, bool
     histoSpec_->Scale(expectedEvents/ histoSpec_->Integral("width")); 
     RooArgSet obsPlusW(obs); obsPlusW.add(*weightVar);
     RooDataSet *data = new RooDataSet(TString::Format("%sData", pdf_->GetName()), "", obsPlusW, RooFit::WeightVar(weightVar->GetName()));
-    RooAbsArg::setDirtyInhibit(true); // don't propagate dirty flags while filling histograms 
+    { RooDirtyInhibitSentry inhibit; // don't propagate dirty flags while filling histograms 
     switch (obs.getSize()) {
         case 1:
             for (int i = 1, n = histoSpec_->GetNbinsX(); i <= n; ++i) {
@@ -252,7 +253,7 @@ toymcoptutils::SinglePdfGenInfo::generateWithHisto(RooRealVar *&weightVar, bool
             } } }
             }
     }
-    RooAbsArg::setDirtyInhibit(false); // restore proper propagation of dirty flags
+    } // restore proper propagation of dirty flags
     if (!keepHistoSpec_) { delete histoSpec_; histoSpec_ = 0; }
     //std::cout << "Asimov dataset generated from " << pdf_->GetName() << " (sumw? " << data->sumEntries() << ", expected events " << expectedEvents << ")" << std::endl;
     //utils::printRDH(data);
@@ -389,7 +390,7 @@ toymcoptutils::SimPdfGenInfo::generate(RooRealVar *&weightVar, const RooDataSet*
             RooArgSet vars(observables_), varsPlusWeight(observables_); 
             if (weightVar) varsPlusWeight.add(*weightVar);
             ret = new RooDataSet(retName, "", varsPlusWeight, RooFit::WeightVar(weightVar ? weightVar->GetName() : 0));
-            RooAbsArg::setDirtyInhibit(true); // don't propagate dirty flags while filling histograms 
+            { RooDirtyInhibitSentry inhibit; // don't propagate dirty flags while filling histograms 
             for (std::map<std::string,RooAbsData*>::iterator it = datasetPieces_.begin(), ed = datasetPieces_.end(); it != ed; ++it) {
                 cat_->setLabel(it->first.c_str());
                 for (unsigned int i = 0, n = it->second->numEntries(); i < n; ++i) {
@@ -397,7 +398,7 @@ toymcoptutils::SimPdfGenInfo::generate(RooRealVar *&weightVar, const RooDataSet*
                     ret->add(vars, it->second->weight());
                 }
             }
-            RooAbsArg::setDirtyInhibit(false); // restore proper propagation of dirty flags
+            } // restore proper propagation of dirty flags
         } else {
             // not copyData is the "fast" mode used when generating toys as a ToyMCSampler.
             // this doesn't copy the data, so the toys cannot outlive this class and each new
@@ -425,7 +426,7 @@ toymcoptutils::SimPdfGenInfo::generateAsimov(RooRealVar *&weightVar, int verbose
         if (copyData_) { 
             RooArgSet vars(observables_), varsPlusWeight(observables_); varsPlusWeight.add(*weightVar);
             ret = new RooDataSet(retName, "", varsPlusWeight, RooFit::WeightVar(weightVar ? weightVar->GetName() : 0));
-            RooAbsArg::setDirtyInhibit(true); // don't propagate dirty flags while filling histograms 
+            { RooDirtyInhibitSentry inhibit; // don't propagate dirty flags while filling histograms 
             for (std::map<std::string,RooAbsData*>::iterator it = datasetPieces_.begin(), ed = datasetPieces_.end(); it != ed; ++it) {
                 cat_->setLabel(it->first.c_str());
                 for (unsigned int i = 0, n = it->second->numEntries(); i < n; ++i) {
@@ -433,7 +434,7 @@ toymcoptutils::SimPdfGenInfo::generateAsimov(RooRealVar *&weightVar, int verbose
                     ret->add(vars, it->second->weight());
                 }
             }
-            RooAbsArg::setDirtyInhibit(false); // restore proper propagation of dirty flags
+            } // restore proper propagation of dirty flags
         } else {
             // not copyData is the "fast" mode used when generating toys as a ToyMCSampler.
             // this doesn't copy the data, so the toys cannot outlive this class and each new
@@ -60,10 +60,9 @@ VBFHZZ4L_RooSpinZeroPdf_fast::VBFHZZ4L_RooSpinZeroPdf_fast(
 {}
 
 
-Float_t VBFHZZ4L_RooSpinZeroPdf_fast::interpolateFcn(Int_t code, const char* rangeName) const{
-  DefaultAccumulator<Float_t> value = 0;
-
-  vector<Float_t> coefs; coefs.reserve(5);
+Bool_t VBFHZZ4L_RooSpinZeroPdf_fast::getCouplingCoefficients(vector<Float_t>& coefs) const{
+  coefs.clear();
+  coefs.reserve(5);
   coefs.push_back((Float_t)pow(a1, 4)); // a1**4
   coefs.push_back((Float_t)pow(a1, 3)*ai1); // a1**3 x ai1
   coefs.push_back((Float_t)pow(a1*ai1, 2)); // a1**2 x ai1**2
@@ -71,15 +70,22 @@ Float_t VBFHZZ4L_RooSpinZeroPdf_fast::interpolateFcn(Int_t code, const char* ran
   coefs.push_back((Float_t)pow(ai1, 4)); // ai1**4
 
   if (coefList.getSize() != (Int_t)coefs.size()){
-    cerr << "VBFHZZ4L_RooSpinZeroPdf_fast::interpolateFcn: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
+    cerr << "VBFHZZ4L_RooSpinZeroPdf_fast::getCouplingCoefficients: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
     assert(0);
   }
+  return true;
+}
 
+Float_t VBFHZZ4L_RooSpinZeroPdf_fast::interpolateFcn(Int_t code, const char* rangeName) const{
+  vector<Float_t> coefs;
+  if (!getCouplingCoefficients(coefs)) return 0;
+
+  DefaultAccumulator<Float_t> value = 0;
   if (code==0){
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
   }
   else{
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
   }
 
   Float_t result = value.sum();
@@ -56,16 +56,16 @@ VVHZZ4L_RooSpinZeroPdf_1D_fast::VVHZZ4L_RooSpinZeroPdf_1D_fast(
 {}
 
 
-Float_t VVHZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn(Int_t code, const char* rangeName) const{
+Bool_t VVHZZ4L_RooSpinZeroPdf_1D_fast::getCouplingCoefficients(vector<Float_t>& coefs) const{
   Float_t absfai1 = fabs(fai1);
   Float_t fa1 = 1.-absfai1;
   
-  if (fa1<0.) return 0;
+  coefs.clear();
+  if (fa1<0.) return false;
 
-  DefaultAccumulator<Float_t> value = 0;
   Float_t sgn_fai1 = (fai1>=0. ? 1. : -1.);
 
-  vector<Float_t> coefs; coefs.reserve(5);
+  coefs.reserve(5);
   coefs.push_back((Float_t)pow(fa1, 2)); // a1**4
   coefs.push_back((Float_t)sgn_fai1*sqrt(pow(fa1, 3)*fai1)); // a1**3 x ai1
   coefs.push_back((Float_t)(fa1*fai1)); // a1**2 x ai1**2
@@ -73,15 +73,22 @@ Float_t VVHZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn(Int_t code, const char* r
   coefs.push_back((Float_t)pow(fai1, 2)); // ai1**4
 
   if (coefList.getSize() != (Int_t)coefs.size()){
-    cerr << "VVHZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
+    cerr << "VVHZZ4L_RooSpinZeroPdf_1D_fast::getCouplingCoefficients: coefList.getSize()=" << coefList.getSize() << " != coefs.size()=" << coefs.size() << endl;
     assert(0);
   }
+  return true;
+}
 
+Float_t VVHZZ4L_RooSpinZeroPdf_1D_fast::interpolateFcn(Int_t code, const char* rangeName) const{
+  vector<Float_t> coefs;
+  if (!getCouplingCoefficients(coefs)) return 0;
+
+  DefaultAccumulator<Float_t> value = 0;
   if (code==0){
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->getVal())*coefs.at(ic));
   }
   else{
-    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((dynamic_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
+    for (int ic=0; ic<coefList.getSize(); ic++) value += (Float_t)((static_cast<const RooAbsReal*>(coefList.at(ic))->analyticalIntegral(code, rangeName))*coefs.at(ic));
   }
 
   Float_t result = value.sum();
@@ -0,0 +1,99 @@
+#include "../interface/VectorizedSpinZeroPdfs.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_1D_fast.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_2D_fast.h"
+#include "../interface/HZZ4L_RooSpinZeroPdf_phase_fast.h"
+#include "../interface/VBFHZZ4L_RooSpinZeroPdf_fast.h"
+#include "../interface/VVHZZ4L_RooSpinZeroPdf_1D_fast.h"
+#include "../interface/Accumulators.h"
+#include <RooArgSet.h>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+
+template<typename PdfT>
+bool VectorizedSpinZeroPdf<PdfT>::canVectorize(const PdfT &pdf, const RooArgSet &obs) {
+    std::unique_ptr<RooArgSet> pdfObs(pdf.getObservables(obs));
+    RooArgSet analVars;
+    Int_t code = pdf.getAnalyticalIntegral(*pdfObs, analVars);
+    if (code == 0 || analVars.getSize() != pdfObs->getSize()) return false;
+    for (RooAbsArg *a : pdf.componentList()) {
+        std::unique_ptr<RooArgSet> params(a->getParameters(obs));
+        if (params->getSize() != 0) return false;
+    }
+    return true;
+}
+
+template<typename PdfT>
+VectorizedSpinZeroPdf<PdfT>::VectorizedSpinZeroPdf(const PdfT &pdf, const RooAbsData &data, bool includeZeroWeights) :
+    pdf_(&pdf), nentries_(0), norm_(1.0)
+{
+    // makeCachingPdf only vectorizes the pdfs that qualify, and uses the generic CachingPdf for the others
+    if (!canVectorize(pdf, *data.get())) {
+        throw std::logic_error(std::string("Pdf ") + pdf.GetName() + " can't be vectorized: its integral is not analytical, or its components depend on parameters");
+    }
+    std::unique_ptr<RooArgSet> obs(pdf.getObservables(data));
+    RooArgSet analVars;
+    Int_t code = pdf.getAnalyticalIntegral(*obs, analVars);
+
+    // the values of the components are computed once here, as they are pure templates of the observables
+    std::vector<const RooAbsReal *> components;
+    for (RooAbsArg *a : pdf.componentList()) components.push_back(static_cast<const RooAbsReal *>(a));
+    vals_.resize(components.size());
+    for (auto &v : vals_) v.reserve(data.numEntries());
+    for (unsigned int i = 0, n = data.numEntries(); i < n; ++i) {
+        data.get(i);
+        if (data.weight() || includeZeroWeights) {
+            for (unsigned int ic = 0, nc = components.size(); ic < nc; ++ic) vals_[ic].push_back(components[ic]->getVal());
+            ++nentries_;
+        }
+    }
+    integrals_.reserve(components.size());
+    for (const RooAbsReal *c : components) integrals_.push_back(c->analyticalIntegral(code));
+    sum_.resize(nentries_);
+    compensation_.resize(nentries_);
+}
+
+template<typename PdfT>
+void VectorizedSpinZeroPdf<PdfT>::fill(std::vector<Double_t> &out) const {
+    out.resize(nentries_);
+    if (!pdf_->getCouplingCoefficients(coefs_)) {
+        // both the value and the integral of the pdf are 1e-100
+        std::fill(out.begin(), out.end(), 1.0);
+        normCoefs_.clear();
+        return;
+    }
+
+    if (normCoefs_.empty() || coefs_ != normCoefs_) {
+        DefaultAccumulator<Float_t> norm = 0;
+        for (unsigned int ic = 0, nc = coefs_.size(); ic < nc; ++ic) norm += (Float_t)(integrals_[ic]*coefs_[ic]);
+        Double_t value = norm.sum();
+        norm_ = (value <= 0. ? 1e-100 : value);
+        normCoefs_ = coefs_;
+    }
+
+    // Kahan sum over the components for all entries at once, as DefaultAccumulator<Float_t> does for a single one
+    Float_t * __restrict__ sum = sum_.data();
+    Float_t * __restrict__ compensation = compensation_.data();
+    std::fill(sum_.begin(), sum_.end(), 0.f);
+    std::fill(compensation_.begin(), compensation_.end(), 0.f);
+    for (unsigned int ic = 0, nc = coefs_.size(); ic < nc; ++ic) {
+        const Double_t * __restrict__ vals = vals_[ic].data();
+        const Float_t coef = coefs_[ic];
+        for (unsigned int i = 0; i < nentries_; ++i) {
+            Float_t y = (Float_t)(vals[i]*coef) - compensation[i];
+            Float_t sumnew = sum[i] + y;
+            compensation[i] = (sumnew - sum[i]) - y;
+            sum[i] = sumnew;
+        }
+    }
+    for (unsigned int i = 0; i < nentries_; ++i) {
+        Double_t value = sum[i];
+        out[i] = (value <= 0. ? 1e-100 : value) / norm_;
+    }
+}
+
+template class VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_1D_fast>;
+template class VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_2D_fast>;
+template class VectorizedSpinZeroPdf<HZZ4L_RooSpinZeroPdf_phase_fast>;
+template class VectorizedSpinZeroPdf<VBFHZZ4L_RooSpinZeroPdf_fast>;
+template class VectorizedSpinZeroPdf<VVHZZ4L_RooSpinZeroPdf_1D_fast>;
@@ -1,4 +1,5 @@
 #include "../interface/VerticalInterpHistPdf.h"
+#include "../interface/FastTemplateKernel.h"
 
 #include <cassert>
 #include <memory>
@@ -502,25 +503,21 @@ void FastVerticalInterpHistPdfBase::syncTotal(FastTemplate &cache, const FastTem
      * so we just do template += (0.5 * x) * (diff + smoothStepFunc(x) * sum)
      * ========================================== */
 
-    // start from nominal
-    cache.CopyValues(_smoothAlgo < 0 ? cacheNominalLog : cacheNominal);
-    //printf("Cache initialized to nominal template: \n");  cacheNominal.Dump();
-
-    // apply all morphs one by one
+    // start from nominal, apply all morphs one by one, and if necessary go back to linear scale:
+    // all done in a single pass over the bins
+    FastTemplateKernel kernel(cache);
+    kernel.copy(_smoothAlgo < 0 ? cacheNominalLog : cacheNominal);
     for (int i = 0, ndim = _coefList.getSize(); i < ndim; ++i) {
         double x = _morphParams[i]->getVal();
         double a = 0.5*x, b = smoothStepFunc(x);
-        cache.Meld(_morphs[i].diff, _morphs[i].sum, a, b);    
-        //printf("Merged transformation for dimension %d, x = %+5.3f, step = %.3f: \n", i, x, b);  cache.Dump();
+        kernel.meld(_morphs[i].diff, _morphs[i].sum, a, b);
     }
-
-    // if necessary go back to linear scale
     if (_smoothAlgo < 0) {
-        cache.Exp();
-        //printf("Done exponential tranformation\n");  cache.Dump();
+        kernel.exp();
     } else {
-        cache.CropUnderflows();
+        kernel.cropUnderflows();
     }
+    kernel.run();
     
     // mark as done
     _sentry.reset();
@@ -1027,25 +1024,21 @@ void FastVerticalInterpHistPdf2Base::syncTotal(FastTemplate &cache, const FastTe
      * so we just do template += (0.5 * x) * (diff + smoothStepFunc(x) * sum)
      * ========================================== */
 
-    // start from nominal
-    cache.CopyValues(_smoothAlgo < 0 ? cacheNominalLog : cacheNominal);
-    //printf("Cache initialized to nominal template: \n");  cacheNominal.Dump();
-
-    // apply all morphs one by one
+    // start from nominal, apply all morphs one by one, and if necessary go back to linear scale:
+    // all done in a single pass over the bins
+    FastTemplateKernel kernel(cache);
+    kernel.copy(_smoothAlgo < 0 ? cacheNominalLog : cacheNominal);
     for (int i = 0, ndim = _coefList.getSize(); i < ndim; ++i) {
         double x = _morphParams[i]->getVal();
         double a = 0.5*x, b = smoothStepFunc(x);
-        cache.Meld(_morphs[i].diff, _morphs[i].sum, a, b);    
-        //printf("Merged transformation for dimension %d, x = %+5.3f, step = %.3f: \n", i, x, b);  cache.Dump();
+        kernel.meld(_morphs[i].diff, _morphs[i].sum, a, b);
     }
-
-    // if necessary go back to linear scale
     if (_smoothAlgo < 0) {
-        cache.Exp();
-        //printf("Done exponential tranformation\n");  cache.Dump();
+        kernel.exp();
     } else {
-        cache.CropUnderflows();
+        kernel.cropUnderflows();
     }
+    kernel.run();
     
     // mark as done
     _sentry.reset();
@@ -1174,3 +1167,90 @@ void FastVerticalInterpHistPdf2V::fill(std::vector<Double_t> &out) const
     }
 }
 
+void FastHistoNDBins::push_back(int bin)
+{
+    if (bin < 0) {
+        outside_.push_back(bins_.size());
+        bin = 0;
+    }
+    bins_.push_back(bin);
+}
+
+void FastHistoNDBins::finalize()
+{
+    begin_ = end_ = 0;
+    if (bins_.empty() || !outside_.empty()) return;
+    for (int i = 1, n = bins_.size(); i < n; ++i) {
+        if (bins_[i] != bins_[i-1]+1) return;
+    }
+    begin_ = bins_.front();
+    end_   = bins_.back()+1;
+    bins_.clear();
+}
+
+void FastHistoNDBins::fill(const FastTemplate &cache, std::vector<Double_t> &out) const
+{
+    if (begin_ != end_) {
+        out.resize(end_-begin_);
+        std::copy(&cache[begin_], &cache[end_-1]+1, out.begin());
+    } else {
+        int n = bins_.size();
+        out.resize(n);
+        const int * __restrict__ bins = n ? &bins_[0] : nullptr;
+        const Double_t * __restrict__ values = cache.fullsize() ? &cache[0] : nullptr;
+        Double_t * __restrict__ dest = n ? &out[0] : nullptr;
+        for (int i = 0; i < n; ++i) dest[i] = values[bins[i]];
+        for (int i : outside_) dest[i] = 0;
+    }
+}
+
+FastVerticalInterpHistPdf2D2V::FastVerticalInterpHistPdf2D2V(const FastVerticalInterpHistPdf2D2 &hpdf, const RooAbsData &data, bool includeZeroWeights) :
+    hpdf_(hpdf)
+{
+    // check init
+    if (!hpdf._initBase) hpdf.initBase();
+    if (hpdf._cache.size() == 0) hpdf._cache = hpdf._cacheNominal;
+    if (!hpdf._sentry.good()) hpdf.syncTotal();
+    // find bins, once per entry
+    RooArgSet obs(hpdf._x.arg(), hpdf._y.arg());
+    const RooRealVar &x = static_cast<const RooRealVar &>(hpdf._x.arg());
+    const RooRealVar &y = static_cast<const RooRealVar &>(hpdf._y.arg());
+    for (int i = 0, n = data.numEntries(); i < n; ++i) {
+        obs = *data.get(i);
+        if (data.weight() == 0 && !includeZeroWeights) continue;
+        bins_.push_back(hpdf._cache.FindBin(x.getVal(), y.getVal()));
+    }
+    bins_.finalize();
+}
+
+void FastVerticalInterpHistPdf2D2V::fill(std::vector<Double_t> &out) const 
+{
+    if (!hpdf_._sentry.good()) hpdf_.syncTotal();
+    bins_.fill(hpdf_._cache, out);
+}
+
+FastVerticalInterpHistPdf3DV::FastVerticalInterpHistPdf3DV(const FastVerticalInterpHistPdf3D &hpdf, const RooAbsData &data, bool includeZeroWeights) :
+    hpdf_(hpdf)
+{
+    // check init
+    if (hpdf._cache.size() == 0) hpdf.setupCaches();
+    if (!hpdf._sentry.good() || !hpdf._init) hpdf.syncTotal();
+    // find bins, once per entry
+    RooArgSet obs(hpdf._x.arg(), hpdf._y.arg(), hpdf._z.arg());
+    const RooRealVar &x = static_cast<const RooRealVar &>(hpdf._x.arg());
+    const RooRealVar &y = static_cast<const RooRealVar &>(hpdf._y.arg());
+    const RooRealVar &z = static_cast<const RooRealVar &>(hpdf._z.arg());
+    for (int i = 0, n = data.numEntries(); i < n; ++i) {
+        obs = *data.get(i);
+        if (data.weight() == 0 && !includeZeroWeights) continue;
+        bins_.push_back(hpdf._cache.FindBin(x.getVal(), y.getVal(), z.getVal()));
+    }
+    bins_.finalize();
+}
+
+void FastVerticalInterpHistPdf3DV::fill(std::vector<Double_t> &out) const 
+{
+    if (!hpdf_._sentry.good() || !hpdf_._init) hpdf_.syncTotal();
+    bins_.fill(hpdf_._cache, out);
+}
+
@@ -8,6 +8,7 @@
 #include <cmath>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
 #include <memory>
 #include <typeinfo>
@@ -119,8 +120,33 @@ void utils::printPdf(RooWorkspace *w, const char *pdfName) {
   params->Print("V");
 }
 
+namespace {
+    // state of one call to utils::factorizePdf
+    struct FactorizeMemo {
+        // nodes that were already factorized into themselves or into nothing: shared subgraphs, like the
+        // product of the constraints used by all the channels, are walked only once
+        std::unordered_map<const RooAbsPdf *, RooAbsPdf *> done;
+        // names of the constraints collected so far, as RooArgList::contains does a linear search
+        std::unordered_set<std::string> constraintNames;
+        void addConstraint(RooArgList &constraints, RooAbsArg &pdf) {
+            if (constraintNames.insert(pdf.GetName()).second) constraints.add(pdf);
+        }
+    };
+
+    RooAbsPdf *factorizePdfMemo(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &constraints, FactorizeMemo &memo) ;
+}
+
 RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &constraints) {
+    FactorizeMemo memo;
+    for (RooAbsArg *a : constraints) memo.constraintNames.insert(a->GetName());
+    return factorizePdfMemo(observables, pdf, constraints, memo);
+}
+
+namespace {
+RooAbsPdf *factorizePdfMemo(const RooArgSet &observables, RooAbsPdf &pdf, RooArgList &constraints, FactorizeMemo &memo) {
     //assert(&pdf);
+    auto cached = memo.done.find(&pdf);
+    if (cached != memo.done.end()) return cached->second;
     const std::type_info & id = typeid(pdf);
     if (id == typeid(RooProdPdf)) {
         //std::cout << " pdf is product pdf " << pdf.GetName() << std::endl;
@@ -130,22 +156,22 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
         bool needNew = false;
         for (int i = 0, n = list.getSize(); i < n; ++i) {
             RooAbsPdf *pdfi = (RooAbsPdf *) list.at(i);
-            RooAbsPdf *newpdf = factorizePdf(observables, *pdfi, constraints);
+            RooAbsPdf *newpdf = factorizePdfMemo(observables, *pdfi, constraints, memo);
             //std::cout << "    for " << pdfi->GetName() << "   newpdf  " << (newpdf == 0 ? "null" : (newpdf == pdfi ? "old" : "new"))  << std::endl;
             if (newpdf == 0) { needNew = true; continue; }
             if (newpdf != pdfi) { needNew = true; newOwned.add(*newpdf); }
             newFactors.add(*newpdf);
         }
-        if (!needNew && newFactors.getSize() > 1) { copyAttributes(pdf, *prod); return prod; }
-        else if (newFactors.getSize() == 0) return 0;
+        if (!needNew && newFactors.getSize() > 1) { utils::copyAttributes(pdf, *prod); memo.done[&pdf] = prod; return prod; }
+        else if (newFactors.getSize() == 0) { memo.done[&pdf] = 0; return 0; }
         else if (newFactors.getSize() == 1) {
             RooAbsPdf *ret = (RooAbsPdf *) newFactors.first()->Clone(TString::Format("%s_obsOnly", pdf.GetName()));
-            copyAttributes(pdf, *ret);
+            utils::copyAttributes(pdf, *ret);
             return ret;
         }
         RooProdPdf *ret = new RooProdPdf(TString::Format("%s_obsOnly", pdf.GetName()), "", newFactors);
         ret->addOwnedComponents(newOwned);
-        copyAttributes(pdf, *ret);
+        utils::copyAttributes(pdf, *ret);
         return ret;
     } else if (id == typeid(RooSimultaneous) || id == typeid(RooSimultaneousOpt)) {
         RooSimultaneous *sim  = dynamic_cast<RooSimultaneous *>(&pdf);
@@ -156,7 +182,7 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
         for (int ic = 0, nc = nbins; ic < nc; ++ic) {
             cat->setBin(ic);
             RooAbsPdf *pdfi = sim->getPdf(cat->getLabel());
-            RooAbsPdf *newpdf = factorizePdf(observables, *pdfi, constraints);
+            RooAbsPdf *newpdf = factorizePdfMemo(observables, *pdfi, constraints, memo);
             factorizedPdfs[ic] = newpdf;
             if (newpdf == 0) { throw std::runtime_error(std::string("ERROR: channel ") + cat->getLabel() + " factorized to zero."); }
             if (newpdf != pdfi) { needNew = true; newOwned.add(*newpdf); }
@@ -165,7 +191,7 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
             RooSimultaneousOpt &o = dynamic_cast<RooSimultaneousOpt &>(pdf);
             if (o.extraConstraints().getSize() > 0) needNew = true;
             for (RooAbsArg *a : o.extraConstraints()) {
-                if (!constraints.contains(*a) && (!a->getAttribute("ignoreConstraint")) ) constraints.add(*a);
+                if (!a->getAttribute("ignoreConstraint")) memo.addConstraint(constraints, *a);
             }
         }
         RooSimultaneous *ret = sim;
@@ -183,17 +209,21 @@ RooAbsPdf *utils::factorizePdf(const RooArgSet &observables, RooAbsPdf &pdf, Roo
             ret->addOwnedComponents(newOwned);
         }
         delete cat;
-        copyAttributes(pdf, *ret);
+        utils::copyAttributes(pdf, *ret);
         return ret;
     } else if (pdf.dependsOn(observables)) {
+        memo.done[&pdf] = &pdf;
         return &pdf;
     } else {
-        if (!constraints.contains(pdf) && (!pdf.getAttribute("ignoreConstraint"))) constraints.add(pdf);
+        if (!pdf.getAttribute("ignoreConstraint")) memo.addConstraint(constraints, pdf);
+        memo.done[&pdf] = 0;
         return 0;
     }
 
 }
 
+} // namespace
+
 void utils::factorizePdf(RooStats::ModelConfig &model, RooAbsPdf &pdf, RooArgList &obsTerms, RooArgList &constraints, bool debug) {
     return factorizePdf(*model.GetObservables(), pdf, obsTerms, constraints, debug);
 }
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <TH1D.h>
+#include <TRandom3.h>
+#include <RooRealVar.h>
+#include <RooCategory.h>
+#include <RooDataHist.h>
+#include <RooDataSet.h>
+#include <RooHistFunc.h>
+#include <RooFormulaVar.h>
+#include <RooRealSumPdf.h>
+#include <RooGaussian.h>
+#include <RooProdPdf.h>
+#include <RooMsgService.h>
+#include <boost/program_options.hpp>
+#include "HiggsAnalysis/CombinedLimit/interface/CascadeMinimizer.h"
+#include "HiggsAnalysis/CombinedLimit/interface/CachingNLL.h"
+#include "HiggsAnalysis/CombinedLimit/interface/RooSimultaneousOpt.h"
+#include "HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h"
+
+// Fit of a generated model with one nuisance parameter per bin (as for the bin-by-bin statistical uncertainties
+// without the analytic minimization), done with the default cascade and with --cminBlockCoordinate. The
+// channels share only the signal strength r, so each channel's nuisances form a block. The default size is
+// 100 channels of 100 bins, i.e. 10k per-bin nuisances.
+// Usage: benchBlockCoordinate.exe [channels=100] [bins=100] [rounds=5]
+
+struct Model {
+    std::vector<std::unique_ptr<RooDataHist> > hists; // before owned, so that they're deleted after the functions using them
+    RooArgList owned;
+    RooArgSet nuisances, globalObs, observables;
+    RooRealVar *r;
+    RooCategory *cat;
+    RooSimultaneousOpt *pdf;
+    std::unique_ptr<RooDataSet> data;
+};
+
+// signal bump over a falling background in each channel, with a relative uncertainty of 10% on each bin
+void build(Model &m, unsigned int nch, unsigned int nbins) {
+    TRandom3 rnd(7);
+    m.r = new RooRealVar("r", "r", 1, 0, 10);
+    m.cat = new RooCategory("CMS_channel", "");
+    m.owned.addOwned(*m.r);
+    m.owned.addOwned(*m.cat);
+    for (unsigned int c = 0; c < nch; ++c) m.cat->defineType(Form("ch%u", c), c);
+    m.pdf = new RooSimultaneousOpt("model_s", "", *m.cat);
+    m.owned.addOwned(*m.pdf);
+    RooRealVar *weight = new RooRealVar("weight", "", 1);
+    m.owned.addOwned(*weight);
+    std::vector<std::vector<double> > expected(nch);
+    for (unsigned int c = 0; c < nch; ++c) {
+        RooRealVar *x = new RooRealVar(Form("x_ch%u", c), "", 0, nbins);
+        x->setBins(nbins);
+        m.owned.addOwned(*x);
+        m.observables.add(*x);
+        TH1D hsig(Form("hsig_ch%u", c), "", nbins, 0, nbins);
+        for (unsigned int b = 0; b < nbins; ++b) hsig.SetBinContent(b + 1, 20 * std::exp(-0.5 * std::pow((b + 0.5 - 0.5 * nbins) / (0.1 * nbins), 2)));
+        RooDataHist *dsig = new RooDataHist(Form("dsig_ch%u", c), "", RooArgList(*x), &hsig);
+        RooHistFunc *fsig = new RooHistFunc(Form("sig_ch%u", c), "", RooArgSet(*x), *dsig);
+        m.hists.emplace_back(dsig);
+        m.owned.addOwned(*fsig);
+        RooArgList funcs(*fsig), coefs(*m.r), constraints;
+        expected[c].resize(nbins);
+        for (unsigned int b = 0; b < nbins; ++b) {
+            double bkg = 1000 * std::exp(-3.0 * b / nbins) * rnd.Uniform(0.8, 1.2);
+            expected[c][b] = bkg + hsig.GetBinContent(b + 1);
+            TH1D hbkg(Form("hbkg_ch%u_bin%u", c, b), "", nbins, 0, nbins);
+            hbkg.SetBinContent(b + 1, bkg);
+            RooDataHist *dbkg = new RooDataHist(Form("dbkg_ch%u_bin%u", c, b), "", RooArgList(*x), &hbkg);
+            RooHistFunc *fbkg = new RooHistFunc(Form("bkg_ch%u_bin%u", c, b), "", RooArgSet(*x), *dbkg);
+            RooRealVar *gamma = new RooRealVar(Form("prop_ch%u_bin%u", c, b), "", 0, -5, 5);
+            RooRealVar *gobs = new RooRealVar(Form("prop_ch%u_bin%u_In", c, b), "", 0, -5, 5);
+            gobs->setConstant(true);
+            RooRealVar *sigma = new RooRealVar(Form("prop_ch%u_bin%u_sigma", c, b), "", 1);
+            sigma->setConstant(true);
+            RooGaussian *constr = new RooGaussian(Form("prop_ch%u_bin%u_Pdf", c, b), "", *gobs, *gamma, *sigma);
+            // yield of the bin = bkg * (1 + 0.1 * gamma)
+            RooRealVar *unc = new RooRealVar(Form("prop_ch%u_bin%u_unc", c, b), "", 0.1);
+            unc->setConstant(true);
+            RooFormulaVar *coef = new RooFormulaVar(Form("coef_ch%u_bin%u", c, b), "", "1+@0*@1", RooArgList(*unc, *gamma));
+            m.hists.emplace_back(dbkg);
+            for (RooAbsArg *a : std::vector<RooAbsArg *>{fbkg, gamma, gobs, sigma, constr, unc, coef}) m.owned.addOwned(*a);
+            funcs.add(*fbkg);
+            coefs.add(*coef);
+            constraints.add(*constr);
+            m.nuisances.add(*gamma);
+            m.globalObs.add(*gobs);
+        }
+        RooRealSumPdf *sum = new RooRealSumPdf(Form("shapes_ch%u", c), "", funcs, coefs, true);
+        constraints.add(*sum);
+        RooProdPdf *prod = new RooProdPdf(Form("pdf_ch%u", c), "", constraints);
+        m.owned.addOwned(*sum);
+        m.owned.addOwned(*prod);
+        m.pdf->addPdf(*prod, Form("ch%u", c));
+    }
+    RooArgSet vars(m.observables);
+    vars.add(*m.cat);
+    vars.add(*weight);
+    m.data.reset(new RooDataSet("data_obs", "", vars, RooFit::WeightVar(*weight)));
+    for (unsigned int c = 0; c < nch; ++c) {
+        m.cat->setIndex(c);
+        RooRealVar *x = (RooRealVar *) m.observables.at(c);
+        for (unsigned int b = 0; b < nbins; ++b) {
+            x->setVal(b + 0.5);
+            m.data->add(vars, rnd.Poisson(expected[c][b]));
+        }
+    }
+}
+
+struct Result { double seconds, nll, r; bool ok; };
+
+Result fit(RooAbsReal &nll, Model &m, const RooArgSet &start, int rounds) {
+    std::unique_ptr<RooArgSet> params(nll.getParameters((const RooArgSet *)0));
+    params->assignValueOnly(start);
+    boost::program_options::variables_map vm;
+    std::vector<std::string> args{"--cminBlockCoordinate", std::to_string(rounds)};
+    boost::program_options::store(boost::program_options::command_line_parser(args).options(CascadeMinimizer::options()).run(), vm);
+    boost::program_options::notify(vm);
+    CascadeMinimizer::applyOptions(vm);
+    CascadeMinimizer minim(nll, CascadeMinimizer::Constrained, m.r);
+    minim.setStrategy(0);
+    auto begin = std::chrono::steady_clock::now();
+    bool ok = minim.minimize(0);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return Result{seconds, nll.getVal(), m.r->getVal(), ok};
+}
+
+int main(int argc, char **argv) {
+    unsigned int nch   = argc > 1 ? atoi(argv[1]) : 100;
+    unsigned int nbins = argc > 2 ? atoi(argv[2]) : 100;
+    int rounds         = argc > 3 ? atoi(argv[3]) : 5;
+    RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+    // as in bin/combine.cpp
+    for (const char *rtd : {"OPTIMIZE_BOUNDS", "ADDNLL_RECURSIVE", "ADDNLL_GAUSSNLL", "ADDNLL_HISTNLL", "ADDNLL_ROOREALSUM_FACTOR", "ADDNLL_ROOREALSUM_NONORM",
+                            "ADDNLL_ROOREALSUM_BASICINT", "ADDNLL_ROOREALSUM_KEEPZEROS", "ADDNLL_PRODNLL", "ADDNLL_ROOREALSUM_CHEAPPROD"}) {
+        runtimedef::set(rtd, 1);
+    }
+    CascadeMinimizer::initOptions();
+
+    Model m;
+    build(m, nch, nbins);
+    RooAbsReal *nll = m.pdf->createNLL(*m.data, RooFit::Constrain(m.nuisances), RooFit::GlobalObservables(m.globalObs));
+    if (dynamic_cast<cacheutils::CachingSimNLL *>(nll) == 0) { std::cerr << "ERROR: not a cacheutils::CachingSimNLL !" << std::endl; return 1; }
+    CascadeMinimizerGlobalConfigs::O().parametersOfInterest = RooArgList(*m.r);
+    CascadeMinimizerGlobalConfigs::O().nuisanceParameters = RooArgList(m.nuisances);
+    CascadeMinimizerGlobalConfigs::O().allFloatingParameters = RooArgList(m.nuisances);
+    CascadeMinimizerGlobalConfigs::O().allFloatingParameters.add(*m.r);
+
+    std::unique_ptr<RooArgSet> params(nll->getParameters((const RooArgSet *)0));
+    std::unique_ptr<RooArgSet> start(static_cast<RooArgSet *>(params->snapshot()));
+    printf("%u channels, %u bins: %u per-bin nuisances\n", nch, nbins, nch * nbins);
+
+    Result cascade = fit(*nll, m, *start, 0);
+    printf("default cascade:        %s, %.2f s, NLL %.6f, r = %.5f\n", cascade.ok ? "ok" : "failed", cascade.seconds, cascade.nll, cascade.r);
+    Result block = fit(*nll, m, *start, rounds);
+    printf("block-coordinate (%d):   %s, %.2f s, NLL %.6f, r = %.5f\n", rounds, block.ok ? "ok" : "failed", block.seconds, block.nll, block.r);
+    printf("speedup x%.2f, NLL difference %.3e, r difference %.3e\n", cascade.seconds / block.seconds, block.nll - cascade.nll, block.r - cascade.r);
+
+    bool ok = cascade.ok && block.ok && std::abs(block.nll - cascade.nll) < 0.01;
+    printf("%s\n", ok ? "OK" : "FAIL");
+    delete nll;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <TFile.h>
+#include <TKey.h>
+#include <TMemFile.h>
+#include <RooWorkspace.h>
+#include <RooRealVar.h>
+#include <RooRandom.h>
+#include <RooMsgService.h>
+#include <RooStats/ModelConfig.h>
+#include <RooStats/MarkovChain.h>
+#include <boost/program_options.hpp>
+#include "HiggsAnalysis/CombinedLimit/interface/Combine.h"
+#include "HiggsAnalysis/CombinedLimit/interface/MarkovChainMC.h"
+#include "HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h"
+
+// Run MarkovChainMC on the same model with the native Hamiltonian Monte Carlo sampler (--chains N --chainSampler hmc),
+// the native Metropolis one, and the RooStats MCMCCalculator with the 'ortho', 'uniform' and 'gaus' proposals
+// (--tries N), all with the same number of chains and iterations, and report the effective sample size of the POI
+// per second of wall time. The time is that of the whole MarkovChainMC::run, so for hmc it includes the NLL
+// evaluations of the numerical gradients.
+// Usage: benchChainSamplers.exe workspace.root [iterations=20000] [chains=4] [burnInSteps=500] [hmcSteps=10]
+
+struct Sampler {
+    std::string name;
+    std::vector<std::string> args;
+};
+
+// POI values of each step of the chains saved in dir, expanding the weights (number of steps spent at each point)
+std::vector<std::vector<double> > traces(TDirectory *dir, const char *poi) {
+    std::vector<std::vector<double> > ret;
+    for (TObject *k : *dir->GetListOfKeys()) {
+        RooStats::MarkovChain *chain = dynamic_cast<RooStats::MarkovChain *>(static_cast<TKey *>(k)->ReadObj());
+        if (chain == nullptr) continue;
+        ret.emplace_back();
+        for (int i = 0, n = chain->Size(); i < n; ++i) {
+            const RooArgSet *point = chain->Get(i);
+            double x = static_cast<RooRealVar *>(point->find(poi))->getVal();
+            for (int w = 0, nw = std::lround(chain->Weight()); w < nw; ++w) ret.back().push_back(x);
+        }
+        delete chain;
+    }
+    // the batch means need chains of the same length
+    if (!ret.empty()) {
+        size_t n = ret.front().size();
+        for (const std::vector<double> &t : ret) n = std::min(n, t.size());
+        for (std::vector<double> &t : ret) t.resize(n);
+    }
+    return ret;
+}
+
+int main(int argc, char **argv) {
+    if (argc <= 1) { printf("Usage: %s workspace.root [iterations=20000] [chains=4] [burnInSteps=500] [hmcSteps=10]\n", argv[0]); return 1; }
+    std::string iterations = argc > 2 ? argv[2] : "20000";
+    std::string chains     = argc > 3 ? argv[3] : "4";
+    std::string burnIn     = argc > 4 ? argv[4] : "500";
+    std::string hmcSteps   = argc > 5 ? argv[5] : "10";
+    RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+    runtimedef::set("ADDNLL_HISTNLL", 1);
+    runtimedef::set("ADDNLL_CBNLL", 1);
+    runtimedef::set("ADDNLL_HISTFUNCNLL", 1);
+    verbose = 0;
+
+    TFile *file = TFile::Open(argv[1]);
+    if (!file) { std::cerr << "ERROR: could not open " << argv[1] << std::endl; return 2; }
+    RooWorkspace *w = (RooWorkspace *) file->Get("w");
+    RooStats::ModelConfig *mc_s = (RooStats::ModelConfig *) w->genobj("ModelConfig");
+    RooStats::ModelConfig *mc_b = (RooStats::ModelConfig *) w->genobj("ModelConfig_bonly");
+    RooAbsData *data = w->data("data_obs");
+    const char *poi = mc_s->GetParametersOfInterest()->first()->GetName();
+    w->saveSnapshot("clean", w->allVars());
+
+    // every option that differs between the samplers is given to all of them, as their values are kept in statics
+    std::vector<Sampler> samplers = {
+        {"hmc",               {"--chains", chains, "--chainSampler", "hmc",        "--hmcSteps", hmcSteps, "--tries", "1", "--proposal", "ortho"}},
+        {"metropolis",        {"--chains", chains, "--chainSampler", "metropolis", "--hmcSteps", hmcSteps, "--tries", "1", "--proposal", "ortho"}},
+        {"RooStats ortho",    {"--chains", "0",    "--chainSampler", "metropolis", "--hmcSteps", hmcSteps, "--tries", chains, "--proposal", "ortho"}},
+        {"RooStats uniform",  {"--chains", "0",    "--chainSampler", "metropolis", "--hmcSteps", hmcSteps, "--tries", chains, "--proposal", "uniform"}},
+        {"RooStats gaus",     {"--chains", "0",    "--chainSampler", "metropolis", "--hmcSteps", hmcSteps, "--tries", chains, "--proposal", "gaus"}},
+    };
+
+    MarkovChainMC mcmc;
+    boost::program_options::options_description desc;
+    desc.add_options()("mass,m", boost::program_options::value<float>()->default_value(120.));
+    desc.add(mcmc.options());
+
+    printf("%-18s %10s %10s %10s %12s\n", "sampler", "time (s)", "limit", "ESS", "ESS/s");
+    for (const Sampler &s : samplers) {
+        std::vector<std::string> args(s.args);
+        for (const std::string &a : {std::string("--saveChain"), std::string("-i"), iterations, std::string("-b"), burnIn, std::string("--essTarget"), std::string("1e9")}) args.push_back(a);
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::command_line_parser(args).options(desc).run(), vm);
+        boost::program_options::notify(vm);
+        mcmc.applyOptions(vm);
+
+        TMemFile chainsFile("chains.root", "RECREATE");
+        writeToysHere = &chainsFile;
+        RooRandom::randomGenerator()->SetSeed(1);
+        w->loadSnapshot("clean");
+        double limit = 0, limitErr = 0;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = mcmc.run(w, mc_s, mc_b, *data, limit, limitErr, nullptr);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        writeToysHere = nullptr;
+
+        std::vector<std::vector<double> > t = traces(&chainsFile, poi);
+        int first = atoi(burnIn.c_str());
+        double ess = (ok && !t.empty() && int(t.front().size()) > first + 1) ? MarkovChainMC::effectiveSampleSize(t, first) : 0;
+        printf("%-18s %10.2f %10.4f %10.0f %12.2f%s\n", s.name.c_str(), seconds, limit, ess, seconds > 0 ? ess / seconds : 0., ok ? "" : "  (failed)");
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <RooRealVar.h>
+#include <RooGaussian.h>
+#include <RooDataSet.h>
+#include <RooAbsReal.h>
+#include <RooMinimizer.h>
+#include <RooMsgService.h>
+#include "HiggsAnalysis/CombinedLimit/interface/CloseCoutSentry.h"
+#include "HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h"
+
+// Dense scan of a simple likelihood, with a fit at each point as in MultiDimFit --algo grid, done with and
+// without a CloseCoutSentry around each fit: the difference is the overhead of the sentry.
+// The mode can't change within a process, so run it once per mode:
+// Usage: benchCloseCoutSentry.exe [points=5000] [thread]     ("thread" = silence only the calling thread, CLOSECOUT_THREAD)
+
+double scan(RooAbsReal &nll, RooRealVar &mean, unsigned int points, bool sentry) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < points; ++i) {
+        mean.setVal(-1 + 2.0 * i / points);
+        mean.setConstant(true);
+        CloseCoutSentry coutSentry(sentry);
+        RooMinimizer minim(nll);
+        minim.setPrintLevel(-1);
+        minim.minimize("Minuit2", "Migrad");
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+    unsigned int points = argc > 1 ? atoi(argv[1]) : 5000;
+    bool thread = argc > 2 && strcmp(argv[2], "thread") == 0;
+    if (thread) runtimedef::set("CLOSECOUT_THREAD", 1);
+    RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+
+    RooRealVar x("x", "x", -10, 10), mean("mean", "mean", 0, -5, 5), sigma("sigma", "sigma", 1, 0.1, 10);
+    RooGaussian gaus("gaus", "gaus", x, mean, sigma);
+    std::unique_ptr<RooDataSet> data(gaus.generate(x, 1000));
+    std::unique_ptr<RooAbsReal> nll(gaus.createNLL(*data));
+
+    scan(*nll, mean, points / 10, false); // warm up
+    double tplain = scan(*nll, mean, points, false);
+    double tsentry = scan(*nll, mean, points, true);
+    printf("%s mode, %u fits: %.3f s without sentry, %.3f s with it: %.2f us per fit (%.1f%%)\n",
+            CloseCoutSentry::useFileDescriptors() ? "file descriptor" : "thread", points, tplain, tsentry,
+            1e6 * (tsentry - tplain) / points, 100 * (tsentry - tplain) / tplain);
+    return 0;
+}
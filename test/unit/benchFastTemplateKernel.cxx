@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <TRandom3.h>
+#include "HiggsAnalysis/CombinedLimit/interface/FastTemplate_Old.h"
+#include "HiggsAnalysis/CombinedLimit/interface/FastTemplateKernel.h"
+
+// Vertical morphing of a template with nmorphs shape uncertainties in log scale (as for
+// FastVerticalInterpHistPdf2 and CMSHistFunc with LogQuadLinear), done with one pass over the bins
+// for each operation, and with FastTemplateKernel
+
+FastTemplate randomTemplate(unsigned int nbins, double mean, double sigma) {
+    FastTemplate ret(nbins);
+    for (unsigned int i = 0; i < nbins; ++i) ret[i] = gRandom->Gaus(mean, sigma);
+    return ret;
+}
+
+void bench(unsigned int nbins, unsigned int nmorphs, unsigned int ntimes) {
+    FastTemplate nominal = randomTemplate(nbins, 1.0, 0.1);
+    std::vector<FastTemplate> sums, diffs;
+    for (unsigned int i = 0; i < nmorphs; ++i) {
+        sums.push_back(randomTemplate(nbins, 0.0, 0.01));
+        diffs.push_back(randomTemplate(nbins, 0.0, 0.01));
+    }
+    std::vector<double> xs(nmorphs);
+    FastTemplate separate(nbins), fused(nbins);
+
+    double maxdiff = 0, tseparate = 0, tfused = 0;
+    for (unsigned int itime = 0; itime < ntimes; ++itime) {
+        for (unsigned int i = 0; i < nmorphs; ++i) xs[i] = gRandom->Gaus(0, 1);
+
+        auto start = std::chrono::steady_clock::now();
+        separate.CopyValues(nominal);
+        separate.Log();
+        for (unsigned int i = 0; i < nmorphs; ++i) separate.Meld(diffs[i], sums[i], 0.5*xs[i], xs[i]);
+        separate.Exp();
+        separate.CropUnderflows();
+        double isep = separate.Integral();
+        auto middle = std::chrono::steady_clock::now();
+        FastTemplateKernel kernel(fused);
+        kernel.copy(nominal).log();
+        for (unsigned int i = 0; i < nmorphs; ++i) kernel.meld(diffs[i], sums[i], 0.5*xs[i], xs[i]);
+        double ifus = kernel.exp().cropUnderflows().run();
+        auto end = std::chrono::steady_clock::now();
+
+        tseparate += std::chrono::duration<double>(middle - start).count();
+        tfused += std::chrono::duration<double>(end - middle).count();
+        for (unsigned int b = 0; b < nbins; ++b) maxdiff = std::max(maxdiff, std::abs(separate[b] - fused[b]));
+        maxdiff = std::max(maxdiff, std::abs(isep - ifus));
+    }
+    printf("%6u bins, %3u morphs: separate passes %8.3f us, fused kernel %8.3f us, speedup %5.2f, max difference %g\n",
+           nbins, nmorphs, 1e6*tseparate/ntimes, 1e6*tfused/ntimes, tseparate/tfused, maxdiff);
+}
+
+int main(int argc, char **argv) {
+    gRandom->SetSeed(42);
+    unsigned int nbins[3] = { 100, 1000, 10000 };
+    unsigned int nmorphs[3] = { 5, 20, 100 };
+    for (unsigned int ib = 0; ib < 3; ++ib) {
+        for (unsigned int im = 0; im < 3; ++im) {
+            bench(nbins[ib], nmorphs[im], 100000000 / (nbins[ib] * nmorphs[im]));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TROOT.h>
+#include <TObjString.h>
+#include "HiggsAnalysis/CombinedLimit/interface/AsyncOutputWriter.h"
+
+// Fork while an AsyncOutputWriter is active, as HybridNew --fork does with --asyncOutput. In the child, the
+// inherited writer is given more rows than its queue can hold and then destroyed: it must neither wait for nor
+// join the writer thread of the parent, which fork does not copy (a child stuck for more than 30 s is killed, and
+// counts as a failure). The child also runs a writer of its own on another file. The parent keeps using its
+// writer, and its file must have exactly the rows and objects it wrote.
+// Usage: testAsyncOutputFork.exe [rows=10000] [queue=4]
+
+int main(int argc, char **argv) {
+    unsigned int nrows  = argc > 1 ? atoi(argv[1]) : 10000;
+    unsigned int nqueue = argc > 2 ? atoi(argv[2]) : 4;
+    ROOT::EnableThreadSafety();
+    char fname[999]; snprintf(fname, 998, "%s/asyncfork-XXXXXX", P_tmpdir);
+    int fd = mkstemp(fname); close(fd);
+
+    int fails = 0;
+    {
+        TFile file(fname, "RECREATE");
+        TTree *tree = new TTree("limit", "");
+        double x; int i;
+        tree->Branch("x", &x, "x/D");
+        tree->Branch("i", &i, "i/I");
+        std::unique_ptr<AsyncOutputWriter> writer(new AsyncOutputWriter(tree, nqueue));
+        for (i = 0; i < int(nrows); ++i) { x = 0.5 * i; writer->fill(); }
+
+        fflush(stdout); fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            alarm(30);
+            // write into a file of its own, as the children of HybridNew do
+            TFile childFile(TString::Format("%s.child.root", fname), "RECREATE");
+            TTree *childTree = new TTree("limit", "");
+            childTree->Branch("x", &x, "x/D");
+            std::unique_ptr<AsyncOutputWriter> childWriter(new AsyncOutputWriter(childTree, nqueue));
+            for (unsigned int j = 0; j < 10 * nrows; ++j) { x = j; childWriter->fill(); }
+            // few enough rows that no basket of the inherited tree is written into the file of the parent
+            for (unsigned int j = 0; j < 10 * nqueue; ++j) writer->fill();
+            childWriter.reset();
+            writer.reset();
+            bool ok = (childTree->GetEntries() == 10 * nrows);
+            childFile.Close();
+            unlink(TString::Format("%s.child.root", fname).Data());
+            _exit(ok ? 0 : 2);
+        }
+        if (pid == -1) { printf("could not fork: %s FAIL\n", strerror(errno)); return 1; }
+
+        for (i = nrows; i < int(2 * nrows); ++i) { x = 0.5 * i; writer->fill(); }
+        writer->write(&file, new TObjString("parent"), "fromParent");
+        int status, ret;
+        do { ret = waitpid(pid, &status, 0); } while (ret == -1 && errno == EINTR);
+        if (ret == -1 || WIFSIGNALED(status)) {
+            printf("the child %s FAIL\n", ret == -1 ? "could not be waited for" : "was killed (stuck on the writer?)");
+            ++fails;
+        } else if (WEXITSTATUS(status) != 0) {
+            printf("the child failed with status %d FAIL\n", WEXITSTATUS(status));
+            ++fails;
+        }
+        writer.reset();
+        file.cd();
+        tree->Write();
+        file.Close();
+    }
+
+    TFile file(fname);
+    TTree *tree = (TTree *) file.Get("limit");
+    long entries = tree ? tree->GetEntries() : -1;
+    if (entries != long(2 * nrows)) { printf("%ld entries in the tree instead of %u FAIL\n", entries, 2 * nrows); ++fails; }
+    if (!file.Get("fromParent")) { printf("object of the parent missing FAIL\n"); ++fails; }
+    double x; int i;
+    if (tree) {
+        tree->SetBranchAddress("x", &x);
+        tree->SetBranchAddress("i", &i);
+        for (long j = 0; j < entries; ++j) {
+            tree->GetEntry(j);
+            if (i != j || x != 0.5 * j) { printf("entry %ld: i = %d, x = %g FAIL\n", j, i, x); ++fails; break; }
+        }
+    }
+    file.Close();
+    unlink(fname);
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include <TROOT.h>
+#include <TFile.h>
+#include <TRandom3.h>
+#include <RooWorkspace.h>
+#include <RooRealVar.h>
+#include <RooMsgService.h>
+#include <RooStats/ModelConfig.h>
+#include "HiggsAnalysis/CombinedLimit/interface/CachingNLL.h"
+#include "HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h"
+
+// Evaluate NLLs built from separate copies of the same workspace in parallel threads, and check that
+// they give the same values as a serial evaluation: the flags and error state of each NLL are in its
+// own NLLEvalContext, not in statics.
+// Usage: testNLLEvalContext.exe workspace.root [threads=4] [points=200]
+
+struct Model {
+    TFile *file;
+    RooWorkspace *w;
+    RooAbsReal *nll;
+    std::vector<RooRealVar *> vars;
+};
+
+Model load(const char *fname) {
+    Model m;
+    m.file = TFile::Open(fname);
+    if (!m.file) { std::cerr << "ERROR: could not open " << fname << std::endl; exit(2); }
+    m.w = (RooWorkspace *) m.file->Get("w");
+    RooStats::ModelConfig *mc = (RooStats::ModelConfig *) m.w->genobj("ModelConfig");
+    RooAbsData *d = m.w->data("data_obs");
+    const RooArgSet *nuisances = mc->GetNuisanceParameters();
+    m.nll = mc->GetPdf()->createNLL(*d, RooFit::Constrain(*nuisances), RooFit::Offset(true));
+    if (dynamic_cast<cacheutils::CachingSimNLL *>(m.nll) == 0) { std::cerr << "ERROR: not a cacheutils::CachingSimNLL !" << std::endl; exit(1); }
+    for (RooAbsArg *a : *nuisances) {
+        RooRealVar *rrv = dynamic_cast<RooRealVar *>(a);
+        if (rrv && !rrv->isConstant()) m.vars.push_back(rrv);
+    }
+    for (RooAbsArg *a : *mc->GetParametersOfInterest()) m.vars.push_back((RooRealVar *) a);
+    return m;
+}
+
+// the same sequence of points for all the models
+void evaluate(Model &m, unsigned int points, std::vector<double> &out) {
+    TRandom3 rnd(37);
+    out.clear();
+    for (unsigned int i = 0; i < points; ++i) {
+        for (RooRealVar *v : m.vars) v->setVal(v->getMin() + rnd.Uniform() * 0.2 * (v->getMax() - v->getMin()));
+        out.push_back(m.nll->getVal());
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc <= 1) { printf("Usage: %s workspace.root [threads=4] [points=200]\n", argv[0]); return 1; }
+    unsigned int nthreads = argc > 2 ? atoi(argv[2]) : 4;
+    unsigned int points   = argc > 3 ? atoi(argv[3]) : 200;
+    ROOT::EnableThreadSafety();
+    RooMsgService::instance().setGlobalKillBelow(RooFit::ERROR);
+    runtimedef::set("ADDNLL_HISTNLL", 1);
+    runtimedef::set("ADDNLL_CBNLL", 1);
+
+    // the models and NLLs are made serially: only the evaluation runs in parallel
+    std::vector<Model> models;
+    for (unsigned int i = 0; i <= nthreads; ++i) models.push_back(load(argv[1]));
+
+    std::vector<double> serial;
+    evaluate(models[0], points, serial);
+
+    std::vector<std::vector<double> > parallel(nthreads);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        threads.emplace_back(evaluate, std::ref(models[i+1]), points, std::ref(parallel[i]));
+    }
+    for (std::thread &t : threads) t.join();
+
+    int fails = 0;
+    for (unsigned int i = 0; i < nthreads; ++i) {
+        for (unsigned int j = 0; j < points; ++j) {
+            if (parallel[i][j] != serial[j] && !(std::isnan(parallel[i][j]) && std::isnan(serial[j]))) {
+                if (++fails < 20) printf("thread %u, point %u: serial %.12g, parallel %.12g FAIL\n", i, j, serial[j], parallel[i][j]);
+            }
+        }
+        const cacheutils::NLLEvalContext &context = dynamic_cast<cacheutils::CachingSimNLL *>(models[i+1].nll)->evalContext();
+        printf("thread %u: %s (errors flagged: %d)\n", i, fails ? "FAIL" : "OK", int(context.hasError));
+    }
+    printf("%u threads, %u points: %s\n", nthreads, points, fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
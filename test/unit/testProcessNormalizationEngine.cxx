@@ -0,0 +1,97 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <TRandom3.h>
+#include <RooRealVar.h>
+#include "HiggsAnalysis/CombinedLimit/interface/ProcessNormalizationEngine.h"
+#include "HiggsAnalysis/CombinedLimit/interface/CombineMathFuncs.h"
+
+// Compare the values of the ProcessNormalizationEngine with the direct evaluation of each process
+// (RooFit::Detail::MathFuncs::processNormalization, as done by ProcessNormalization without the engine),
+// after changing one nuisance at a time as a minimizer does for the gradient, and time the two.
+// Processes are also removed and added again, to check that the rows and columns are reused correctly.
+// Usage: testProcessNormalizationEngine.exe [processes=2000] [nuisances=500] [per-process=20] [steps=2000]
+
+struct Process {
+    std::vector<unsigned int> thetas, asymmThetas;
+    std::vector<double> logKappas, logKappasLow, logKappasHigh;
+    unsigned int row;
+};
+
+double direct(const Process &p, const std::vector<std::unique_ptr<RooRealVar> > &vars) {
+    std::vector<double> thetas, asymmThetas;
+    for (unsigned int i : p.thetas) thetas.push_back(vars[i]->getVal());
+    for (unsigned int i : p.asymmThetas) asymmThetas.push_back(vars[i]->getVal());
+    return RooFit::Detail::MathFuncs::processNormalization(1.0, thetas.size(), asymmThetas.size(), 0, thetas.data(), p.logKappas.data(),
+                                                           asymmThetas.data(), p.logKappasLow.data(), p.logKappasHigh.data(), nullptr);
+}
+
+void add(ProcessNormalizationEngine &engine, Process &p, const std::vector<std::unique_ptr<RooRealVar> > &vars) {
+    std::vector<const RooAbsReal *> thetas, asymmThetas;
+    for (unsigned int i : p.thetas) thetas.push_back(vars[i].get());
+    for (unsigned int i : p.asymmThetas) asymmThetas.push_back(vars[i].get());
+    p.row = engine.addProcess(thetas, p.logKappas, asymmThetas, p.logKappasLow, p.logKappasHigh);
+}
+
+int main(int argc, char **argv) {
+    unsigned int nproc  = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int nvars  = argc > 2 ? atoi(argv[2]) : 500;
+    unsigned int perproc = argc > 3 ? atoi(argv[3]) : 20;
+    unsigned int nsteps = argc > 4 ? atoi(argv[4]) : 2000;
+    TRandom3 rnd(42);
+
+    std::vector<std::unique_ptr<RooRealVar> > vars;
+    for (unsigned int i = 0; i < nvars; ++i) vars.emplace_back(new RooRealVar(Form("theta_%u", i), "", rnd.Gaus(0, 0.5), -5, 5));
+    std::vector<Process> procs(nproc);
+    for (Process &p : procs) {
+        for (unsigned int j = 0; j < perproc; ++j) {
+            unsigned int i = rnd.Integer(nvars);
+            if (rnd.Uniform() < 0.7) {
+                p.thetas.push_back(i);
+                p.logKappas.push_back(std::log(1 + rnd.Uniform(0.01, 0.3)));
+            } else {
+                p.asymmThetas.push_back(i);
+                p.logKappasLow.push_back(std::log(1 - rnd.Uniform(0.01, 0.3)));
+                p.logKappasHigh.push_back(std::log(1 + rnd.Uniform(0.01, 0.3)));
+            }
+        }
+    }
+
+    ProcessNormalizationEngine &engine = ProcessNormalizationEngine::instance();
+    for (Process &p : procs) add(engine, p, vars);
+
+    int fails = 0;
+    double tdirect = 0, tengine = 0;
+    for (unsigned int step = 0; step < nsteps; ++step) {
+        vars[rnd.Integer(nvars)]->setVal(rnd.Gaus(0, 1));
+        if (step % 100 == 99) {
+            // replace some processes, as when the NLLs are rebuilt
+            for (unsigned int k = 0; k < 10; ++k) {
+                Process &p = procs[rnd.Integer(nproc)];
+                engine.removeProcess(p.row);
+                add(engine, p, vars);
+            }
+        }
+        double sumDirect = 0, sumEngine = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const Process &p : procs) sumDirect += direct(p, vars);
+        auto middle = std::chrono::steady_clock::now();
+        for (const Process &p : procs) sumEngine += engine.value(p.row);
+        auto end = std::chrono::steady_clock::now();
+        tdirect += std::chrono::duration<double>(middle - start).count();
+        tengine += std::chrono::duration<double>(end - middle).count();
+        if (sumDirect != sumEngine) {
+            for (const Process &p : procs) {
+                if (direct(p, vars) != engine.value(p.row) && ++fails < 20) printf("step %u, row %u: direct %.17g, engine %.17g FAIL\n", step, p.row, direct(p, vars), engine.value(p.row));
+            }
+        }
+    }
+    if (engine.processes() != nproc) { printf("%u processes in the engine instead of %u FAIL\n", engine.processes(), nproc); ++fails; }
+    if (engine.nuisances() > nvars) { printf("%u nuisances in the engine, more than %u FAIL\n", engine.nuisances(), nvars); ++fails; }
+    printf("%u processes, %u steps: direct %.3f s, engine %.3f s (x%.2f)\n", nproc, nsteps, tdirect, tengine, tdirect / tengine);
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <TRandom3.h>
+#include <TTree.h>
+#include <RooRealVar.h>
+#include <RooListProxy.h>
+#include "HiggsAnalysis/CombinedLimit/interface/RooSplineND.h"
+
+// Check the evaluation of RooSplineND against a brute-force reference, from given points and weights:
+// - with the Gaussian kernel, against the loop over all the points of the previous implementation
+//   (two std::map lookups per point and dimension), which must give the same values
+// - with the TruncatedGaussian and Wendland kernels, against the sum over all the points, with the kernel set to
+//   zero beyond its support: a point missed by the k-d tree changes the value (by at least w*exp(-cutoff^2) for
+//   the truncated gaussian, which is discontinuous at the cutoff)
+// each with and without the rescaling of the axes. Then solve for the weights of a spline with each compactly
+// supported kernel from a tree and check that it goes through the sample points, and check that a
+// TruncatedGaussian without a positive cutoff is rejected.
+// Usage: testRooSplineND.exe [points=2000] [evaluations=500]
+
+const int ndim = 3;
+
+struct Sample {
+    std::map<int, std::vector<double> > v;
+    std::map<int, std::pair<double, double> > r;
+    std::vector<double> w;
+    int M;
+};
+
+double distSquare(const Sample &s, int i, const double *x, bool rescale) {
+    double axis_pts = std::pow(s.M, 1. / ndim), d2 = 0;
+    for (int k = 0; k < ndim; ++k) {
+        double dk = s.v.at(k)[i] - x[k];
+        if (rescale) dk = axis_pts * dk / (s.r.at(k).second - s.r.at(k).first);
+        d2 += dk * dk;
+    }
+    return d2;
+}
+
+double kernel(int type, double d2, double eps, double cutoff) {
+    if (type == RooSplineND::Wendland) {
+        double r = std::sqrt(d2) / eps;
+        if (r >= 1) return 0.;
+        int l = ndim / 2 + 2;
+        return std::pow(1 - r, l + 1) * ((l + 1) * r + 1);
+    }
+    if (type == RooSplineND::TruncatedGaussian && d2 / (eps * eps) > cutoff * cutoff) return 0.;
+    return std::exp(-d2 / (eps * eps));
+}
+
+int check(int type, double eps, bool rescale, Sample &s, RooArgList &vars, unsigned int nevals, TRandom3 &rnd) {
+    const double cutoff = 2.5;
+    RooRealVar holder("holder", "", 0);
+    RooListProxy proxy("vars", "", &holder);
+    proxy.add(vars);
+    RooSplineND spline("spline", "", proxy, ndim, s.M, eps, rescale, s.w, s.v, s.r, 0., 1., type, cutoff);
+    int fails = 0;
+    double neighbours = 0;
+    for (unsigned int e = 0; e < nevals; ++e) {
+        double x[ndim];
+        for (int k = 0; k < ndim; ++k) {
+            x[k] = rnd.Uniform(s.r[k].first, s.r[k].second);
+            static_cast<RooRealVar &>(vars[k]).setVal(x[k]);
+        }
+        double ref = 0, norm = 0;
+        for (int i = 0; i < s.M; ++i) {
+            if (s.w[i] == 0) continue;
+            double rad = kernel(type, distSquare(s, i, x, rescale), eps, cutoff);
+            ref += s.w[i] * rad;
+            norm += std::abs(s.w[i] * rad);
+            if (rad != 0) neighbours++;
+        }
+        double val = spline.getVal();
+        // the gaussian kernel adds the same terms in the same order as before; the others in the order of the tree
+        if (std::abs(val - ref) > 1e-12 * norm && ++fails < 10) {
+            printf("kernel %d, rescale %d: %.17g instead of %.17g at (%g, %g, %g) FAIL\n", type, rescale, val, ref, x[0], x[1], x[2]);
+        }
+    }
+    printf("kernel %d, rescale %d: %.1f points on average within the support, %s\n", type, rescale, neighbours / nevals, fails ? "FAIL" : "OK");
+    return fails;
+}
+
+int main(int argc, char **argv) {
+    int M                = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int nevals  = argc > 2 ? atoi(argv[2]) : 500;
+    TRandom3 rnd(42);
+
+    // axes of different ranges, so that the rescaling matters
+    const double lo[ndim] = {0, -5, 100}, hi[ndim] = {1, 5, 300};
+    RooArgList vars;
+    std::vector<std::unique_ptr<RooRealVar> > owned;
+    for (int k = 0; k < ndim; ++k) {
+        owned.emplace_back(new RooRealVar(Form("x%d", k), "", lo[k], lo[k], hi[k]));
+        vars.add(*owned.back());
+    }
+    Sample s;
+    s.M = M;
+    for (int k = 0; k < ndim; ++k) {
+        s.v[k].resize(M);
+        s.r[k] = std::make_pair(1e6, -1e6);
+    }
+    for (int i = 0; i < M; ++i) {
+        for (int k = 0; k < ndim; ++k) {
+            double val = rnd.Uniform(lo[k], hi[k]);
+            s.v[k][i] = val;
+            s.r[k].first = std::min(s.r[k].first, val);
+            s.r[k].second = std::max(s.r[k].second, val);
+        }
+        s.w.push_back(i % 17 == 0 ? 0. : rnd.Gaus(0, 1));
+    }
+
+    int fails = 0;
+    for (bool rescale : {false, true}) {
+        // eps of about three times the distance between points, as on the rescaled axes
+        double eps = rescale ? 3. : 0.3;
+        fails += check(RooSplineND::Gaussian, eps, rescale, s, vars, nevals, rnd);
+        fails += check(RooSplineND::TruncatedGaussian, eps, rescale, s, vars, nevals, rnd);
+        fails += check(RooSplineND::Wendland, 2 * eps, rescale, s, vars, nevals, rnd);
+    }
+
+    // solve for the weights from a tree of a smooth function, which the spline must then go through
+    TTree tree("tree", "");
+    float b[ndim], f;
+    for (int k = 0; k < ndim; ++k) tree.Branch(Form("x%d", k), &b[k], Form("x%d/F", k));
+    tree.Branch("f", &f, "f/F");
+    const int ntree = 500;
+    for (int i = 0; i < ntree; ++i) {
+        for (int k = 0; k < ndim; ++k) b[k] = rnd.Uniform(lo[k], hi[k]);
+        f = std::sin(3 * b[0]) + 0.1 * b[1] + 0.01 * b[2];
+        tree.Fill();
+    }
+    for (int type : {int(RooSplineND::TruncatedGaussian), int(RooSplineND::Wendland)}) {
+        // a narrower gaussian, for a well-conditioned matrix
+        RooSplineND spline("fitted", "", vars, &tree, "f", type == RooSplineND::Wendland ? 3. : 1., true, "", type, 2.5);
+        // the constructor reads the tree into its own buffers
+        for (int k = 0; k < ndim; ++k) tree.SetBranchAddress(Form("x%d", k), &b[k]);
+        tree.SetBranchAddress("f", &f);
+        int bad = 0;
+        for (int i = 0; i < ntree; ++i) {
+            tree.GetEntry(i);
+            for (int k = 0; k < ndim; ++k) static_cast<RooRealVar &>(vars[k]).setVal(b[k]);
+            if (std::abs(spline.getVal() - f) > 1e-5 && ++bad < 10) printf("kernel %d: %.9g instead of %.9g at sample point %d FAIL\n", type, spline.getVal(), f, i);
+        }
+        printf("kernel %d: spline through the %d sample points %s\n", type, ntree, bad ? "FAIL" : "OK");
+        fails += bad;
+    }
+
+    try {
+        RooSplineND spline("nocutoff", "", vars, &tree, "f", 3., true, "", RooSplineND::TruncatedGaussian, 0.);
+        printf("TruncatedGaussian kernel with a zero cutoff accepted FAIL\n");
+        ++fails;
+    } catch (const std::invalid_argument &e) {
+        printf("TruncatedGaussian kernel with a zero cutoff rejected: %s\n", e.what());
+    }
+
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
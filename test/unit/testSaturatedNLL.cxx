@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <TList.h>
+#include <TRandom3.h>
+#include <RooRealVar.h>
+#include <RooCategory.h>
+#include <RooDataSet.h>
+#include <RooExponential.h>
+#include <RooExtendPdf.h>
+#include "HiggsAnalysis/CombinedLimit/interface/Combine.h"
+#include "HiggsAnalysis/CombinedLimit/interface/CachingNLL.h"
+#include "HiggsAnalysis/CombinedLimit/interface/GoodnessOfFit.h"
+#include "HiggsAnalysis/CombinedLimit/interface/RooSimultaneousOpt.h"
+
+// Compare the saturated model nll of the channels computed directly from the data, as GoodnessOfFit does by
+// default, with the nll of the saturated model that GoodnessOfFit builds and fits with GOF_SATURATED_FIT on, on a
+// small binned model with two channels: one with weighted entries at the bin centres, some with zero weight and
+// one bin without an entry, and one with unit-weight events, several in most bins and none in one. The model has
+// no constraint terms, so the saturated model has no parameters and its best fit value is its value.
+// Usage: testSaturatedNLL.exe [events=500]
+
+// gives access to the saturated model helpers of GoodnessOfFit
+struct TestGoF : public GoodnessOfFit {
+    using GoodnessOfFit::makeSaturatedPdf;
+    using GoodnessOfFit::saturatedChannelNLLs;
+    void setPdf(RooAbsPdf *pdf) { obsOnlyPdf_ = pdf; }
+};
+
+int main(int argc, char **argv) {
+    unsigned int nevents = argc > 1 ? atoi(argv[1]) : 500;
+    TRandom3 rnd(42);
+
+    RooRealVar x("x", "", 0.5, 0., 12.); x.setBins(12);
+    RooRealVar y("y", "", 0.5, 0., 5.);  y.setBins(5);
+    RooRealVar weight("weight", "", 1.);
+    RooCategory cat("CMS_channel", "");
+    cat.defineType("a", 0);
+    cat.defineType("b", 1);
+
+    // nominal model: only its channels and their observables are used
+    RooRealVar ka("ka", "", -0.2), kb("kb", "", -0.5), na("na", "", 100.), nb("nb", "", 100.);
+    RooExponential ea("ea", "", x, ka), eb("eb", "", y, kb);
+    RooExtendPdf pa("pa", "", ea, na), pb("pb", "", eb, nb);
+    RooSimultaneousOpt sim("sim", "", cat);
+    sim.addPdf(pa, "a");
+    sim.addPdf(pb, "b");
+
+    RooArgSet vars(x, y, cat, weight);
+    RooDataSet data("data_obs", "", vars, "weight");
+    cat.setLabel("a");
+    for (int b = 0; b < 11; ++b) {
+        x.setVal(b + 0.5);
+        data.add(RooArgSet(x, y, cat), (b == 3 || b == 8) ? 0. : 40. * std::exp(-0.2 * b) + 0.25 * b);
+    }
+    cat.setLabel("b");
+    for (unsigned int i = 0; i < nevents; ++i) {
+        double v;
+        do { v = rnd.Exp(2.); } while (v >= 5. || (v >= 2. && v < 3.));
+        y.setVal(v);
+        data.add(RooArgSet(x, y, cat), 1.);
+    }
+
+    int fails = 0;
+    TestGoF gof;
+    gof.setPdf(&sim);
+    std::vector<double> nlls;
+    if (!gof.saturatedChannelNLLs(data, nlls)) {
+        printf("saturated nll of the channels not computed FAIL\n");
+        printf("FAIL\n");
+        return 1;
+    }
+
+    // the saturated model of GOF_SATURATED_FIT, built as in GoodnessOfFit::runSaturatedModel
+    std::unique_ptr<TList> datasets(data.split(cat, true));
+    RooSimultaneousOpt satsim("sim_saturated", "", cat);
+    for (int ic = 0; ic < cat.numBins((const char *)0); ++ic) {
+        cat.setBin(ic);
+        RooAbsData *datai = (RooAbsData *) datasets->FindObject(cat.getLabel());
+        std::unique_ptr<RooArgSet> data_observables(sim.getPdf(cat.getLabel())->getObservables(datai));
+        std::unique_ptr<RooAbsData> data_reduced(datai->reduce(*data_observables));
+        RooAbsPdf *saturatedPdfi = gof.makeSaturatedPdf(*data_reduced);
+        satsim.addPdf(*saturatedPdfi, cat.getLabel());
+        satsim.addOwnedComponents(*saturatedPdfi);
+
+        // each channel alone against its own saturated model
+        cacheutils::CachingAddNLL nlli("nlli", "", saturatedPdfi, data_reduced.get());
+        nlli.clearConstantZeroPoint();
+        double ref = nlli.getVal();
+        bool bad = std::abs(nlls[ic] - ref) > 1e-9 * std::max(1., std::abs(ref));
+        printf("channel %s: %.12g, fitted saturated model %.12g%s\n", cat.getLabel(), nlls[ic], ref, bad ? " FAIL" : "");
+        fails += bad;
+    }
+
+    std::unique_ptr<RooAbsReal> satnll = combineCreateNLL(satsim, data);
+    cacheutils::CachingSimNLL *simnll = dynamic_cast<cacheutils::CachingSimNLL *>(satnll.get());
+    if (simnll == 0) {
+        printf("nll of the saturated model not a cacheutils::CachingSimNLL FAIL\n");
+        ++fails;
+    } else {
+        simnll->clearConstantZeroPoint();
+    }
+    double sum = 0;
+    for (double nll : nlls) sum += nll;
+    double ref = satnll->getVal();
+    bool bad = std::abs(sum - ref) > 1e-9 * std::max(1., std::abs(ref));
+    printf("all channels: %.12g, fitted saturated model %.12g%s\n", sum, ref, bad ? " FAIL" : "");
+    fails += bad;
+
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
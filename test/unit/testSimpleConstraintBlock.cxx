@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <TRandom3.h>
+#include <RooRealVar.h>
+#include <RooConstVar.h>
+#include <RooFormulaVar.h>
+#include "HiggsAnalysis/CombinedLimit/interface/SimpleConstraintBlock.h"
+#include "HiggsAnalysis/CombinedLimit/interface/Accumulators.h"
+
+// Compare the sum of the constraint terms from a SimpleConstraintBlock with the sum of getLogValFast() over the
+// same constraints, in the same order and with the same zero points, as CachingSimNLL computed it without the
+// block. The parameters are moved one at a time, a few at a time and all at once, so that both the sparse and
+// the full recomputation are used; some constraints have a RooFormulaVar mean, which is not read directly.
+// The two sums must be identical.
+// Usage: testSimpleConstraintBlock.exe [gaussians=1000] [poissons=200] [steps=1000]
+
+int main(int argc, char **argv) {
+    unsigned int ngaus  = argc > 1 ? atoi(argv[1]) : 1000;
+    unsigned int npois  = argc > 2 ? atoi(argv[2]) : 200;
+    unsigned int nsteps = argc > 3 ? atoi(argv[3]) : 1000;
+    TRandom3 rnd(42);
+
+    RooArgList owned;
+    std::vector<RooRealVar *> params;
+    std::vector<SimpleGaussianConstraint *> gaus;
+    std::vector<SimplePoissonConstraint *> pois;
+    RooRealVar *shift = new RooRealVar("shift", "", 0, -5, 5);
+    owned.addOwned(*shift);
+    params.push_back(shift);
+    for (unsigned int i = 0; i < ngaus; ++i) {
+        RooRealVar *x = new RooRealVar(Form("theta_%u", i), "", rnd.Gaus(0, 1), -5, 5);
+        RooAbsReal *sigma = new RooConstVar(Form("theta_%u_sigma", i), "", rnd.Uniform(0.5, 2));
+        RooAbsReal *mean;
+        if (i % 10 == 9) {
+            mean = new RooFormulaVar(Form("theta_%u_mean", i), "", "0.1*@0", RooArgList(*shift));
+        } else if (i % 2) {
+            mean = new RooConstVar(Form("theta_%u_In", i), "", rnd.Gaus(0, 0.5));
+        } else {
+            RooRealVar *gobs = new RooRealVar(Form("theta_%u_In", i), "", rnd.Gaus(0, 0.5), -5, 5);
+            gobs->setConstant(true);
+            mean = gobs;
+        }
+        SimpleGaussianConstraint *c = new SimpleGaussianConstraint(Form("theta_%u_Pdf", i), "", *x, *mean, *sigma);
+        for (RooAbsArg *a : std::vector<RooAbsArg *>{x, sigma, mean, c}) owned.addOwned(*a);
+        params.push_back(x);
+        gaus.push_back(c);
+    }
+    for (unsigned int i = 0; i < npois; ++i) {
+        double n = std::round(rnd.Uniform(0, 50)) + (i % 20 == 19 ? 2e6 : 0); // a few in the gaussian approximation
+        RooRealVar *obs = new RooRealVar(Form("gamma_%u_In", i), "", n, 0, 1e7);
+        obs->setConstant(true);
+        RooAbsReal *mean;
+        if (i % 10 == 9) {
+            mean = new RooFormulaVar(Form("gamma_%u_mean", i), "", "@0*(1+0.01*@1)", RooArgList(*obs, *shift));
+        } else {
+            RooRealVar *m = new RooRealVar(Form("gamma_%u", i), "", std::max(n, 1.), 0.1, 1e7);
+            params.push_back(m);
+            mean = m;
+        }
+        SimplePoissonConstraint *c = new SimplePoissonConstraint(Form("gamma_%u_Pdf", i), "", *obs, *mean, true);
+        for (RooAbsArg *a : std::vector<RooAbsArg *>{obs, mean, c}) owned.addOwned(*a);
+        pois.push_back(c);
+    }
+
+    SimpleConstraintBlock block;
+    for (SimpleGaussianConstraint *c : gaus) block.add(c);
+    for (SimplePoissonConstraint *c : pois) block.add(c);
+    std::vector<double> gausZero(ngaus, 0), poisZero(npois, 0);
+
+    int fails = 0;
+    for (unsigned int step = 0; step < nsteps; ++step) {
+        // one parameter, about 1/20, or all of them
+        unsigned int nmove = (step % 10 == 9 ? params.size() : (step % 3 == 2 ? params.size() / 20 + 1 : 1));
+        for (unsigned int k = 0; k < nmove; ++k) {
+            unsigned int ip = (nmove == params.size() ? k : rnd.Integer(params.size()));
+            // shift and the gaussian parameters come first, then the means of the poissons
+            RooRealVar *v = params[ip];
+            v->setVal(ip <= ngaus ? rnd.Gaus(0, 1) : v->getVal() * rnd.Uniform(0.9, 1.1));
+        }
+        if (step % 250 == 100) {
+            block.setZeroPoint();
+            for (unsigned int i = 0; i < ngaus; ++i) gausZero[i] = -gaus[i]->getLogValFast();
+            for (unsigned int i = 0; i < npois; ++i) poisZero[i] = -pois[i]->getLogValFast();
+        } else if (step % 250 == 200) {
+            block.clearZeroPoint();
+            std::fill(gausZero.begin(), gausZero.end(), 0.);
+            std::fill(poisZero.begin(), poisZero.end(), 0.);
+        }
+        DefaultAccumulator<double> ref = 0, blk = 0;
+        for (unsigned int i = 0; i < ngaus; ++i) ref += (gaus[i]->getLogValFast() + gausZero[i]);
+        for (unsigned int i = 0; i < npois; ++i) ref += (pois[i]->getLogValFast() + poisZero[i]);
+        block.addTo(blk);
+        if (ref.sum() != blk.sum() && ++fails < 20) printf("step %u (%u moved): direct %.17g, block %.17g FAIL\n", step, nmove, ref.sum(), blk.sum());
+    }
+    printf("%u gaussians, %u poissons, %u steps\n", ngaus, npois, nsteps);
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <typeinfo>
+#include <vector>
+#include <TH1F.h>
+#include <TRandom3.h>
+#include <RooRealVar.h>
+#include <RooFormulaVar.h>
+#include <RooDataSet.h>
+#include "HiggsAnalysis/CombinedLimit/interface/CachingNLL.h"
+#include "HiggsAnalysis/CombinedLimit/interface/ProfilingTools.h"
+#include "HiggsAnalysis/CombinedLimit/interface/FastTemplateFunc.h"
+#include "HiggsAnalysis/CombinedLimit/interface/HZZ4L_RooSpinZeroPdf_1D_fast.h"
+
+// Compare the values of a HZZ4L_RooSpinZeroPdf_1D_fast on a dataset from the vectorized caching pdf made by
+// makeCachingPdf (with ADDNLL_SPINZERONLL on, as in combine) with those of the generic CachingPdf, over a scan of
+// fai1 that includes the pure and the mixed states. Then check that a pdf whose templates depend on a parameter,
+// and so can't be vectorized, gets the generic CachingPdf instead of an exception.
+// Usage: testVectorizedSpinZeroPdf.exe [entries=2000] [points=41]
+
+TH1F *makeTemplate(const char *name, int shape, TRandom3 &rnd) {
+    TH1F *h = new TH1F(name, "", 25, 0., 10.);
+    for (int b = 1; b <= h->GetNbinsX(); ++b) {
+        double x = h->GetBinCenter(b);
+        // the interference template changes sign, and one bin of the others is empty
+        double y = shape == 0 ? std::exp(-0.3 * x) : shape == 1 ? 0.1 + 0.05 * x : 0.2 * std::sin(x);
+        h->SetBinContent(b, (shape < 2 && b == 7) ? 0. : y * rnd.Uniform(0.9, 1.1));
+    }
+    return h;
+}
+
+int main(int argc, char **argv) {
+    unsigned int nentries = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int npoints  = argc > 2 ? atoi(argv[2]) : 41;
+    runtimedef::set("ADDNLL_SPINZERONLL", 1);
+    TRandom3 rnd(42);
+
+    RooRealVar x("x", "", 5., 0., 10.);
+    RooRealVar fai1("fai1", "", 0., -1., 1.);
+    RooArgList obs(x);
+    std::vector<std::unique_ptr<TH1F> > hists;
+    std::vector<std::unique_ptr<FastHistoFunc_f> > templates;
+    RooArgList components;
+    for (int k = 0; k < 3; ++k) {
+        hists.emplace_back(makeTemplate(Form("h%d", k), k, rnd));
+        FastHisto_f tpl(*hists.back());
+        templates.emplace_back(new FastHistoFunc_f(Form("T%d", k), "", obs, tpl));
+        components.add(*templates.back());
+    }
+    HZZ4L_RooSpinZeroPdf_1D_fast pdf("pdf", "", fai1, obs, components);
+
+    RooArgSet vars(x);
+    RooDataSet data("data", "", vars);
+    for (unsigned int i = 0; i < nentries; ++i) {
+        x.setVal(rnd.Uniform(0., 10.));
+        data.add(vars);
+    }
+
+    int fails = 0;
+    std::unique_ptr<cacheutils::CachingPdfBase> vectorized(cacheutils::makeCachingPdf(&pdf, data.get()));
+    if (typeid(*vectorized) == typeid(cacheutils::CachingPdf)) {
+        printf("the pdf is not vectorized FAIL\n");
+        ++fails;
+    }
+    cacheutils::CachingPdf generic(&pdf, data.get());
+    double maxdiff = 0;
+    for (unsigned int p = 0; p < npoints; ++p) {
+        fai1.setVal(-1. + 2. * p / (npoints - 1));
+        const std::vector<Double_t> &vals = vectorized->eval(data);
+        const std::vector<Double_t> &ref = generic.eval(data);
+        if (vals.size() != ref.size()) {
+            printf("fai1 = %g: %u values instead of %u FAIL\n", fai1.getVal(), unsigned(vals.size()), unsigned(ref.size()));
+            ++fails;
+            continue;
+        }
+        for (unsigned int i = 0; i < ref.size(); ++i) {
+            double diff = std::abs(vals[i] - ref[i]) / std::max(std::abs(ref[i]), 1e-100);
+            maxdiff = std::max(maxdiff, diff);
+            // the same float arithmetic as interpolateFcn, so the values only differ by rounding
+            if (diff > 1e-6 && ++fails < 10) printf("fai1 = %g, entry %u: %.9g instead of %.9g FAIL\n", fai1.getVal(), i, vals[i], ref[i]);
+        }
+    }
+    printf("%u entries, %u values of fai1: largest relative difference %g\n", nentries, npoints, maxdiff);
+
+    // templates of x shifted by a parameter: the components are not pure templates, and the integral is not analytical
+    RooRealVar shift("shift", "", 0.1, -1., 1.);
+    RooFormulaVar xs("xs", "", "@0+@1", RooArgList(x, shift));
+    RooArgList shiftedObs(xs);
+    std::vector<std::unique_ptr<FastHistoFunc_f> > shiftedTemplates;
+    RooArgList shiftedComponents;
+    for (int k = 0; k < 3; ++k) {
+        FastHisto_f tpl(*hists[k]);
+        shiftedTemplates.emplace_back(new FastHistoFunc_f(Form("S%d", k), "", shiftedObs, tpl));
+        shiftedComponents.add(*shiftedTemplates.back());
+    }
+    HZZ4L_RooSpinZeroPdf_1D_fast shifted("shifted", "", fai1, obs, shiftedComponents);
+    try {
+        std::unique_ptr<cacheutils::CachingPdfBase> fallback(cacheutils::makeCachingPdf(&shifted, data.get()));
+        if (typeid(*fallback) != typeid(cacheutils::CachingPdf)) {
+            printf("pdf with parameters in its templates vectorized FAIL\n");
+            ++fails;
+        } else {
+            fallback->eval(data);
+            printf("pdf with parameters in its templates: generic CachingPdf\n");
+        }
+    } catch (const std::exception &e) {
+        printf("pdf with parameters in its templates rejected: %s FAIL\n", e.what());
+        ++fails;
+    }
+
+    printf("%s\n", fails ? "FAIL" : "OK");
+    return fails ? 1 : 0;
+}